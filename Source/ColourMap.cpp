@@ -0,0 +1,48 @@
+#include "ColourMap.h"
+
+namespace TriggeredAverage
+{
+
+namespace
+{
+std::uint32_t packOpaque (float red, float green, float blue)
+{
+    auto toByte = [] (float component)
+    { return static_cast<std::uint32_t> (jlimit (0, 255, roundToInt (component * 255.0f))); };
+    return 0xff000000u | (toByte (red) << 16) | (toByte (green) << 8) | toByte (blue);
+}
+} // namespace
+
+ColourMap ColourMap::createDiverging()
+{
+    ColourMap map;
+    for (int i = 0; i < numEntries; ++i)
+    {
+        // -1 (blue) .. 0 (white) .. 1 (red)
+        const float t = 2.0f * static_cast<float> (i) / (numEntries - 1) - 1.0f;
+        if (t < 0.0f)
+            map.m_table[i] = packOpaque (1.0f + 0.8f * t, 1.0f + 0.7f * t, 1.0f + 0.2f * t);
+        else
+            map.m_table[i] = packOpaque (1.0f - 0.2f * t, 1.0f - 0.8f * t, 1.0f - 0.8f * t);
+    }
+    return map;
+}
+
+void ColourMap::mapValues (const float* values,
+                           int numValues,
+                           juce::Range<float> range,
+                           std::uint32_t* dest,
+                           float* scratch) const
+{
+    const float length = range.getLength() > 0.0f ? range.getLength() : 1.0f;
+    const float maxIndex = static_cast<float> (numEntries - 1);
+
+    FloatVectorOperations::add (scratch, values, -range.getStart(), numValues);
+    FloatVectorOperations::multiply (scratch, maxIndex / length, numValues);
+    FloatVectorOperations::clip (scratch, scratch, 0.0f, maxIndex, numValues);
+
+    for (int i = 0; i < numValues; ++i)
+        dest[i] = m_table[static_cast<size_t> (scratch[i] + 0.5f)];
+}
+
+} // namespace TriggeredAverage
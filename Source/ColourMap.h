@@ -0,0 +1,35 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <cstdint>
+
+namespace TriggeredAverage
+{
+
+/** Maps values to packed 0xAARRGGBB colours through a lookup table */
+class ColourMap
+{
+public:
+    static constexpr int numEntries = 256;
+
+    /** Blue - white - red, for signals centred on zero */
+    static ColourMap createDiverging();
+
+    /**
+     * Maps values in range linearly onto the table; values outside the range are clipped.
+     * The normalization runs through FloatVectorOperations, leaving only the table lookup
+     * per value. scratch must hold numValues floats.
+     */
+    void mapValues (const float* values,
+                    int numValues,
+                    juce::Range<float> range,
+                    std::uint32_t* dest,
+                    float* scratch) const;
+
+    std::uint32_t getColour (int index) const { return m_table[index]; }
+
+private:
+    std::array<std::uint32_t, numEntries> m_table {};
+};
+
+} // namespace TriggeredAverage
@@ -0,0 +1,9 @@
+#pragma once
+#include <cstdint>
+
+namespace TriggeredAverage
+{
+// Identifies a trigger condition for its whole lifetime, including undo/redo and reloading
+using ConditionId = std::uint32_t;
+constexpr ConditionId invalidConditionId = 0;
+} // namespace TriggeredAverage
@@ -1,36 +1,317 @@
 #include "DataCollector.h"
 #include "MultiChannelRingBuffer.h"
-#include "TriggerSource.h"
-#include "TriggeredAvgNode.h"
-#include <ProcessorHeaders.h>
+#include "TimingZones.h"
+#include "TrialArchive.h"
+
+#include <utility>
 
 using namespace TriggeredAverage;
 
-void DataStore::ResetAndResizeAverageBufferForTriggerSource (TriggerSource* source,
-                                                             int nChannels,
-                                                             int nSamples)
+void DataStore::ResetAndResizeAverageBufferForCondition (ConditionId id,
+                                                         int nChannels,
+                                                         int nPreSamples,
+                                                         int nPostSamples)
 {
     std::scoped_lock<std::recursive_mutex> lock (m_mutex);
-    if (! source)
+    if (id == invalidConditionId)
     {
         for (auto& [key, value] : m_averageBuffers)
         {
-            value.setSize (nChannels, nSamples);
+            value.setSize (nChannels, nPreSamples, nPostSamples);
         }
+        m_trialHistories.clear();
+        m_traceDensities.clear();
+        m_recentTriggers.clear();
     }
     else
     {
-        m_averageBuffers[source].setSize (nChannels, nSamples);
+        m_retiredAverageBuffers.erase (id);
+        std::erase (m_retirementOrder, id);
+        m_recentTriggers.erase (id);
+        m_averageBuffers[id].setSize (nChannels, nPreSamples, nPostSamples);
+        m_trialHistories.erase (id);
+        m_traceDensities.erase (id);
+    }
+}
+
+MultiChannelAverageBuffer* DataStore::getOrCreateAverageBufferForCondition (ConditionId id,
+                                                                            int nChannels,
+                                                                            int nPreSamples,
+                                                                            int nPostSamples)
+{
+    std::scoped_lock<std::recursive_mutex> lock (m_mutex);
+    if (auto* existing = getRefToAverageBufferForCondition (id))
+        return existing;
+
+    if (auto retired = m_retiredAverageBuffers.find (id); retired != m_retiredAverageBuffers.end())
+    {
+        auto& restored = m_averageBuffers[id] = std::move (retired->second);
+        m_retiredAverageBuffers.erase (retired);
+        std::erase (m_retirementOrder, id);
+        return &restored;
+    }
+
+    auto& created = m_averageBuffers[id];
+    created.setSize (nChannels, nPreSamples, nPostSamples);
+    return &created;
+}
+
+void DataStore::mergeAveragesFrom (DataStore& other)
+{
+    std::scoped_lock<std::recursive_mutex, std::recursive_mutex> lock (m_mutex, other.m_mutex);
+    for (const auto& [id, source] : other.m_averageBuffers)
+    {
+        auto* dest = getOrCreateAverageBufferForCondition (
+            id, source.getNumChannels(), source.getNumPreSamples(), source.getNumPostSamples());
+        if (dest->getNumChannels() != source.getNumChannels())
+            ResetAndResizeAverageBufferForCondition (id,
+                                                     source.getNumChannels(),
+                                                     source.getNumPreSamples(),
+                                                     source.getNumPostSamples());
+        dest->merge (source);
+        markConditionUpdated (id);
+    }
+}
+
+void DataStore::resizeWindowForAllConditions (int nPreSamples, int nPostSamples)
+{
+    std::scoped_lock<std::recursive_mutex> lock (m_mutex);
+    for (auto& [id, buffer] : m_averageBuffers)
+        buffer.resizeWindow (nPreSamples, nPostSamples);
+    for (auto& [id, buffer] : m_retiredAverageBuffers)
+        buffer.resizeWindow (nPreSamples, nPostSamples);
+
+    // stored single trials have the old length
+    for (auto& [id, history] : m_trialHistories)
+        history->clear();
+    for (auto& [id, density] : m_traceDensities)
+        density->clear();
+}
+
+void DataStore::retireAverageBufferForCondition (ConditionId id)
+{
+    std::scoped_lock<std::recursive_mutex> lock (m_mutex);
+    if (auto buffer = m_averageBuffers.find (id); buffer != m_averageBuffers.end())
+    {
+        m_retiredAverageBuffers[id] = std::move (buffer->second);
+        m_averageBuffers.erase (buffer);
+        std::erase (m_retirementOrder, id);
+        m_retirementOrder.push_back (id);
+        setRetiredBytesLimit (m_retiredBytesLimit);
+    }
+    m_averageSnapshots.erase (id);
+    m_trialHistories.erase (id);
+    m_traceDensities.erase (id);
+    m_recentTriggers.erase (id);
+}
+
+void DataStore::addRecentTrigger (ConditionId id, SampleNumber triggerSample)
+{
+    auto& triggers = m_recentTriggers[id];
+    triggers.push_back (triggerSample);
+    if (triggers.size() > maxRecentTriggers)
+        triggers.pop_front();
+}
+
+const std::deque<SampleNumber>* DataStore::getRecentTriggers (ConditionId id) const
+{
+    const auto triggers = m_recentTriggers.find (id);
+    return triggers != m_recentTriggers.end() ? &triggers->second : nullptr;
+}
+
+void DataStore::setRetiredBytesLimit (size_t numBytes)
+{
+    std::scoped_lock<std::recursive_mutex> lock (m_mutex);
+    m_retiredBytesLimit = numBytes;
+
+    size_t retiredBytes = 0;
+    for (const auto& [id, buffer] : m_retiredAverageBuffers)
+        retiredBytes += buffer.getNumBytes();
+
+    // undoing the removal of an evicted condition re-adds it without data
+    while (retiredBytes > m_retiredBytesLimit && m_retirementOrder.size() > 1)
+    {
+        const auto oldest = m_retiredAverageBuffers.find (m_retirementOrder.front());
+        retiredBytes -= oldest->second.getNumBytes();
+        m_retiredAverageBuffers.erase (oldest);
+        m_retirementOrder.pop_front();
     }
 }
 
-DataCollector::DataCollector (TriggeredAvgNode* viewer_,
+std::vector<ConditionId> DataStore::getConditionIds()
+{
+    std::scoped_lock<std::recursive_mutex> lock (m_mutex);
+    std::vector<ConditionId> ids;
+    ids.reserve (m_averageBuffers.size());
+    for (const auto& [id, buffer] : m_averageBuffers)
+        ids.push_back (id);
+    return ids;
+}
+
+TrialHistory* DataStore::getTrialHistory (ConditionId id)
+{
+    std::scoped_lock<std::recursive_mutex> lock (m_mutex);
+    auto history = m_trialHistories.find (id);
+    return history != m_trialHistories.end() ? history->second.get() : nullptr;
+}
+
+TrialHistory* DataStore::getOrCreateTrialHistory (ConditionId id, int nChannels, int nSamples)
+{
+    std::scoped_lock<std::recursive_mutex> lock (m_mutex);
+    const int nColumns = std::min (nSamples, trialHistoryColumns);
+    auto& history = m_trialHistories[id];
+    if (history == nullptr || history->getNumChannels() != nChannels
+        || history->getNumColumns() != nColumns)
+    {
+        history = std::make_unique<TrialHistory> (nChannels, nColumns, trialHistoryCapacity);
+    }
+    return history.get();
+}
+
+void DataStore::setKeepTrialHistories (bool shouldKeep)
+{
+    std::scoped_lock<std::recursive_mutex> lock (m_mutex);
+    m_keepTrialHistories = shouldKeep;
+    if (! shouldKeep)
+        m_trialHistories.clear();
+}
+
+bool DataStore::keepsTrialHistories()
+{
+    std::scoped_lock<std::recursive_mutex> lock (m_mutex);
+    return m_keepTrialHistories;
+}
+
+TraceDensity* DataStore::getTraceDensity (ConditionId id)
+{
+    std::scoped_lock<std::recursive_mutex> lock (m_mutex);
+    auto density = m_traceDensities.find (id);
+    return density != m_traceDensities.end() ? density->second.get() : nullptr;
+}
+
+TraceDensity* DataStore::getOrCreateTraceDensity (ConditionId id, int nChannels, int nSamples)
+{
+    std::scoped_lock<std::recursive_mutex> lock (m_mutex);
+    const int nColumns = std::min (nSamples, traceDensityColumns);
+    auto& density = m_traceDensities[id];
+    if (density == nullptr || density->getNumChannels() != nChannels
+        || density->getNumColumns() != nColumns)
+    {
+        density = std::make_unique<TraceDensity> (nChannels, nColumns, traceDensityRows);
+    }
+    return density.get();
+}
+
+void DataStore::setKeepTraceDensities (bool shouldKeep)
+{
+    std::scoped_lock<std::recursive_mutex> lock (m_mutex);
+    m_keepTraceDensities = shouldKeep;
+    if (! shouldKeep)
+        m_traceDensities.clear();
+}
+
+bool DataStore::keepsTraceDensities()
+{
+    std::scoped_lock<std::recursive_mutex> lock (m_mutex);
+    return m_keepTraceDensities;
+}
+
+std::vector<ConditionId> DataStore::takeUpdatedConditions()
+{
+    std::scoped_lock<std::recursive_mutex> lock (m_mutex);
+    std::vector<ConditionId> ids (m_updatedConditions.begin(), m_updatedConditions.end());
+    m_updatedConditions.clear();
+    return ids;
+}
+
+std::shared_ptr<const AverageSnapshot> DataStore::getAverageSnapshot (ConditionId id)
+{
+    std::unique_lock<std::recursive_mutex> lock (m_mutex);
+    auto* buffer = getRefToAverageBufferForCondition (id);
+    if (buffer == nullptr)
+        return nullptr;
+
+    if (auto cached = m_averageSnapshots.find (id);
+        cached != m_averageSnapshots.end() && cached->second->version == buffer->getVersion())
+    {
+        return cached->second;
+    }
+
+    auto snapshot = std::make_shared<AverageSnapshot>();
+    snapshot->version = buffer->getVersion();
+    snapshot->numTrials = buffer->getNumTrials();
+    snapshot->numPreSamples = buffer->getNumPreSamples();
+    snapshot->mean = buffer->getAverage();
+    snapshot->standardDeviation = buffer->getStandardDeviation();
+    snapshot->trialCounts.resize (static_cast<size_t> (buffer->getNumSamples()));
+    for (int i = 0; i < buffer->getNumSamples(); ++i)
+        snapshot->trialCounts[i] = buffer->getNumTrialsAtSample (i);
+
+    // the pyramids and ranges only depend on the copied mean, so the collector can continue
+    // meanwhile
+    lock.unlock();
+    const int numChannels = snapshot->mean.getNumChannels();
+    const int numSamples = snapshot->mean.getNumSamples();
+    snapshot->pyramids.resize (static_cast<size_t> (numChannels));
+    snapshot->channelRanges.resize (static_cast<size_t> (numChannels));
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        const float* channelData = snapshot->mean.getReadPointer (ch);
+        snapshot->pyramids[ch].build (channelData, numSamples);
+
+        const auto channelRange =
+            juce::FloatVectorOperations::findMinAndMax (channelData, numSamples);
+        snapshot->channelRanges[ch] = channelRange;
+        snapshot->range = ch == 0 ? channelRange : snapshot->range.getUnionWith (channelRange);
+    }
+    lock.lock();
+
+    // the condition may have been removed or recreated, or a newer snapshot cached, while
+    // unlocked; only a snapshot of the live buffer replaces an older one
+    buffer = getRefToAverageBufferForCondition (id);
+    if (buffer == nullptr || buffer->getVersion() < snapshot->version)
+        return snapshot;
+    auto& cached = m_averageSnapshots[id];
+    if (cached == nullptr || cached->version < snapshot->version)
+        cached = snapshot;
+    return cached;
+}
+
+int DataStore::publishSnapshots()
+{
+    int numPublished = 0;
+    for (auto id : getConditionIds())
+    {
+        {
+            std::scoped_lock<std::recursive_mutex> lock (m_mutex);
+            auto* buffer = getRefToAverageBufferForCondition (id);
+            auto cached = m_averageSnapshots.find (id);
+            if (buffer == nullptr
+                || (cached != m_averageSnapshots.end()
+                    && cached->second->version == buffer->getVersion()))
+                continue;
+        }
+        getAverageSnapshot (id);
+        ++numPublished;
+    }
+    return numPublished;
+}
+
+std::shared_ptr<const AverageSnapshot> DataStore::getPublishedSnapshot (ConditionId id)
+{
+    std::scoped_lock<std::recursive_mutex> lock (m_mutex);
+    auto cached = m_averageSnapshots.find (id);
+    return cached != m_averageSnapshots.end() ? cached->second : nullptr;
+}
+
+DataCollector::DataCollector (std::function<void()> onDataUpdated_,
                               MultiChannelRingBuffer* buffer_,
                               DataStore* datastore_)
     : Thread ("TriggeredAvg: Data Collector"),
-      m_processor (viewer_),
+      m_onDataUpdated (std::move (onDataUpdated_)),
       ringBuffer (buffer_),
       m_datastore (datastore_),
+      m_requestSlots (maxPendingRequests),
       newTriggerEvent (false)
 {
     //setPriority(Thread::Priority::high);
@@ -38,58 +319,118 @@ DataCollector::DataCollector (TriggeredAvgNode* viewer_,
 
 DataCollector::~DataCollector() { stopThread (1000); }
 
+std::unique_ptr<TrialArchiveWriter>
+    DataCollector::setTrialArchive (std::unique_ptr<TrialArchiveWriter> archive)
+{
+    const std::scoped_lock lock (m_archiveLock);
+    std::swap (m_archive, archive);
+    return archive;
+}
+
 void DataCollector::registerCaptureRequest (const CaptureRequest& request)
 {
-    const ScopedLock lock (triggerQueueLock);
-    captureRequestQueue.emplace_back (request);
+    int start1, size1, start2, size2;
+    m_requestFifo.prepareToWrite (1, start1, size1, start2, size2);
+    if (size1 + size2 == 0)
+    {
+        m_numDroppedRequests.fetch_add (1);
+        return;
+    }
+
+    m_requestSlots[static_cast<size_t> (size1 > 0 ? start1 : start2)] = request;
+    m_requestFifo.finishedWrite (1);
+}
+
+void DataCollector::takeNewRequests()
+{
+    int start1, size1, start2, size2;
+    m_requestFifo.prepareToRead (m_requestFifo.getNumReady(), start1, size1, start2, size2);
+    auto take = [this] (int start, int size)
+    {
+        const auto first = m_requestSlots.begin() + start;
+        captureRequestQueue.insert (captureRequestQueue.end(), first, first + size);
+    };
+    take (start1, size1);
+    take (start2, size2);
+    m_requestFifo.finishedRead (size1 + size2);
+}
+
+void DataCollector::setWindowSize (int nPreSamples, int nPostSamples)
+{
+    m_pendingPreSamples.store (nPreSamples);
+    m_pendingPostSamples.store (nPostSamples);
+    m_windowChangePending.store (true);
     newTriggerEvent.signal();
 }
 
 void DataCollector::run()
 {
+    constexpr double pollIntervalMs = 10.0;
     constexpr double retryIntervalMs = 50.0;
     constexpr int maximumNumberOfRetries = 200;
     while (! threadShouldExit())
     {
-        if (bool wasTriggered = newTriggerEvent.wait (100))
+        // the audio thread does not signal new requests, so the queue is polled
+        newTriggerEvent.wait (pollIntervalMs);
+        if (m_windowChangePending.load())
+            applyPendingWindowChange();
+
+        takeNewRequests();
+        bool averageBuffersWereUpdated = false;
+        int iRetry = maximumNumberOfRetries;
+        while (! captureRequestQueue.empty() && ! threadShouldExit())
         {
-            const ScopedLock lock (triggerQueueLock);
-            bool averageBuffersWereUpdated = false;
-            int iRetry = maximumNumberOfRetries;
-            while (! captureRequestQueue.empty())
+            const auto result = processCaptureRequest (captureRequestQueue.front());
+            if (result == RingBufferReadResult::NotEnoughNewData && iRetry > 0)
             {
-                switch (processCaptureRequest (captureRequestQueue.front()))
-                {
-                    case RingBufferReadResult::Success:
-                    case RingBufferReadResult::DataInRingBufferTooOld:
-                        averageBuffersWereUpdated = true;
-                        captureRequestQueue.pop_front();
-                        break;
-                    case RingBufferReadResult::NotEnoughNewData:
-                        if (iRetry > 0)
-                        {
-                            wait (retryIntervalMs);
-                            iRetry--;
-                        }
-                        else
-                        {
-                            captureRequestQueue.pop_front();
-                        }
-                        break;
-                    case RingBufferReadResult::InvalidParameters:
-                    case RingBufferReadResult::UnknownError:
-                        assert (false);
-                        break;
-                }
-            }
-            if (averageBuffersWereUpdated)
-            {
-                // notify the processor that the data has been updated
-                if (m_processor != nullptr)
-                    m_processor->triggerAsyncUpdate();
+                // show what has been accumulated so far while waiting for more data
+                if (std::exchange (averageBuffersWereUpdated, false))
+                    publishSnapshotsAndNotify();
+                wait (retryIntervalMs);
+                iRetry--;
+                takeNewRequests();
+                continue;
             }
+
+            jassert (result != RingBufferReadResult::InvalidParameters
+                     && result != RingBufferReadResult::UnknownError);
+            if (result == RingBufferReadResult::Success)
+                averageBuffersWereUpdated = true;
+
+            // the retry budget is per request
+            iRetry = maximumNumberOfRetries;
+            captureRequestQueue.pop_front();
         }
+        // also picks up changes made on other threads, e.g. a cleared or resized condition
+        publishSnapshotsAndNotify();
+    }
+}
+
+void DataCollector::publishSnapshotsAndNotify()
+{
+    // the snapshots are built here, so the message thread only draws finished ones
+    if (m_datastore->publishSnapshots() > 0 && m_onDataUpdated)
+        m_onDataUpdated();
+}
+
+int DataCollector::processAvailableRequests()
+{
+    if (m_windowChangePending.load())
+        applyPendingWindowChange();
+
+    takeNewRequests();
+    int numAccumulated = 0;
+    while (! captureRequestQueue.empty())
+    {
+        const auto result = processCaptureRequest (captureRequestQueue.front());
+        if (result == RingBufferReadResult::NotEnoughNewData)
+            break;
+
+        if (result == RingBufferReadResult::Success)
+            ++numAccumulated;
+        captureRequestQueue.pop_front();
     }
+    return numAccumulated;
 }
 
 // process a single capture request on the ring buffer, running on the data collector thread
@@ -97,52 +438,144 @@ RingBufferReadResult DataCollector::processCaptureRequest (const CaptureRequest&
 {
     auto result = ringBuffer->readAroundSample (
         request.triggerSample, request.preSamples, request.postSamples, m_collectBuffer);
-    if (result == RingBufferReadResult::Success)
+    if (result == RingBufferReadResult::Success && accumulateTrial (request))
     {
-        auto* avgBuffer =
-            m_datastore->getRefToAverageBufferForTriggerSource (request.triggerSource);
-        if (! avgBuffer)
+        // outside the store lock; the archive copies the trial and never waits for the disk
+        const std::scoped_lock lock (m_archiveLock);
+        if (m_archive != nullptr)
+            m_archive->addTrial (
+                request.conditionId, request.triggerSample, request.preSamples, m_collectBuffer);
+    }
+    return result;
+}
+
+// adds the trial in m_collectBuffer to the store; false if its condition has been removed
+bool DataCollector::accumulateTrial (const CaptureRequest& request)
+{
+    auto lock = m_datastore->GetLock();
+
+    // requests that were queued before their condition was removed are dropped
+    if (m_datastore->isRetired (request.conditionId))
+        return false;
+
+    auto* avgBuffer = m_datastore->getOrCreateAverageBufferForCondition (
+        request.conditionId,
+        m_collectBuffer.getNumChannels(),
+        request.preSamples,
+        request.postSamples);
+    jassert (avgBuffer);
+
+    if (m_collectBuffer.getNumChannels() != avgBuffer->getNumChannels())
+    {
+        m_datastore->ResetAndResizeAverageBufferForCondition (request.conditionId,
+                                                              m_collectBuffer.getNumChannels(),
+                                                              request.preSamples,
+                                                              request.postSamples);
+    }
+
+    // requests queued before a window change still contribute to the overlapping part
+    avgBuffer->addDataToAverageFromBuffer (m_collectBuffer, request.preSamples);
+    m_datastore->markConditionUpdated (request.conditionId);
+
+    // single trials are only kept if they match the current window exactly
+    if (request.preSamples == avgBuffer->getNumPreSamples()
+        && m_collectBuffer.getNumSamples() == avgBuffer->getNumSamples())
+    {
+        if (m_datastore->keepsTrialHistories())
         {
-            m_datastore->ResetAndResizeAverageBufferForTriggerSource (
-                request.triggerSource,
+            auto* history = m_datastore->getOrCreateTrialHistory (
+                request.conditionId,
                 m_collectBuffer.getNumChannels(),
                 m_collectBuffer.getNumSamples());
-            avgBuffer = m_datastore->getRefToAverageBufferForTriggerSource (request.triggerSource);
+            history->addTrial (m_collectBuffer);
         }
 
-        jassert (avgBuffer);
-
-        if (m_collectBuffer.getNumChannels() != avgBuffer->getNumChannels()
-            || m_collectBuffer.getNumSamples() != avgBuffer->getNumSamples())
+        if (m_datastore->keepsTraceDensities())
         {
-            m_datastore->ResetAndResizeAverageBufferForTriggerSource (
-                request.triggerSource,
+            auto* density = m_datastore->getOrCreateTraceDensity (
+                request.conditionId,
                 m_collectBuffer.getNumChannels(),
                 m_collectBuffer.getNumSamples());
+            density->addTrial (m_collectBuffer);
         }
-        jassert (m_collectBuffer.getNumSamples() == avgBuffer->getNumSamples());
-        jassert (m_collectBuffer.getNumChannels() == avgBuffer->getNumChannels());
+    }
+
+    m_datastore->addRecentTrigger (request.conditionId, request.triggerSample);
+    return true;
+}
+
+void DataCollector::applyPendingWindowChange()
+{
+    m_windowChangePending.store (false);
+    const int nPreSamples = m_pendingPreSamples.load();
+    const int nPostSamples = m_pendingPostSamples.load();
+
+    auto lock = m_datastore->GetLock();
+    for (auto id : m_datastore->getConditionIds())
+    {
+        auto* buffer = m_datastore->getRefToAverageBufferForCondition (id);
+        const int oldPreSamples = buffer->getNumPreSamples();
+        const int oldPostSamples = buffer->getNumPostSamples();
 
-        m_datastore->getRefToAverageBufferForTriggerSource (request.triggerSource)
-            ->addDataToAverageFromBuffer (m_collectBuffer);
+        buffer->resizeWindow (nPreSamples, nPostSamples);
+        backfillWindowExtension (id, *buffer, oldPreSamples, oldPostSamples);
+        m_datastore->markConditionUpdated (id);
     }
-    return result;
+    m_datastore->resizeWindowForAllConditions (nPreSamples, nPostSamples);
 }
-MultiChannelAverageBuffer::MultiChannelAverageBuffer (int numChannels, int numSamples)
-    : m_numChannels (numChannels),
-      m_numSamples (numSamples)
+
+// re-reads the newly covered part of the window for triggers still in the ring buffer
+void DataCollector::backfillWindowExtension (ConditionId id,
+                                             MultiChannelAverageBuffer& buffer,
+                                             int oldPreSamples,
+                                             int oldPostSamples)
 {
-    m_sumBuffer.setSize (numChannels, numSamples);
-    m_sumSquaresBuffer.setSize (numChannels, numSamples);
-    resetTrials();
+    const auto* recentTriggers = m_datastore->getRecentTriggers (id);
+    if (recentTriggers == nullptr)
+        return;
+
+    const int newPreSamples = buffer.getNumPreSamples();
+    const int newPostSamples = buffer.getNumPostSamples();
+    const int preExtension = newPreSamples - oldPreSamples;
+    const int postExtension = newPostSamples - oldPostSamples;
+
+    for (auto triggerSample : *recentTriggers)
+    {
+        if (preExtension > 0
+            && ringBuffer->readAroundSample (
+                   triggerSample - oldPreSamples, preExtension, 0, m_collectBuffer)
+                   == RingBufferReadResult::Success)
+        {
+            buffer.addSamplesToAverage (m_collectBuffer, 0, 0, preExtension);
+        }
+
+        if (postExtension > 0
+            && ringBuffer->readAroundSample (
+                   triggerSample + oldPostSamples, 0, postExtension, m_collectBuffer)
+                   == RingBufferReadResult::Success)
+        {
+            buffer.addSamplesToAverage (
+                m_collectBuffer, 0, newPreSamples + oldPostSamples, postExtension);
+        }
+    }
+}
+
+MultiChannelAverageBuffer::MultiChannelAverageBuffer (int numChannels,
+                                                      int numPreSamples,
+                                                      int numPostSamples)
+{
+    setSize (numChannels, numPreSamples, numPostSamples);
 }
 MultiChannelAverageBuffer::MultiChannelAverageBuffer (MultiChannelAverageBuffer&& other) noexcept
     : m_numChannels (other.m_numChannels),
-      m_numSamples (other.m_numSamples)
+      m_numSamples (other.m_numSamples),
+      m_numPreSamples (other.m_numPreSamples)
 {
     m_sumBuffer = std::move (other.m_sumBuffer);
     m_sumSquaresBuffer = std::move (other.m_sumSquaresBuffer);
+    m_trialCountPerSample = std::move (other.m_trialCountPerSample);
     m_numTrials = other.m_numTrials;
+    m_version = other.m_version;
 }
 MultiChannelAverageBuffer&
     MultiChannelAverageBuffer::operator= (MultiChannelAverageBuffer&& other) noexcept
@@ -151,26 +584,115 @@ MultiChannelAverageBuffer&
     {
         m_sumBuffer = std::move (other.m_sumBuffer);
         m_sumSquaresBuffer = std::move (other.m_sumSquaresBuffer);
+        m_trialCountPerSample = std::move (other.m_trialCountPerSample);
         m_numTrials = other.m_numTrials;
         m_numChannels = other.m_numChannels;
         m_numSamples = other.m_numSamples;
+        m_numPreSamples = other.m_numPreSamples;
+        m_version = other.m_version;
     }
     return *this;
 }
-void MultiChannelAverageBuffer::addDataToAverageFromBuffer (const juce::AudioBuffer<float>& buffer)
+void MultiChannelAverageBuffer::setSize (int nChannels, int nPreSamples, int nPostSamples)
 {
+    m_numChannels = nChannels;
+    m_numPreSamples = nPreSamples;
+    m_numSamples = nPreSamples + nPostSamples;
+    m_sumBuffer.setSize (nChannels, m_numSamples);
+    m_sumSquaresBuffer.setSize (nChannels, m_numSamples);
+    m_trialCountPerSample.resize (static_cast<size_t> (m_numSamples));
+    resetTrials();
+}
+void MultiChannelAverageBuffer::resizeWindow (int nPreSamples, int nPostSamples)
+{
+    const int oldNumSamples = m_numSamples;
+    const int newNumSamples = nPreSamples + nPostSamples;
+    if (nPreSamples == m_numPreSamples && newNumSamples == oldNumSamples)
+        return;
+
+    // old sample i moves to i + shift; keep what still falls inside the new window
+    const int shift = nPreSamples - m_numPreSamples;
+    const int sourceStart = std::max (0, -shift);
+    const int destStart = sourceStart + shift;
+    const int numKept = std::max (0, std::min (oldNumSamples, newNumSamples - shift) - sourceStart);
+    const int workingSize = std::max (oldNumSamples, newNumSamples);
+
+    auto moveSamples = [&] (auto* data)
+    {
+        if (numKept > 0)
+            std::memmove (data + destStart, data + sourceStart, sizeof (*data) * numKept);
+        if (numKept > 0)
+        {
+            std::fill (data, data + destStart, 0);
+            std::fill (data + destStart + numKept, data + workingSize, 0);
+        }
+        else
+        {
+            std::fill (data, data + workingSize, 0);
+        }
+    };
+
+    if (newNumSamples > oldNumSamples)
+    {
+        m_sumBuffer.setSize (m_numChannels, newNumSamples, true, true, true);
+        m_sumSquaresBuffer.setSize (m_numChannels, newNumSamples, true, true, true);
+        m_trialCountPerSample.resize (static_cast<size_t> (newNumSamples));
+    }
+
+    for (int ch = 0; ch < m_numChannels; ++ch)
+    {
+        moveSamples (m_sumBuffer.getWritePointer (ch));
+        moveSamples (m_sumSquaresBuffer.getWritePointer (ch));
+    }
+    moveSamples (m_trialCountPerSample.data());
+
+    if (newNumSamples < oldNumSamples)
+    {
+        m_sumBuffer.setSize (m_numChannels, newNumSamples, true, false, true);
+        m_sumSquaresBuffer.setSize (m_numChannels, newNumSamples, true, false, true);
+        m_trialCountPerSample.resize (static_cast<size_t> (newNumSamples));
+    }
+
+    m_numSamples = newNumSamples;
+    m_numPreSamples = nPreSamples;
+    ++m_version;
+}
+void MultiChannelAverageBuffer::addDataToAverageFromBuffer (const juce::AudioBuffer<float>& buffer,
+                                                            int bufferPreSamples)
+{
+    TRIGGERED_AVG_TIMING_ZONE ("MultiChannelAverageBuffer::addDataToAverageFromBuffer");
     jassert (buffer.getNumChannels() == m_numChannels);
-    jassert (buffer.getNumSamples() == m_numSamples);
+
+    // align the buffer's trigger with ours and add the overlap
+    const int shift = m_numPreSamples - bufferPreSamples;
+    const int sourceStart = std::max (0, -shift);
+    const int numSamples =
+        std::min (buffer.getNumSamples(), m_numSamples - shift) - sourceStart;
+
+    if (numSamples > 0)
+        addSamplesToAverage (buffer, sourceStart, sourceStart + shift, numSamples);
+
+    ++m_numTrials;
+    ++m_version;
+}
+void MultiChannelAverageBuffer::addSamplesToAverage (const juce::AudioBuffer<float>& buffer,
+                                                     int sourceStartSample,
+                                                     int destStartSample,
+                                                     int numSamples)
+{
+    jassert (buffer.getNumChannels() == m_numChannels);
+    jassert (sourceStartSample >= 0 && sourceStartSample + numSamples <= buffer.getNumSamples());
+    jassert (destStartSample >= 0 && destStartSample + numSamples <= m_numSamples);
 
     for (int ch = 0; ch < m_numChannels; ++ch)
     {
-        auto* sumData = m_sumBuffer.getWritePointer (ch);
+        auto* sumData = m_sumBuffer.getWritePointer (ch, destStartSample);
         // TODO: Use SIMD
         //m_sumBuffer.addFrom (ch, 0, buffer, ch, 0, m_numSamples);
-        auto* sumSquaresData = m_sumSquaresBuffer.getWritePointer (ch);
-        auto* inputData = buffer.getReadPointer (ch);
+        auto* sumSquaresData = m_sumSquaresBuffer.getWritePointer (ch, destStartSample);
+        auto* inputData = buffer.getReadPointer (ch, sourceStartSample);
 
-        for (int i = 0; i < m_numSamples; ++i)
+        for (int i = 0; i < numSamples; ++i)
         {
             float sample = inputData[i];
             sumData[i] += sample;
@@ -178,11 +700,45 @@ void MultiChannelAverageBuffer::addDataToAverageFromBuffer (const juce::AudioBuf
         }
     }
 
-    ++m_numTrials;
+    for (int i = destStartSample; i < destStartSample + numSamples; ++i)
+        ++m_trialCountPerSample[i];
+    ++m_version;
 }
-AudioBuffer<float> MultiChannelAverageBuffer::getAverage() const
+bool MultiChannelAverageBuffer::merge (const MultiChannelAverageBuffer& other)
 {
-    AudioBuffer<float> outputBuffer;
+    if (other.m_numChannels != m_numChannels)
+        return false;
+
+    // align the other window's trigger with ours and add the overlap
+    const int shift = m_numPreSamples - other.m_numPreSamples;
+    const int sourceStart = std::max (0, -shift);
+    const int numSamples = std::min (other.m_numSamples, m_numSamples - shift) - sourceStart;
+    if (numSamples > 0)
+    {
+        const int destStart = sourceStart + shift;
+        for (int ch = 0; ch < m_numChannels; ++ch)
+        {
+            juce::FloatVectorOperations::add (m_sumBuffer.getWritePointer (ch, destStart),
+                                              other.m_sumBuffer.getReadPointer (ch, sourceStart),
+                                              numSamples);
+            juce::FloatVectorOperations::add (
+                m_sumSquaresBuffer.getWritePointer (ch, destStart),
+                other.m_sumSquaresBuffer.getReadPointer (ch, sourceStart),
+                numSamples);
+        }
+
+        for (int i = 0; i < numSamples; ++i)
+            m_trialCountPerSample[static_cast<size_t> (destStart + i)] +=
+                other.m_trialCountPerSample[static_cast<size_t> (sourceStart + i)];
+    }
+
+    m_numTrials += other.m_numTrials;
+    ++m_version;
+    return true;
+}
+juce::AudioBuffer<float> MultiChannelAverageBuffer::getAverage() const
+{
+    juce::AudioBuffer<float> outputBuffer;
     if (m_numTrials == 0)
     {
         outputBuffer.clear();
@@ -198,12 +754,13 @@ AudioBuffer<float> MultiChannelAverageBuffer::getAverage() const
 
         for (int i = 0; i < m_numSamples; ++i)
         {
-            outputData[i] = sumData[i] / static_cast<float> (m_numTrials);
+            const int nTrials = m_trialCountPerSample[i];
+            outputData[i] = nTrials > 0 ? sumData[i] / static_cast<float> (nTrials) : 0.0f;
         }
     }
     return outputBuffer;
 }
-AudioBuffer<float> MultiChannelAverageBuffer::getStandardDeviation() const
+juce::AudioBuffer<float> MultiChannelAverageBuffer::getStandardDeviation() const
 {
     juce::AudioBuffer<float> outputBuffer;
     if (m_numTrials == 0)
@@ -220,13 +777,15 @@ AudioBuffer<float> MultiChannelAverageBuffer::getStandardDeviation() const
         auto* sumSquaresData = m_sumSquaresBuffer.getReadPointer (ch);
         auto* outputData = outputBuffer.getWritePointer (ch);
 
+        // in double, so the subtraction does not add to the rounding of the float sums
         for (int i = 0; i < m_numSamples; ++i)
         {
-            const float mean = sumData[i] / static_cast<float> (m_numTrials);
-            const float meanSquares = sumSquaresData[i] / static_cast<float> (m_numTrials);
-            const float variance = meanSquares - (mean * mean);
-            outputData[i] = std::sqrt (
-                std::max (0.0f, variance)); // Clamp to avoid negative due to float precision
+            const double nTrials = std::max (1, m_trialCountPerSample[i]);
+            const double mean = sumData[i] / nTrials;
+            const double meanSquares = sumSquaresData[i] / nTrials;
+            const double variance = meanSquares - (mean * mean);
+            outputData[i] = static_cast<float> (
+                std::sqrt (std::max (0.0, variance))); // Clamp to avoid negative due to rounding
         }
     }
     return outputBuffer;
@@ -236,7 +795,9 @@ void MultiChannelAverageBuffer::resetTrials()
 {
     m_sumBuffer.clear();
     m_sumSquaresBuffer.clear();
+    std::fill (m_trialCountPerSample.begin(), m_trialCountPerSample.end(), 0);
     m_numTrials = 0;
+    ++m_version;
 }
 int MultiChannelAverageBuffer::getNumTrials() const { return m_numTrials; }
 int MultiChannelAverageBuffer::getNumChannels() const
@@ -249,3 +810,8 @@ int MultiChannelAverageBuffer::getNumSamples() const
     assert (m_sumBuffer.getNumChannels() == m_sumSquaresBuffer.getNumChannels());
     return m_sumBuffer.getNumSamples();
 }
+size_t MultiChannelAverageBuffer::getNumBytes() const
+{
+    const auto numValues = static_cast<size_t> (m_numChannels) * static_cast<size_t> (m_numSamples);
+    return 2 * numValues * sizeof (float) + m_trialCountPerSample.size() * sizeof (int);
+}
@@ -1,35 +1,114 @@
 #pragma once
+#include "ConditionId.h"
 #include "MultiChannelRingBuffer.h"
+#include "TraceDecimation.h"
+#include "TraceDensity.h"
+#include "TrialHistory.h"
 
-#include <JuceHeader.h>
-#include <ProcessorHeaders.h>
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
 
 namespace TriggeredAverage
 {
 class MultiChannelAverageBuffer;
-class TriggeredAvgNode;
-class TriggerSource;
+struct AverageSnapshot;
 class MultiChannelRingBuffer;
+class TriggerSource;
+class TrialArchiveWriter;
 
 struct CaptureRequest
 {
-    TriggerSource* triggerSource;
+    ConditionId conditionId;
     SampleNumber triggerSample;
     int preSamples;
     int postSamples;
 };
 
+// Holds the accumulated averages, keyed by the persistent id of their trigger condition
 class DataStore
 {
 public:
-    void ResetAndResizeAverageBufferForTriggerSource (TriggerSource* source, int nChannels, int nSamples);
+    void ResetAndResizeAverageBufferForCondition (ConditionId id,
+                                                  int nChannels,
+                                                  int nPreSamples,
+                                                  int nPostSamples);
+
+    /** Returns the buffer for a condition, creating it (or restoring it if it was retired)
+        when necessary. */
+    MultiChannelAverageBuffer* getOrCreateAverageBufferForCondition (ConditionId id,
+                                                                     int nChannels,
+                                                                     int nPreSamples,
+                                                                     int nPostSamples);
 
-    MultiChannelAverageBuffer* getRefToAverageBufferForTriggerSource (TriggerSource* source)
+    MultiChannelAverageBuffer* getRefToAverageBufferForCondition (ConditionId id)
     {
-        if (m_averageBuffers.contains (source))
-            return &m_averageBuffers.at (source);
+        if (m_averageBuffers.contains (id))
+            return &m_averageBuffers.at (id);
         return nullptr;
     }
+
+    /** Keeps the data of a removed condition, so that re-adding it (e.g. on undo) restores it.
+        Once the retired buffers take more than the retired bytes limit, the oldest are freed;
+        the most recently retired one is always kept. */
+    void retireAverageBufferForCondition (ConditionId id);
+    void setRetiredBytesLimit (size_t numBytes);
+    bool isRetired (ConditionId id) const { return m_retiredAverageBuffers.contains (id); }
+
+    /** Crops or extends the window of all buffers, keeping the accumulated trials */
+    void resizeWindowForAllConditions (int nPreSamples, int nPostSamples);
+
+    std::vector<ConditionId> getConditionIds();
+
+    /** Mean of a condition. Snapshots are shared and only rebuilt when the accumulator changed
+        since the last call; returns nullptr for unknown conditions. Building one is expensive,
+        so the message thread uses getPublishedSnapshot() instead. */
+    std::shared_ptr<const AverageSnapshot> getAverageSnapshot (ConditionId id);
+
+    /** Rebuilds the snapshots of all conditions whose data changed since they were last
+        built; returns how many were rebuilt. Called by the collector thread. */
+    int publishSnapshots();
+
+    /** The last snapshot built for a condition, without building one; nullptr until the
+        first was published. Cheap enough for paint(). */
+    std::shared_ptr<const AverageSnapshot> getPublishedSnapshot (ConditionId id);
+
+    /** Single trials of a condition for trial-by-trial displays; nullptr until the first
+        trial arrived. Access with the lock held. */
+    TrialHistory* getTrialHistory (ConditionId id);
+    TrialHistory* getOrCreateTrialHistory (ConditionId id, int nChannels, int nSamples);
+
+    /** Whether the collector keeps single trials; off by default so that offline replay
+        does not pay for them. Turning it off frees the kept trials. */
+    void setKeepTrialHistories (bool shouldKeep);
+    bool keepsTrialHistories();
+
+    /** Density image of all trials of a condition; same access rules as getTrialHistory */
+    TraceDensity* getTraceDensity (ConditionId id);
+    TraceDensity* getOrCreateTraceDensity (ConditionId id, int nChannels, int nSamples);
+
+    /** Like setKeepTrialHistories(), for the trace densities */
+    void setKeepTraceDensities (bool shouldKeep);
+    bool keepsTraceDensities();
+
+    /** Merges the averages of every condition of another store into this one; a buffer with
+        a different channel count is reset first, as when the collector sees one */
+    void mergeAveragesFrom (DataStore& other);
+
+    /** Triggers whose trials are in a condition's buffer, newest last, for backfilling when
+        the window grows. Dropped whenever the buffer is reset, cleared or retired. Access
+        with the lock held; getRecentTriggers() returns nullptr if there are none. */
+    void addRecentTrigger (ConditionId id, SampleNumber triggerSample);
+    const std::deque<SampleNumber>* getRecentTriggers (ConditionId id) const;
+
+    /** Records that a condition received data; called by the collector with the lock held */
+    void markConditionUpdated (ConditionId id) { m_updatedConditions.insert (id); }
+
+    /** Returns the conditions that received data since the last call */
+    std::vector<ConditionId> takeUpdatedConditions();
+
     std::scoped_lock<std::recursive_mutex> GetLock()
     {
         return std::scoped_lock<std::recursive_mutex> (m_mutex);
@@ -39,75 +118,200 @@ public:
     {
         auto lock = GetLock();
         m_averageBuffers.clear();
+        m_retiredAverageBuffers.clear();
+        m_retirementOrder.clear();
+        m_recentTriggers.clear();
+        m_averageSnapshots.clear();
+        m_trialHistories.clear();
+        m_traceDensities.clear();
+        m_updatedConditions.clear();
     }
     // TODO: Add method for getteing a ref with a lock
 
 private:
     std::recursive_mutex m_mutex;
-    std::unordered_map<TriggerSource*, MultiChannelAverageBuffer> m_averageBuffers;
+    std::unordered_map<ConditionId, MultiChannelAverageBuffer> m_averageBuffers;
+    std::unordered_map<ConditionId, MultiChannelAverageBuffer> m_retiredAverageBuffers;
+    // oldest first
+    std::deque<ConditionId> m_retirementOrder;
+    size_t m_retiredBytesLimit = size_t (512) << 20;
+    static constexpr size_t maxRecentTriggers = 256;
+    std::unordered_map<ConditionId, std::deque<SampleNumber>> m_recentTriggers;
+    std::unordered_map<ConditionId, std::shared_ptr<const AverageSnapshot>> m_averageSnapshots;
+    std::unordered_map<ConditionId, std::unique_ptr<TrialHistory>> m_trialHistories;
+    bool m_keepTrialHistories = false;
+    std::unordered_map<ConditionId, std::unique_ptr<TraceDensity>> m_traceDensities;
+    bool m_keepTraceDensities = false;
+    std::unordered_set<ConditionId> m_updatedConditions;
+
+    static constexpr int trialHistoryColumns = 256;
+    static constexpr int trialHistoryCapacity = 100;
+    static constexpr int traceDensityColumns = 256;
+    static constexpr int traceDensityRows = 128;
 };
 
-class DataCollector : public Thread
+class DataCollector : public juce::Thread
 {
 public:
-    DataCollector (TriggeredAvgNode*, MultiChannelRingBuffer*, DataStore*);
+    /** onDataUpdated is called on the collector thread whenever averages have changed */
+    DataCollector (std::function<void()> onDataUpdated, MultiChannelRingBuffer*, DataStore*);
     ~DataCollector() override;
     void run() override;
     void registerTriggerSource (const TriggerSource*);
+
+    /** Queues a capture request. Called on the audio thread, so it neither allocates, locks
+        nor wakes the collector, which polls for new requests; there may only be one calling
+        thread. Requests that do not fit into the queue are dropped and counted. */
     void registerCaptureRequest (const CaptureRequest&);
+    int getNumDroppedRequests() const { return m_numDroppedRequests.load(); }
+
+    /** Changes the window of all accumulators on the collector thread. Growing the
+        window backfills the new region from the ring buffer for recent triggers. */
+    void setWindowSize (int nPreSamples, int nPostSamples);
+
+    /** Processes queued requests on the calling thread, up to the first one whose window is
+        not complete yet. For offline processing, where the thread is not started. Returns
+        the number of trials that were accumulated. */
+    int processAvailableRequests();
+
+    /** Archives every trial that is accumulated from now on; nullptr stops archiving.
+        Returns the previous archive. Destroying it finishes its file, which can wait for the
+        disk, so the caller should do that rather than the collector thread. */
+    std::unique_ptr<TrialArchiveWriter>
+        setTrialArchive (std::unique_ptr<TrialArchiveWriter> archive);
 
 private:
     // dependencies
-    TriggeredAvgNode* m_processor;
+    std::function<void()> m_onDataUpdated;
     MultiChannelRingBuffer* ringBuffer;
     DataStore* m_datastore;
 
-    // data
+    // requests from the audio thread, moved into captureRequestQueue on the collector thread
+    static constexpr int maxPendingRequests = 4096;
+    juce::AbstractFifo m_requestFifo { maxPendingRequests };
+    std::vector<CaptureRequest> m_requestSlots;
+    std::atomic<int> m_numDroppedRequests = 0;
+
+    // data, collector thread only
     std::deque<CaptureRequest> captureRequestQueue;
-    AudioBuffer<float> m_collectBuffer;
+    juce::AudioBuffer<float> m_collectBuffer;
+
+    // optional copy of every accumulated trial on disk, see setTrialArchive()
+    std::mutex m_archiveLock;
+    std::unique_ptr<TrialArchiveWriter> m_archive;
+
+    // window change requested from the message thread
+    std::atomic<bool> m_windowChangePending = false;
+    std::atomic<int> m_pendingPreSamples = 0;
+    std::atomic<int> m_pendingPostSamples = 0;
 
     // synchronization
-    CriticalSection triggerQueueLock;
-    WaitableEvent newTriggerEvent;
+    juce::WaitableEvent newTriggerEvent;
 
+    void takeNewRequests();
+    void publishSnapshotsAndNotify();
     RingBufferReadResult processCaptureRequest (const CaptureRequest&);
+    bool accumulateTrial (const CaptureRequest&);
+    void applyPendingWindowChange();
+    void backfillWindowExtension (ConditionId id,
+                                  MultiChannelAverageBuffer& buffer,
+                                  int oldPreSamples,
+                                  int oldPostSamples);
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DataCollector)
 };
 
+/**
+    Running sum and sum of squares of the trials of one condition.
+
+    The window is [-preSamples, postSamples) around the trigger. Each sample keeps its own
+    trial count, so the window can be changed without discarding data: samples that were
+    newly added to the window start at zero trials and are averaged over the trials that
+    covered them since (or were backfilled).
+*/
 class MultiChannelAverageBuffer
 {
 public:
     MultiChannelAverageBuffer() = default;
-    MultiChannelAverageBuffer (int numChannels, int numSamples);
+    MultiChannelAverageBuffer (int numChannels, int numPreSamples, int numPostSamples);
     MultiChannelAverageBuffer (MultiChannelAverageBuffer&& other) noexcept;
     MultiChannelAverageBuffer& operator= (MultiChannelAverageBuffer&& other) noexcept;
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MultiChannelAverageBuffer)
 
-    void addDataToAverageFromBuffer (const juce::AudioBuffer<float>& buffer);
-    AudioBuffer<float> getAverage() const;
-    AudioBuffer<float> getStandardDeviation() const;
+    /** Adds a trial. bufferPreSamples is the trigger position within the buffer; only the
+        part overlapping the current window is accumulated. */
+    void addDataToAverageFromBuffer (const juce::AudioBuffer<float>& buffer, int bufferPreSamples);
+    void addDataToAverageFromBuffer (const juce::AudioBuffer<float>& buffer)
+    {
+        addDataToAverageFromBuffer (buffer, m_numPreSamples);
+    }
+
+    /** Adds samples of an already counted trial to [destStartSample, destStartSample + numSamples) */
+    void addSamplesToAverage (const juce::AudioBuffer<float>& buffer,
+                              int sourceStartSample,
+                              int destStartSample,
+                              int numSamples);
+
+    /** Adds the trials of another buffer, e.g. the partial average of one shard of a
+        recording. Sums, sums of squares and per-sample counts simply add, so the result
+        equals accumulating all trials in one buffer, including the cancellation that the
+        sum form has for the variance. A different window is aligned on the trigger and only
+        the overlap is added, as for trials captured with an old window. Returns false and
+        merges nothing if the channel counts differ. */
+    bool merge (const MultiChannelAverageBuffer& other);
+
+    juce::AudioBuffer<float> getAverage() const;
+    juce::AudioBuffer<float> getStandardDeviation() const;
 
     void resetTrials();
     int getNumTrials() const;
+    int getNumTrialsAtSample (int sample) const { return m_trialCountPerSample[sample]; }
     int getNumChannels() const;
     int getNumSamples() const;
+    int getNumPreSamples() const { return m_numPreSamples; }
+    int getNumPostSamples() const { return m_numSamples - m_numPreSamples; }
+    size_t getNumBytes() const;
+
+    /** Changes whenever the accumulated data or the window changes */
+    std::uint64_t getVersion() const { return m_version; }
+
     // resets and resizes the buffers
-    void setSize (int nChannels, int nSamples)
-    {
-        m_numChannels = nChannels;
-        m_numSamples = nSamples;
-        m_sumBuffer.setSize (nChannels, nSamples);
-        m_sumSquaresBuffer.setSize (nChannels, nSamples);
-        resetTrials();
-    }
+    void setSize (int nChannels, int nPreSamples, int nPostSamples);
+
+    /** Crops or extends the window in place, keeping the accumulated data of the samples
+        that are still part of it. Costs one memmove per channel. */
+    void resizeWindow (int nPreSamples, int nPostSamples);
 
 private:
     juce::AudioBuffer<float> m_sumBuffer;
     juce::AudioBuffer<float> m_sumSquaresBuffer;
+    std::vector<int> m_trialCountPerSample;
     int m_numTrials = 0;
-    int m_numChannels;
-    int m_numSamples;
+    int m_numChannels = 0;
+    int m_numSamples = 0;
+    int m_numPreSamples = 0;
+    std::uint64_t m_version = 0;
+};
+
+/** Immutable copy of a condition's mean, with a min/max pyramid per channel for drawing */
+struct AverageSnapshot
+{
+    AverageSnapshot() = default;
+
+    std::uint64_t version = 0;
+    int numTrials = 0;
+    int numPreSamples = 0;
+    juce::AudioBuffer<float> mean;
+    juce::AudioBuffer<float> standardDeviation;
+    // trials that contributed to each sample; differs from numTrials after the window grew
+    std::vector<int> trialCounts;
+    // index into mean, which is why a snapshot cannot be copied
+    std::vector<MinMaxPyramid> pyramids;
+    // extremes of each channel's mean and of the whole condition, for autoscaling
+    std::vector<juce::Range<float>> channelRanges;
+    juce::Range<float> range;
+
+    JUCE_DECLARE_NON_COPYABLE (AverageSnapshot)
 };
 
 } // namespace TriggeredAverage
@@ -1,6 +1,7 @@
 #include "MultiChannelRingBuffer.h"
+#include "TimingZones.h"
 
-#include <juce_audio_basics/juce_audio_basics.h> // for AudioBuffer
+#include <juce_audio_basics/juce_audio_basics.h> // for juce::AudioBuffer
 
 #include <algorithm>
 
@@ -16,11 +17,11 @@ MultiChannelRingBuffer::MultiChannelRingBuffer (int numChannels_, int bufferSize
     m_buffer.clear();
 }
 
-void MultiChannelRingBuffer::addData (const AudioBuffer<float>& inputBuffer,
-                                      SampleNumber firstSampleNumber, uint32 numberOfSamplesInBLock)
+void MultiChannelRingBuffer::addData (const juce::AudioBuffer<float>& inputBuffer,
+                                      SampleNumber firstSampleNumber,
+                                      juce::uint32 numberOfSamplesInBLock)
 {
-    const std::scoped_lock lock (writeLock);
-
+    TRIGGERED_AVG_TIMING_ZONE ("MultiChannelRingBuffer::addData");
     const int numSamplesIn = static_cast<int> (numberOfSamplesInBLock);
     if (numSamplesIn <= 0)
         return;
@@ -68,8 +69,9 @@ RingBufferReadResult
     MultiChannelRingBuffer::readAroundSample (SampleNumber centerSample,
                                               int preSamples,
                                               int postSamples,
-                                              AudioBuffer<float>& outputBuffer) const
+                                              juce::AudioBuffer<float>& outputBuffer) const
 {
+    TRIGGERED_AVG_TIMING_ZONE ("MultiChannelRingBuffer::readAroundSample");
     auto [result, startSample] =
         getStartSampleForTriggeredRead (centerSample, preSamples, postSamples);
     if (result != RingBufferReadResult::Success || ! startSample.has_value())
@@ -161,7 +163,6 @@ std::pair<RingBufferReadResult, std::optional<int>>
 
 void MultiChannelRingBuffer::reset()
 {
-    const std::scoped_lock lock (writeLock);
     m_buffer.clear();
     m_nextSampleNumber.store (0);
     m_writeIndex.store (0);
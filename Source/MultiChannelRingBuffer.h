@@ -1,7 +1,7 @@
 #pragma once
-#include <JuceHeader.h>
+#include <juce_audio_basics/juce_audio_basics.h>
 #include <atomic>
-#include <mutex>
+#include <optional>
 
 namespace TriggeredAverage
 {
@@ -24,7 +24,11 @@ public:
     MultiChannelRingBuffer (int numChannels, int bufferSize);
     ~MultiChannelRingBuffer() = default;
 
-    void addData (const juce::AudioBuffer<float>& inputBuffer, SampleNumber firstSampleNumber, uint32 numberOfSamplesInBLock);
+    /** Called on the audio thread; never allocates or locks. Readers on other threads only
+        see samples once the write position has moved past them. */
+    void addData (const juce::AudioBuffer<float>& inputBuffer,
+                  SampleNumber firstSampleNumber,
+                  juce::uint32 numberOfSamplesInBLock);
     RingBufferReadResult readAroundSample (SampleNumber centerSample,
                                            int preSamples,
                                            int postSamples,
@@ -36,6 +40,8 @@ public:
         getStartSampleForTriggeredRead (SampleNumber centerSample,
                                         int preSamples,
                                         int postSamples) const;
+
+    /** Not synchronised with addData(), so only call it while no data is added */
     void reset();
 
 private:
@@ -50,8 +56,6 @@ private:
     const int m_nChannels;
     int m_bufferSize;
 
-    mutable std::recursive_mutex writeLock;
-
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MultiChannelRingBuffer)
     JUCE_DECLARE_NON_MOVEABLE (MultiChannelRingBuffer)
 };
@@ -0,0 +1,144 @@
+#include "BinaryRecording.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace TriggeredAverage
+{
+
+namespace
+{
+juce::File getStreamFolder (const juce::File& parent, const juce::var& stream)
+{
+    return parent.getChildFile (stream["folder_name"].toString().trimCharactersAtEnd ("/"));
+}
+
+// newer recordings use the first name, older ones the second
+juce::File findFile (const juce::File& folder, const char* name, const char* legacyName)
+{
+    const auto file = folder.getChildFile (name);
+    return file.existsAsFile() ? file : folder.getChildFile (legacyName);
+}
+} // namespace
+
+juce::Result BinaryRecording::open (const juce::File& recordingFolder, int streamIndex)
+{
+    const auto structureFile = recordingFolder.getChildFile ("structure.oebin");
+    juce::var structure;
+    if (auto result = juce::JSON::parse (structureFile.loadFileAsString(), structure);
+        result.failed())
+        return juce::Result::fail ("Could not read " + structureFile.getFullPathName() + ": "
+                                   + result.getErrorMessage());
+
+    const auto& streams = structure["continuous"];
+    if (! streams.isArray() || streamIndex < 0 || streamIndex >= streams.size())
+        return juce::Result::fail ("The recording has no continuous stream "
+                                   + juce::String (streamIndex));
+
+    const auto& stream = streams[streamIndex];
+    m_streamName = stream.getProperty ("stream_name", stream["folder_name"]).toString();
+    m_sampleRate = static_cast<double> (stream["sample_rate"]);
+    m_numChannels = static_cast<int> (stream["num_channels"]);
+    m_channelNames.clear();
+    m_bitVolts.assign (static_cast<size_t> (m_numChannels), 1.0f);
+    if (const auto* channels = stream["channels"].getArray())
+    {
+        for (int ch = 0; ch < std::min (m_numChannels, channels->size()); ++ch)
+        {
+            m_channelNames.add ((*channels)[ch]["channel_name"].toString());
+            m_bitVolts[static_cast<size_t> (ch)] =
+                static_cast<float> ((*channels)[ch]["bit_volts"]);
+        }
+    }
+    if (m_numChannels <= 0 || m_sampleRate <= 0.0)
+        return juce::Result::fail ("Invalid stream description in "
+                                   + structureFile.getFullPathName());
+
+    const auto streamFolder = getStreamFolder (recordingFolder.getChildFile ("continuous"), stream);
+    const auto dataFile = streamFolder.getChildFile ("continuous.dat");
+    m_continuousFile =
+        std::make_unique<juce::MemoryMappedFile> (dataFile, juce::MemoryMappedFile::readOnly);
+    m_samples = static_cast<const std::int16_t*> (m_continuousFile->getData());
+    if (m_samples == nullptr)
+        return juce::Result::fail ("Could not map " + dataFile.getFullPathName());
+
+    const auto frameSize = static_cast<size_t> (m_numChannels) * sizeof (std::int16_t);
+    m_numSamples = static_cast<SampleNumber> (m_continuousFile->getSize() / frameSize);
+
+    m_firstSampleNumber = 0;
+    NpyFile sampleNumbers;
+    if (sampleNumbers.open (findFile (streamFolder, "sample_numbers.npy", "timestamps.npy"))
+            .wasOk()
+        && sampleNumbers.getNumElements() > 0)
+    {
+        m_firstSampleNumber = sampleNumbers.getInteger (0);
+    }
+
+    return loadTtlEvents (recordingFolder, structure["events"], stream["folder_name"].toString());
+}
+
+juce::Result BinaryRecording::loadTtlEvents (const juce::File& recordingFolder,
+                                             const juce::var& eventStreams,
+                                             const juce::String& streamFolderName)
+{
+    m_ttlEvents.clear();
+    if (! eventStreams.isArray())
+        return juce::Result::ok();
+
+    for (int index = 0; index < eventStreams.size(); ++index)
+    {
+        // event folders of a stream are named after its continuous folder, e.g. <stream>/TTL/
+        const auto& events = eventStreams[index];
+        const auto folderName = events["folder_name"].toString();
+        if (! folderName.startsWith (streamFolderName) || ! folderName.contains ("TTL"))
+            continue;
+
+        const auto folder = getStreamFolder (recordingFolder.getChildFile ("events"), events);
+        NpyFile sampleNumbers, states;
+        if (auto result =
+                sampleNumbers.open (findFile (folder, "sample_numbers.npy", "timestamps.npy"));
+            result.failed())
+            return result;
+        if (auto result = states.open (findFile (folder, "states.npy", "channel_states.npy"));
+            result.failed())
+            return result;
+        if (sampleNumbers.getNumElements() != states.getNumElements())
+            return juce::Result::fail ("Event sample numbers and states differ in length in "
+                                       + folder.getFullPathName());
+
+        for (std::int64_t i = 0; i < states.getNumElements(); ++i)
+        {
+            const auto state = states.getInteger (i);
+            m_ttlEvents.push_back (TtlEvent { .sampleNumber = sampleNumbers.getInteger (i),
+                                              .line = static_cast<int> (std::abs (state)) - 1,
+                                              .state = state > 0 });
+        }
+    }
+
+    std::stable_sort (m_ttlEvents.begin(),
+                      m_ttlEvents.end(),
+                      [] (const TtlEvent& a, const TtlEvent& b)
+                      { return a.sampleNumber < b.sampleNumber; });
+    return juce::Result::ok();
+}
+
+void BinaryRecording::readBlock (SampleNumber firstSample,
+                                 int numSamples,
+                                 juce::AudioBuffer<float>& dest) const
+{
+    jassert (firstSample >= m_firstSampleNumber
+             && firstSample + numSamples <= getEndSampleNumber());
+    jassert (dest.getNumChannels() == m_numChannels && dest.getNumSamples() >= numSamples);
+
+    const auto* frame = m_samples + (firstSample - m_firstSampleNumber) * m_numChannels;
+    for (int ch = 0; ch < m_numChannels; ++ch)
+    {
+        const float bitVolts = m_bitVolts[static_cast<size_t> (ch)];
+        const std::int16_t* source = frame + ch;
+        float* destination = dest.getWritePointer (ch);
+        for (int i = 0; i < numSamples; ++i)
+            destination[i] = static_cast<float> (source[i * m_numChannels]) * bitVolts;
+    }
+}
+
+} // namespace TriggeredAverage
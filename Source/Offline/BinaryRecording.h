@@ -0,0 +1,73 @@
+#pragma once
+#include "MultiChannelRingBuffer.h"
+#include "NpyFile.h"
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_core/juce_core.h>
+#include <memory>
+#include <vector>
+
+namespace TriggeredAverage
+{
+
+struct TtlEvent
+{
+    SampleNumber sampleNumber;
+    int line; // zero-based, as in the GUI
+    bool state;
+};
+
+/**
+    One continuous stream of a recording in the Open Ephys binary format, together with the
+    TTL events of that stream.
+
+    A recording folder holds structure.oebin, continuous/<stream>/continuous.dat with
+    interleaved 16 bit samples and sample_numbers.npy, and events/<stream>/TTL/ with
+    sample_numbers.npy and states.npy (+/- one-based line). Older recordings, which name
+    these timestamps.npy and channel_states.npy, are read as well. The samples are
+    memory-mapped; events are loaded when opening.
+*/
+class BinaryRecording
+{
+public:
+    /** Opens the stream with the given index of the folder that contains structure.oebin */
+    juce::Result open (const juce::File& recordingFolder, int streamIndex);
+
+    const juce::String& getStreamName() const { return m_streamName; }
+    double getSampleRate() const { return m_sampleRate; }
+    int getNumChannels() const { return m_numChannels; }
+    const juce::StringArray& getChannelNames() const { return m_channelNames; }
+
+    /** Sample number of the first sample; event sample numbers use the same clock */
+    SampleNumber getFirstSampleNumber() const { return m_firstSampleNumber; }
+    SampleNumber getNumSamples() const { return m_numSamples; }
+    SampleNumber getEndSampleNumber() const { return m_firstSampleNumber + m_numSamples; }
+
+    /** TTL events of the stream, ordered by sample number */
+    const std::vector<TtlEvent>& getTtlEvents() const { return m_ttlEvents; }
+
+    /** Copies numSamples samples starting at firstSample into the start of dest and scales
+        them to the channel units (usually microvolts), as the GUI does */
+    void readBlock (SampleNumber firstSample,
+                    int numSamples,
+                    juce::AudioBuffer<float>& dest) const;
+
+private:
+    juce::Result loadTtlEvents (const juce::File& recordingFolder,
+                                const juce::var& eventStreams,
+                                const juce::String& streamFolderName);
+
+    std::unique_ptr<juce::MemoryMappedFile> m_continuousFile;
+    const std::int16_t* m_samples = nullptr;
+
+    juce::String m_streamName;
+    double m_sampleRate = 0.0;
+    int m_numChannels = 0;
+    juce::StringArray m_channelNames;
+    std::vector<float> m_bitVolts;
+    SampleNumber m_firstSampleNumber = 0;
+    SampleNumber m_numSamples = 0;
+    std::vector<TtlEvent> m_ttlEvents;
+};
+
+} // namespace TriggeredAverage
@@ -0,0 +1,173 @@
+#include "NpyFile.h"
+
+#include <cstring>
+
+namespace TriggeredAverage
+{
+
+namespace
+{
+constexpr char npyMagic[] = "\x93NUMPY";
+constexpr size_t npyMagicLength = 6;
+constexpr size_t npyHeaderAlignment = 64;
+
+// value of a key in the header dictionary, e.g. "'<f4'" or "(3, 4)"
+juce::String getHeaderValue (const juce::String& header, const juce::String& key)
+{
+    const auto value = header.fromFirstOccurrenceOf ("'" + key + "':", false, false).trimStart();
+    if (value.startsWithChar ('('))
+        return value.upToFirstOccurrenceOf (")", true, false);
+    if (value.startsWithChar ('\''))
+        return value.substring (1).upToFirstOccurrenceOf ("'", false, false);
+    return value.upToFirstOccurrenceOf (",", false, false).trim();
+}
+
+std::int64_t readLittleEndian (const std::uint8_t* bytes, int numBytes)
+{
+    std::uint64_t value = 0;
+    for (int i = numBytes; --i >= 0;)
+        value = (value << 8) | bytes[i];
+    return static_cast<std::int64_t> (value);
+}
+} // namespace
+
+juce::Result NpyFile::open (const juce::File& file)
+{
+    m_file = std::make_unique<juce::MemoryMappedFile> (file, juce::MemoryMappedFile::readOnly);
+    const auto* bytes = static_cast<const std::uint8_t*> (m_file->getData());
+    const size_t fileSize = m_file->getSize();
+    if (bytes == nullptr || fileSize < npyMagicLength + 4
+        || std::memcmp (bytes, npyMagic, npyMagicLength) != 0)
+        return juce::Result::fail ("Not a .npy file: " + file.getFullPathName());
+
+    // version 1 stores the header length in 2 bytes, later versions in 4
+    const int lengthBytes = bytes[npyMagicLength] == 1 ? 2 : 4;
+    const size_t headerStart = npyMagicLength + 2 + static_cast<size_t> (lengthBytes);
+    const auto headerLength =
+        static_cast<size_t> (readLittleEndian (bytes + npyMagicLength + 2, lengthBytes));
+    if (headerStart + headerLength > fileSize)
+        return juce::Result::fail ("Truncated .npy header: " + file.getFullPathName());
+
+    const juce::String header (reinterpret_cast<const char*> (bytes + headerStart), headerLength);
+    m_dtype = getHeaderValue (header, "descr");
+    if (getHeaderValue (header, "fortran_order") != "False")
+        return juce::Result::fail ("Fortran ordered arrays are not supported: "
+                                   + file.getFullPathName());
+    if (m_dtype.length() < 3 || m_dtype[0] == '>')
+        return juce::Result::fail ("Unsupported .npy type " + m_dtype + ": "
+                                   + file.getFullPathName());
+
+    m_shape.clear();
+    m_numElements = 1;
+    const auto shape = getHeaderValue (header, "shape").removeCharacters ("() ");
+    for (const auto& dimension : juce::StringArray::fromTokens (shape, ",", ""))
+    {
+        if (dimension.isEmpty())
+            continue;
+        m_shape.push_back (dimension.getLargeIntValue());
+        m_numElements *= m_shape.back();
+    }
+
+    m_itemSize = m_dtype.substring (2).getIntValue();
+    m_data = bytes + headerStart + headerLength;
+    const auto dataSize = static_cast<std::uint64_t> (m_numElements) * m_itemSize;
+    if (m_itemSize <= 0 || headerStart + headerLength + dataSize > fileSize)
+        return juce::Result::fail ("Truncated .npy data: " + file.getFullPathName());
+
+    return juce::Result::ok();
+}
+
+std::int64_t NpyFile::getInteger (std::int64_t index) const
+{
+    jassert (index >= 0 && index < m_numElements);
+    const auto* item = static_cast<const std::uint8_t*> (m_data) + index * m_itemSize;
+    const auto value = readLittleEndian (item, m_itemSize);
+
+    // sign-extend signed types narrower than 64 bits
+    if (m_dtype[1] == 'i' && m_itemSize < 8)
+    {
+        const int shift = 64 - 8 * m_itemSize;
+        return static_cast<std::int64_t> (static_cast<std::uint64_t> (value) << shift) >> shift;
+    }
+    return value;
+}
+
+std::vector<std::int64_t> NpyFile::readIntegers() const
+{
+    jassert (m_dtype[1] == 'i' || m_dtype[1] == 'u' || m_dtype[1] == 'b');
+    std::vector<std::int64_t> values (static_cast<size_t> (m_numElements));
+    for (std::int64_t i = 0; i < m_numElements; ++i)
+        values[static_cast<size_t> (i)] = getInteger (i);
+    return values;
+}
+
+NpyWriter::NpyWriter (const juce::File& file,
+                      const juce::String& dtype,
+                      std::vector<std::int64_t> shape)
+{
+    m_expectedBytes = static_cast<std::uint64_t> (dtype.substring (2).getIntValue());
+    for (auto dimension : shape)
+        m_expectedBytes *= static_cast<std::uint64_t> (dimension);
+
+    file.deleteFile();
+    m_stream = std::make_unique<juce::FileOutputStream> (file, 1 << 20);
+    if (m_stream->openedOk())
+    {
+        const auto header = makeHeader (dtype, shape);
+        m_stream->write (header.getData(), header.getSize());
+    }
+}
+
+bool NpyWriter::write (const void* data, size_t numBytes)
+{
+    if (! openedOk() || ! m_stream->write (data, numBytes))
+        return false;
+    m_bytesWritten += numBytes;
+    return true;
+}
+
+juce::Result NpyWriter::finish()
+{
+    if (! openedOk())
+        return juce::Result::fail ("Could not open " + m_stream->getFile().getFullPathName());
+
+    m_stream->flush();
+    if (m_stream->getStatus().failed())
+        return m_stream->getStatus();
+    if (m_bytesWritten != m_expectedBytes)
+        return juce::Result::fail ("Size does not match the shape of "
+                                   + m_stream->getFile().getFullPathName());
+    return juce::Result::ok();
+}
+
+juce::MemoryBlock NpyWriter::makeHeader (const juce::String& dtype,
+                                         const std::vector<std::int64_t>& shape)
+{
+    juce::String shapeText;
+    for (auto dimension : shape)
+        shapeText << juce::String (static_cast<juce::int64> (dimension)) << ", ";
+    shapeText = shape.size() == 1 ? shapeText.trimEnd() : shapeText.dropLastCharacters (2);
+
+    auto dictionary = "{'descr': '" + dtype + "', 'fortran_order': False, 'shape': (" + shapeText
+                      + "), }";
+
+    // pad with spaces so the data starts aligned, the header ends with a newline
+    const size_t prefixLength = npyMagicLength + 4;
+    const size_t unpadded = prefixLength + static_cast<size_t> (dictionary.length()) + 1;
+    const size_t padding =
+        (npyHeaderAlignment - unpadded % npyHeaderAlignment) % npyHeaderAlignment;
+    dictionary << juce::String::repeatedString (" ", static_cast<int> (padding)) << "\n";
+
+    const auto headerLength = static_cast<std::uint16_t> (dictionary.length());
+    juce::MemoryBlock header;
+    header.append (npyMagic, npyMagicLength);
+    const std::uint8_t version[] = { 1, 0 };
+    header.append (version, sizeof (version));
+    const std::uint8_t length[] = { static_cast<std::uint8_t> (headerLength & 0xff),
+                                    static_cast<std::uint8_t> (headerLength >> 8) };
+    header.append (length, sizeof (length));
+    header.append (dictionary.toRawUTF8(), static_cast<size_t> (dictionary.length()));
+    return header;
+}
+
+} // namespace TriggeredAverage
@@ -0,0 +1,63 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace TriggeredAverage
+{
+
+/**
+    Read-only view of a NumPy .npy file. The file is memory-mapped, so large arrays can be
+    read without loading them. Only little-endian, C-ordered arrays are supported.
+*/
+class NpyFile
+{
+public:
+    juce::Result open (const juce::File& file);
+
+    /** NumPy type string, e.g. "<i8" or "<f4" */
+    const juce::String& getDtype() const { return m_dtype; }
+    const std::vector<std::int64_t>& getShape() const { return m_shape; }
+    std::int64_t getNumElements() const { return m_numElements; }
+    int getItemSize() const { return m_itemSize; }
+    const void* getData() const { return m_data; }
+
+    /** Element of an integer array, widened to 64 bits */
+    std::int64_t getInteger (std::int64_t index) const;
+    std::vector<std::int64_t> readIntegers() const;
+
+private:
+    std::unique_ptr<juce::MemoryMappedFile> m_file;
+    juce::String m_dtype;
+    std::vector<std::int64_t> m_shape;
+    std::int64_t m_numElements = 0;
+    int m_itemSize = 0;
+    const void* m_data = nullptr;
+};
+
+/**
+    Writes a little-endian, C-ordered .npy file. The header is written on construction and
+    the data is streamed after it, in as many write() calls as convenient; finish() checks
+    that the amount written matches the shape.
+*/
+class NpyWriter
+{
+public:
+    NpyWriter (const juce::File& file, const juce::String& dtype, std::vector<std::int64_t> shape);
+
+    bool openedOk() const { return m_stream != nullptr && m_stream->openedOk(); }
+    bool write (const void* data, size_t numBytes);
+    juce::Result finish();
+
+    /** Header including magic string and padding, aligned to 64 bytes */
+    static juce::MemoryBlock makeHeader (const juce::String& dtype,
+                                         const std::vector<std::int64_t>& shape);
+
+private:
+    std::unique_ptr<juce::FileOutputStream> m_stream;
+    std::uint64_t m_expectedBytes = 0;
+    std::uint64_t m_bytesWritten = 0;
+};
+
+} // namespace TriggeredAverage
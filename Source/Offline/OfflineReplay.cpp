@@ -0,0 +1,293 @@
+#include "OfflineReplay.h"
+#include "BinaryRecording.h"
+#include "MultiChannelRingBuffer.h"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <span>
+
+namespace TriggeredAverage
+{
+
+namespace
+{
+constexpr int shardsPerWorker = 8;
+
+bool isInSampleOrder (std::span<const CaptureRequest> requests)
+{
+    return std::is_sorted (requests.begin(),
+                           requests.end(),
+                           [] (const CaptureRequest& a, const CaptureRequest& b)
+                           { return a.triggerSample < b.triggerSample; });
+}
+
+/** The ring buffer, collector and block buffer of one thread, which may be fed several sets
+    of requests one after the other, in any order of the recording. */
+class ReplayPipeline
+{
+public:
+    ReplayPipeline (const BinaryRecording& recording,
+                    const ReplaySettings& settings,
+                    DataStore& store)
+        : m_recording (recording),
+          m_blockSize (settings.blockSize),
+          // a window must still be in the ring buffer after the block that completes it
+          m_ringBuffer (recording.getNumChannels(),
+                        settings.preSamples + settings.postSamples + 2 * settings.blockSize),
+          m_collector ({}, &m_ringBuffer, &store),
+          m_block (recording.getNumChannels(), settings.blockSize)
+    {
+    }
+
+    void process (std::span<const CaptureRequest> requests, ReplayStats& stats)
+    {
+        stats.numTriggers += static_cast<int> (requests.size());
+
+        // windows outside the recording could only be completed with stale samples, so they
+        // are dropped here rather than left queued in the collector
+        std::vector<CaptureRequest> inside;
+        for (const auto& request : requests)
+        {
+            if (request.triggerSample - request.preSamples >= m_recording.getFirstSampleNumber()
+                && request.triggerSample + request.postSamples
+                       <= m_recording.getEndSampleNumber())
+            {
+                inside.push_back (request);
+            }
+        }
+
+        size_t nextRequest = 0;
+
+        // skipping a gap leaves the ring buffer with stale samples before the next range, but
+        // every window lies inside one range, so they are never read
+        for (const auto& range : getRangesToRead (inside))
+        {
+            for (auto start = range.getStart(); start < range.getEnd(); start += m_blockSize)
+            {
+                const auto numSamples =
+                    static_cast<int> (std::min<SampleNumber> (m_blockSize, range.getEnd() - start));
+                m_recording.readBlock (start, numSamples, m_block);
+                m_ringBuffer.addData (m_block, start, static_cast<juce::uint32> (numSamples));
+                stats.numSamplesRead += numSamples;
+
+                // triggers are registered once they have been "played", as in the plugin
+                while (nextRequest < inside.size()
+                       && inside[nextRequest].triggerSample < start + numSamples)
+                {
+                    m_collector.registerCaptureRequest (inside[nextRequest++]);
+                }
+                stats.numTrialsAccumulated += m_collector.processAvailableRequests();
+            }
+        }
+    }
+
+private:
+    // merged sample ranges [start, end) that contain all trigger windows
+    std::vector<juce::Range<SampleNumber>>
+        getRangesToRead (const std::vector<CaptureRequest>& requests) const
+    {
+        std::vector<juce::Range<SampleNumber>> ranges;
+        for (const auto& request : requests)
+        {
+            const juce::Range<SampleNumber> window (request.triggerSample - request.preSamples,
+                                                    request.triggerSample
+                                                        + request.postSamples);
+
+            // gaps shorter than a block are cheaper to read than to skip
+            if (! ranges.empty() && window.getStart() <= ranges.back().getEnd() + m_blockSize)
+                ranges.back() = ranges.back().getUnionWith (window);
+            else
+                ranges.push_back (window);
+        }
+        return ranges;
+    }
+
+    const BinaryRecording& m_recording;
+    const int m_blockSize;
+    MultiChannelRingBuffer m_ringBuffer;
+    DataCollector m_collector;
+    juce::AudioBuffer<float> m_block;
+};
+
+/** Shard indices dealt out to the workers in contiguous runs, so that each worker starts on
+    its own part of the recording. A worker takes from the front of its own queue and, once
+    that is empty, steals from the back of another one. */
+class ShardQueues
+{
+public:
+    ShardQueues (int numShards, int numWorkers) : m_queues (static_cast<size_t> (numWorkers))
+    {
+        for (int shard = 0; shard < numShards; ++shard)
+            m_queues[static_cast<size_t> (shard * numWorkers / numShards)].shards.push_back (shard);
+    }
+
+    std::optional<int> next (int worker)
+    {
+        const auto numWorkers = m_queues.size();
+        for (size_t i = 0; i < numWorkers; ++i)
+        {
+            auto& queue = m_queues[(static_cast<size_t> (worker) + i) % numWorkers];
+            std::scoped_lock lock (queue.mutex);
+            if (queue.shards.empty())
+                continue;
+
+            int shard;
+            if (i == 0)
+            {
+                shard = queue.shards.front();
+                queue.shards.pop_front();
+            }
+            else
+            {
+                shard = queue.shards.back();
+                queue.shards.pop_back();
+            }
+            return shard;
+        }
+        return std::nullopt;
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<int> shards;
+    };
+    std::vector<Queue> m_queues;
+};
+
+class ShardWorker : public juce::ThreadPoolJob
+{
+public:
+    struct Context
+    {
+        const BinaryRecording& recording;
+        const ReplaySettings& settings;
+        const std::vector<CaptureRequest>& requests;
+        int numShards;
+        ShardQueues& queues;
+    };
+
+    ShardWorker (int index, Context context, DataStore& store, ReplayStats& stats)
+        : juce::ThreadPoolJob ("Replay shard worker " + juce::String (index)),
+          m_index (index),
+          m_context (context),
+          m_store (store),
+          m_stats (stats)
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        // created here so that the ring buffer is first touched by the thread that uses it
+        ReplayPipeline pipeline (m_context.recording, m_context.settings, m_store);
+        const auto numRequests = m_context.requests.size();
+        const auto numShards = static_cast<size_t> (m_context.numShards);
+
+        while (auto shard = m_context.queues.next (m_index))
+        {
+            const auto first = static_cast<size_t> (*shard) * numRequests / numShards;
+            const auto last = static_cast<size_t> (*shard + 1) * numRequests / numShards;
+            pipeline.process (std::span (m_context.requests).subspan (first, last - first),
+                              m_stats);
+        }
+        return jobHasFinished;
+    }
+
+private:
+    const int m_index;
+    Context m_context;
+    DataStore& m_store;
+    ReplayStats& m_stats;
+};
+} // namespace
+
+OfflineReplay::OfflineReplay (const BinaryRecording& recording, ReplaySettings settings)
+    : m_recording (recording),
+      m_settings (std::move (settings))
+{
+}
+
+std::vector<CaptureRequest> OfflineReplay::makeCaptureRequests() const
+{
+    std::vector<CaptureRequest> requests;
+    for (const auto& event : m_recording.getTtlEvents())
+    {
+        if (! event.state)
+            continue;
+
+        for (const auto& condition : m_settings.conditions)
+        {
+            if (condition.ttlLine < 0 || condition.ttlLine == event.line)
+            {
+                requests.push_back (CaptureRequest { .conditionId = condition.id,
+                                                     .triggerSample = event.sampleNumber,
+                                                     .preSamples = m_settings.preSamples,
+                                                     .postSamples = m_settings.postSamples });
+            }
+        }
+    }
+    return requests;
+}
+
+ReplayStats OfflineReplay::run (const std::vector<CaptureRequest>& requests,
+                                DataStore& store) const
+{
+    jassert (isInSampleOrder (requests));
+
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+    ReplayStats stats;
+    ReplayPipeline (m_recording, m_settings, store).process (requests, stats);
+    stats.seconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+    return stats;
+}
+
+ReplayStats OfflineReplay::runParallel (const std::vector<CaptureRequest>& requests,
+                                        DataStore& store,
+                                        int numThreads) const
+{
+    jassert (isInSampleOrder (requests));
+
+    numThreads = std::max (1, numThreads);
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+    // several shards per worker, so that stealing can even out an uneven trigger density
+    const int numShards =
+        std::max (1, std::min (static_cast<int> (requests.size()), numThreads * shardsPerWorker));
+    ShardQueues queues (numShards, numThreads);
+
+    std::vector<DataStore> partialStores (static_cast<size_t> (numThreads));
+    std::vector<ReplayStats> partialStats (static_cast<size_t> (numThreads));
+    std::vector<std::unique_ptr<ShardWorker>> workers;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        workers.push_back (std::make_unique<ShardWorker> (
+            i,
+            ShardWorker::Context { m_recording, m_settings, requests, numShards, queues },
+            partialStores[static_cast<size_t> (i)],
+            partialStats[static_cast<size_t> (i)]));
+    }
+
+    juce::ThreadPool pool (juce::ThreadPoolOptions {}
+                               .withThreadName ("Offline replay")
+                               .withNumberOfThreads (numThreads));
+    for (auto& worker : workers)
+        pool.addJob (worker.get(), false);
+    for (auto& worker : workers)
+        pool.waitForJobToFinish (worker.get(), -1);
+
+    ReplayStats stats;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        store.mergeAveragesFrom (partialStores[static_cast<size_t> (i)]);
+        stats.numTrialsAccumulated += partialStats[static_cast<size_t> (i)].numTrialsAccumulated;
+        stats.numSamplesRead += partialStats[static_cast<size_t> (i)].numSamplesRead;
+    }
+    stats.numTriggers = static_cast<int> (requests.size());
+    stats.seconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+    return stats;
+}
+
+} // namespace TriggeredAverage
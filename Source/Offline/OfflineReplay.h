@@ -0,0 +1,71 @@
+#pragma once
+#include "ConditionId.h"
+#include "DataCollector.h"
+
+#include <juce_core/juce_core.h>
+#include <vector>
+
+namespace TriggeredAverage
+{
+class BinaryRecording;
+
+struct ReplayCondition
+{
+    ConditionId id;
+    juce::String name;
+    int ttlLine; // zero-based; negative triggers on every line
+};
+
+struct ReplaySettings
+{
+    int preSamples = 0;
+    int postSamples = 0;
+    int blockSize = 4096;
+    std::vector<ReplayCondition> conditions;
+};
+
+struct ReplayStats
+{
+    int numTriggers = 0;
+    int numTrialsAccumulated = 0;
+    std::int64_t numSamplesRead = 0;
+    double seconds = 0.0;
+};
+
+/**
+    Averages a recording with the same ring buffer, collector and accumulators as the
+    plugin, but without playback: blocks are fed as fast as they can be read, and only the
+    parts of the recording that are covered by a trigger window are read at all.
+*/
+class OfflineReplay
+{
+public:
+    OfflineReplay (const BinaryRecording& recording, ReplaySettings settings);
+
+    /** Capture requests for the rising TTL edges of all conditions, in sample order */
+    std::vector<CaptureRequest> makeCaptureRequests() const;
+
+    /** Accumulates the given requests, which must be in sample order, into the store.
+        Triggers whose window does not lie inside the recording are skipped. */
+    ReplayStats run (const std::vector<CaptureRequest>& requests, DataStore& store) const;
+    ReplayStats run (DataStore& store) const { return run (makeCaptureRequests(), store); }
+
+    /** Like run(), but splits the requests into shards of neighbouring triggers that
+        numThreads workers average into private stores, stealing shards from each other
+        when they run out. The partial averages are then merged into the store. */
+    ReplayStats runParallel (const std::vector<CaptureRequest>& requests,
+                             DataStore& store,
+                             int numThreads) const;
+    ReplayStats runParallel (DataStore& store, int numThreads) const
+    {
+        return runParallel (makeCaptureRequests(), store, numThreads);
+    }
+
+    const ReplaySettings& getSettings() const { return m_settings; }
+
+private:
+    const BinaryRecording& m_recording;
+    ReplaySettings m_settings;
+};
+
+} // namespace TriggeredAverage
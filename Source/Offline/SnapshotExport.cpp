@@ -0,0 +1,120 @@
+#include "SnapshotExport.h"
+#include "DataCollector.h"
+#include "NpyFile.h"
+#include "TrialHistory.h"
+
+#include <optional>
+#include <set>
+
+namespace TriggeredAverage
+{
+
+namespace
+{
+juce::Result writeBuffer (const juce::AudioBuffer<float>& buffer, const juce::File& file)
+{
+    NpyWriter writer (file, "<f4", { buffer.getNumChannels(), buffer.getNumSamples() });
+    const auto channelBytes = static_cast<size_t> (buffer.getNumSamples()) * sizeof (float);
+    for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+        writer.write (buffer.getReadPointer (ch), channelBytes);
+    return writer.finish();
+}
+} // namespace
+
+juce::Result writeSnapshotAsNpy (const AverageSnapshot& snapshot,
+                                 const juce::File& folder,
+                                 const juce::String& prefix)
+{
+    if (auto result = writeBuffer (snapshot.mean, folder.getChildFile (prefix + "_mean.npy"));
+        result.failed())
+        return result;
+
+    if (auto result = writeBuffer (snapshot.standardDeviation,
+                                   folder.getChildFile (prefix + "_sd.npy"));
+        result.failed())
+        return result;
+
+    static_assert (sizeof (int) == 4);
+    NpyWriter counts (folder.getChildFile (prefix + "_trial_counts.npy"),
+                      "<i4",
+                      { static_cast<std::int64_t> (snapshot.trialCounts.size()) });
+    counts.write (snapshot.trialCounts.data(), snapshot.trialCounts.size() * sizeof (int));
+    return counts.finish();
+}
+
+juce::Result writeTrialHistoryAsNpy (const TrialHistory& history,
+                                     const juce::File& folder,
+                                     const juce::String& prefix)
+{
+    const auto first = history.getFirstStoredTrial();
+    const auto numTrials = history.getNumTrialsAdded() - first;
+    NpyWriter writer (folder.getChildFile (prefix + "_trials.npy"),
+                      "<f4",
+                      { static_cast<std::int64_t> (numTrials),
+                        history.getNumChannels(),
+                        history.getNumColumns() });
+
+    const auto channelBytes = static_cast<size_t> (history.getNumColumns()) * sizeof (float);
+    for (auto trial = first; trial < history.getNumTrialsAdded(); ++trial)
+        for (int ch = 0; ch < history.getNumChannels(); ++ch)
+            writer.write (history.getTrial (ch, trial), channelBytes);
+    return writer.finish();
+}
+
+juce::String makeUniquePrefix (const juce::String& prefix,
+                               ConditionId id,
+                               std::set<juce::String>& usedPrefixes)
+{
+    if (usedPrefixes.insert (prefix).second)
+        return prefix;
+
+    const auto withId = prefix + "_" + juce::String (id);
+    auto candidate = withId;
+    for (int suffix = 2; ! usedPrefixes.insert (candidate).second; ++suffix)
+        candidate = withId + "_" + juce::String (suffix);
+    return candidate;
+}
+
+juce::Result exportConditionsAsNpy (DataStore& store,
+                                    const std::vector<ExportedCondition>& conditions,
+                                    const juce::File& folder,
+                                    const juce::String& prefix)
+{
+    if (auto result = folder.createDirectory(); result.failed())
+        return result;
+
+    std::set<juce::String> usedPrefixes;
+    for (const auto& condition : conditions)
+    {
+        auto snapshot = store.getAverageSnapshot (condition.id);
+        if (snapshot == nullptr)
+            continue;
+
+        const auto conditionPrefix = makeUniquePrefix (
+            prefix + "_"
+                + juce::File::createLegalFileName (condition.name).replaceCharacter (' ', '_'),
+            condition.id,
+            usedPrefixes);
+
+        if (auto result = writeSnapshotAsNpy (*snapshot, folder, conditionPrefix);
+            result.failed())
+            return result;
+
+        std::optional<TrialHistory> trials;
+        {
+            auto lock = store.GetLock();
+            if (const auto* history = store.getTrialHistory (condition.id);
+                history != nullptr && history->getNumTrialsAdded() > 0)
+                trials.emplace (*history);
+        }
+        if (trials.has_value())
+        {
+            if (auto result = writeTrialHistoryAsNpy (*trials, folder, conditionPrefix);
+                result.failed())
+                return result;
+        }
+    }
+    return juce::Result::ok();
+}
+
+} // namespace TriggeredAverage
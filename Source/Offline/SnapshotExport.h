@@ -0,0 +1,47 @@
+#pragma once
+#include "ConditionId.h"
+
+#include <juce_core/juce_core.h>
+#include <set>
+#include <vector>
+
+namespace TriggeredAverage
+{
+struct AverageSnapshot;
+class DataStore;
+class TrialHistory;
+
+/** Writes <prefix>_mean.npy and <prefix>_sd.npy as float32 [channels, samples] and
+    <prefix>_trial_counts.npy as int32 [samples] into folder */
+juce::Result writeSnapshotAsNpy (const AverageSnapshot& snapshot,
+                                 const juce::File& folder,
+                                 const juce::String& prefix);
+
+/** Writes the stored trials, oldest first, as float32 [trials, channels, columns] to
+    <prefix>_trials.npy. The history keeps each trial decimated to getNumColumns() columns. */
+juce::Result writeTrialHistoryAsNpy (const TrialHistory& history,
+                                     const juce::File& folder,
+                                     const juce::String& prefix);
+
+struct ExportedCondition
+{
+    ConditionId id;
+    juce::String name;
+};
+
+/** Returns prefix, or if it is already in usedPrefixes the first free one of prefix_<id>,
+    prefix_<id>_2, prefix_<id>_3, ..., and adds the result to usedPrefixes */
+juce::String makeUniquePrefix (const juce::String& prefix,
+                               ConditionId id,
+                               std::set<juce::String>& usedPrefixes);
+
+/** Writes the average and the stored trials of every condition that has data, with
+    <prefix>_<condition name> as file prefix, made unique with makeUniquePrefix(). The store
+    is only locked while a trial history is copied, so the collector continues while the
+    files are written; meant to be run on a background thread. */
+juce::Result exportConditionsAsNpy (DataStore& store,
+                                    const std::vector<ExportedCondition>& conditions,
+                                    const juce::File& folder,
+                                    const juce::String& prefix);
+
+} // namespace TriggeredAverage
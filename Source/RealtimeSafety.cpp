@@ -0,0 +1,183 @@
+#include "RealtimeSafety.h"
+
+#if TRIGGERED_AVG_REALTIME_CHECKS
+
+    #include <atomic>
+    #include <cerrno>
+    #include <cstddef>
+    #include <cstdlib>
+    #include <new>
+
+    #if defined(__GLIBC__)
+        #include <dlfcn.h>
+        #include <pthread.h>
+        #include <unistd.h>
+    #endif
+
+namespace TriggeredAverage::RealtimeSafety
+{
+namespace
+{
+    // plain thread_local ints need no allocation, so the hooks can use them
+    thread_local int sectionDepth = 0;
+
+    std::atomic<int> numAllocations { 0 };
+    std::atomic<int> numDeallocations { 0 };
+    std::atomic<int> numLocks { 0 };
+    std::atomic<bool> abortOnViolation { false };
+
+    void report (std::atomic<int>& counter, const char* what)
+    {
+        if (sectionDepth == 0)
+            return;
+
+        counter.fetch_add (1, std::memory_order_relaxed);
+        if (abortOnViolation.load (std::memory_order_relaxed))
+        {
+    #if defined(__GLIBC__)
+            constexpr char prefix[] = "Real-time violation: ";
+            ::write (2, prefix, sizeof (prefix) - 1);
+            ::write (2, what, __builtin_strlen (what));
+            ::write (2, "\n", 1);
+    #else
+            (void) what;
+    #endif
+            std::abort();
+        }
+    }
+
+    void noteAllocation() { report (numAllocations, "allocation"); }
+    void noteDeallocation() { report (numDeallocations, "deallocation"); }
+    void noteLock() { report (numLocks, "mutex lock"); }
+} // namespace
+
+void enterSection() { ++sectionDepth; }
+void exitSection() { --sectionDepth; }
+bool isInSection() { return sectionDepth > 0; }
+
+ViolationCounts getViolationCounts()
+{
+    return { numAllocations.load(), numDeallocations.load(), numLocks.load() };
+}
+
+void resetViolationCounts()
+{
+    numAllocations.store (0);
+    numDeallocations.store (0);
+    numLocks.store (0);
+}
+
+void setAbortOnViolation (bool shouldAbort) { abortOnViolation.store (shouldAbort); }
+
+} // namespace TriggeredAverage::RealtimeSafety
+
+namespace rt = TriggeredAverage::RealtimeSafety;
+
+    #if defined(__GLIBC__)
+
+// glibc lets the executable replace the allocator; operator new ends up here as well
+extern "C"
+{
+    void* __libc_malloc (size_t);
+    void* __libc_calloc (size_t, size_t);
+    void* __libc_realloc (void*, size_t);
+    void* __libc_memalign (size_t, size_t);
+    void __libc_free (void*);
+
+    void* malloc (size_t size)
+    {
+        rt::noteAllocation();
+        return __libc_malloc (size);
+    }
+
+    void* calloc (size_t count, size_t size)
+    {
+        rt::noteAllocation();
+        return __libc_calloc (count, size);
+    }
+
+    void* realloc (void* pointer, size_t size)
+    {
+        rt::noteAllocation();
+        return __libc_realloc (pointer, size);
+    }
+
+    void* aligned_alloc (size_t alignment, size_t size)
+    {
+        rt::noteAllocation();
+        return __libc_memalign (alignment, size);
+    }
+
+    int posix_memalign (void** result, size_t alignment, size_t size)
+    {
+        if (alignment < sizeof (void*) || (alignment & (alignment - 1)) != 0)
+            return EINVAL;
+
+        rt::noteAllocation();
+        *result = __libc_memalign (alignment, size);
+        return *result != nullptr || size == 0 ? 0 : ENOMEM;
+    }
+
+    void free (void* pointer)
+    {
+        if (pointer != nullptr)
+            rt::noteDeallocation();
+        __libc_free (pointer);
+    }
+
+    // std::mutex, std::recursive_mutex and juce::CriticalSection all lock through here
+    int pthread_mutex_lock (pthread_mutex_t* mutex)
+    {
+        using LockFunction = int (*) (pthread_mutex_t*);
+        static std::atomic<LockFunction> next { nullptr };
+
+        auto lock = next.load (std::memory_order_acquire);
+        if (lock == nullptr)
+        {
+            lock = reinterpret_cast<LockFunction> (dlsym (RTLD_NEXT, "pthread_mutex_lock"));
+            next.store (lock, std::memory_order_release);
+        }
+
+        rt::noteLock();
+        return lock (mutex);
+    }
+}
+
+    #else
+
+// elsewhere only C++ allocations are seen
+void* operator new (std::size_t size)
+{
+    rt::noteAllocation();
+    if (auto* pointer = std::malloc (size == 0 ? 1 : size))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size) { return ::operator new (size); }
+
+void* operator new (std::size_t size, const std::nothrow_t&) noexcept
+{
+    rt::noteAllocation();
+    return std::malloc (size == 0 ? 1 : size);
+}
+
+void* operator new[] (std::size_t size, const std::nothrow_t& tag) noexcept
+{
+    return ::operator new (size, tag);
+}
+
+void operator delete (void* pointer) noexcept
+{
+    if (pointer != nullptr)
+        rt::noteDeallocation();
+    std::free (pointer);
+}
+
+void operator delete[] (void* pointer) noexcept { ::operator delete (pointer); }
+void operator delete (void* pointer, std::size_t) noexcept { ::operator delete (pointer); }
+void operator delete[] (void* pointer, std::size_t) noexcept { ::operator delete (pointer); }
+
+    #endif
+
+#endif
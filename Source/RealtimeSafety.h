@@ -0,0 +1,61 @@
+#pragma once
+
+/**
+    Real-time safety checker for test and benchmark builds.
+
+    Code that runs on the audio thread marks itself with a ScopedRealtimeSection. When the
+    core library is built with TRIGGERED_AVG_REALTIME_CHECKS, operator new and delete are
+    replaced, and on Linux (glibc) also malloc/free and pthread_mutex_lock, so that every
+    allocation, deallocation or mutex lock inside a section is counted as a violation, or
+    aborts the process if setAbortOnViolation (true) was called. Without the flag the sections
+    compile to nothing and no hooks are installed.
+
+    The hooks replace the allocator of the whole executable, so the flag is meant for the
+    headless tests and benchmark, never for the plugin.
+*/
+namespace TriggeredAverage::RealtimeSafety
+{
+
+struct ViolationCounts
+{
+    int allocations = 0;
+    int deallocations = 0;
+    int locks = 0;
+
+    int total() const { return allocations + deallocations + locks; }
+};
+
+#if TRIGGERED_AVG_REALTIME_CHECKS
+constexpr bool isEnabled = true;
+
+void enterSection();
+void exitSection();
+bool isInSection();
+
+ViolationCounts getViolationCounts();
+void resetViolationCounts();
+void setAbortOnViolation (bool shouldAbort);
+#else
+constexpr bool isEnabled = false;
+
+inline void enterSection() {}
+inline void exitSection() {}
+inline bool isInSection() { return false; }
+
+inline ViolationCounts getViolationCounts() { return {}; }
+inline void resetViolationCounts() {}
+inline void setAbortOnViolation (bool) {}
+#endif
+
+/** Marks the calling thread as real-time for its lifetime; sections may be nested */
+class ScopedRealtimeSection
+{
+public:
+    ScopedRealtimeSection() { enterSection(); }
+    ~ScopedRealtimeSection() { exitSection(); }
+
+    ScopedRealtimeSection (const ScopedRealtimeSection&) = delete;
+    ScopedRealtimeSection& operator= (const ScopedRealtimeSection&) = delete;
+};
+
+} // namespace TriggeredAverage::RealtimeSafety
@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace TriggeredAverage
+{
+
+/**
+    Publishes immutable snapshots from a writer thread to a single real-time reader.
+
+    The writer (message thread) swaps in a new snapshot with publish(); the reader
+    (audio thread) pins the current snapshot with a ReadScope without locking or
+    allocating. Replaced snapshots are retired and only deleted after a grace period,
+    i.e. once the reader has either left its read scope or entered a newer one.
+*/
+template <typename T>
+class SnapshotPublisher
+{
+public:
+    SnapshotPublisher() = default;
+    ~SnapshotPublisher() { delete m_current.load(); }
+
+    SnapshotPublisher (const SnapshotPublisher&) = delete;
+    SnapshotPublisher& operator= (const SnapshotPublisher&) = delete;
+
+    /** Writer side: makes next visible to the reader and retires the previous snapshot */
+    void publish (std::unique_ptr<const T> next)
+    {
+        const T* previous = m_current.exchange (next.release());
+        const std::uint64_t retiredAtEpoch = m_epoch.fetch_add (1) + 1;
+
+        if (previous != nullptr)
+            m_retired.push_back ({ std::unique_ptr<const T> (previous), retiredAtEpoch });
+
+        collectGarbage();
+    }
+
+    /** Writer side: deletes retired snapshots the reader can no longer see */
+    void collectGarbage()
+    {
+        const std::uint64_t readerEpoch = m_readerEpoch.load();
+        std::erase_if (m_retired,
+                       [readerEpoch] (const Retired& r)
+                       { return readerEpoch == quiescent || readerEpoch >= r.retiredAtEpoch; });
+    }
+
+    /** Writer side: the most recently published snapshot */
+    const T* getLatest() const { return m_current.load(); }
+
+    size_t getNumRetired() const { return m_retired.size(); }
+
+    /** Reader side: pins the current snapshot for the lifetime of the scope.
+        Scopes must not be nested and only one thread may read at a time. */
+    class ReadScope
+    {
+    public:
+        explicit ReadScope (SnapshotPublisher& publisher_) : publisher (publisher_)
+        {
+            publisher.m_readerEpoch.store (publisher.m_epoch.load());
+            snapshot = publisher.m_current.load();
+        }
+        ~ReadScope() { publisher.m_readerEpoch.store (quiescent); }
+
+        ReadScope (const ReadScope&) = delete;
+        ReadScope& operator= (const ReadScope&) = delete;
+
+        const T* get() const { return snapshot; }
+        const T* operator->() const { return snapshot; }
+        explicit operator bool() const { return snapshot != nullptr; }
+
+    private:
+        SnapshotPublisher& publisher;
+        const T* snapshot = nullptr;
+    };
+
+private:
+    static constexpr std::uint64_t quiescent = 0;
+
+    struct Retired
+    {
+        std::unique_ptr<const T> snapshot;
+        std::uint64_t retiredAtEpoch;
+    };
+
+    std::atomic<const T*> m_current { nullptr };
+    std::atomic<std::uint64_t> m_epoch { 1 };
+    std::atomic<std::uint64_t> m_readerEpoch { quiescent };
+
+    // only touched by the writer
+    std::vector<Retired> m_retired;
+};
+
+} // namespace TriggeredAverage
@@ -0,0 +1,255 @@
+#include "SyntheticSource.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace TriggeredAverage
+{
+
+namespace
+{
+// prime, so that the noise does not repeat in step with periodic triggers
+constexpr int noiseTableSize = 1048573;
+constexpr double responseCutoffWidths = 4.0;
+
+float gaussianBump (double offset, double width)
+{
+    if (std::abs (offset) > responseCutoffWidths * width)
+        return 0.0f;
+    return static_cast<float> (std::exp (-0.5 * (offset / width) * (offset / width)));
+}
+} // namespace
+
+SyntheticSource::SyntheticSource (SyntheticSettings settings)
+    : m_settings (std::move (settings)),
+      m_dropRandom (m_settings.seed + 0x100000)
+{
+    const int numChannels = m_settings.numChannels;
+    juce::Random random (m_settings.seed);
+
+    m_noiseTable.resize (noiseTableSize);
+    for (auto& value : m_noiseTable)
+        value = static_cast<float> (nextGaussian (random));
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        m_channelNoiseOffsets.push_back (random.nextInt (noiseTableSize));
+        m_channelGains.push_back (0.5f + 0.5f * random.nextFloat());
+        m_channelDrifts.push_back ((2.0f * random.nextFloat() - 1.0f) * m_settings.maxDriftPerSecond
+                                   / static_cast<float> (m_settings.sampleRate));
+    }
+
+    for (size_t i = 0; i < m_settings.triggers.size(); ++i)
+    {
+        auto& triggerRandom = m_triggerRandoms.emplace_back (m_settings.seed + 0x200000
+                                                             + static_cast<juce::int64> (i));
+        m_nextTriggerSample.push_back (getTriggerInterval (m_settings.triggers[i], triggerRandom));
+    }
+}
+
+double SyntheticSource::getTriggerInterval (const SyntheticTrigger& trigger,
+                                            juce::Random& random) const
+{
+    const double meanInterval = m_settings.sampleRate / trigger.rateHz;
+    return trigger.poisson ? -std::log (1.0 - random.nextDouble()) * meanInterval : meanInterval;
+}
+
+double SyntheticSource::nextGaussian (juce::Random& random)
+{
+    // Box-Muller
+    const double u1 = 1.0 - random.nextDouble();
+    const double u2 = random.nextDouble();
+    return std::sqrt (-2.0 * std::log (u1)) * std::cos (juce::MathConstants<double>::twoPi * u2);
+}
+
+void SyntheticSource::scheduleTriggersUntil (SampleNumber endSample)
+{
+    const double samplesPerMs = m_settings.sampleRate / 1000.0;
+    bool scheduled = false;
+    for (size_t i = 0; i < m_settings.triggers.size(); ++i)
+    {
+        const auto& trigger = m_settings.triggers[i];
+        auto& random = m_triggerRandoms[i];
+        auto& next = m_nextTriggerSample[i];
+
+        while (next < static_cast<double> (endSample))
+        {
+            const auto onset = static_cast<SampleNumber> (next);
+            const double jitter = m_settings.jitterMs > 0.0
+                                      ? nextGaussian (random) * m_settings.jitterMs * samplesPerMs
+                                      : 0.0;
+            m_stimuli.push_back ({ onset, jitter, trigger.ttlLine });
+            m_pendingEvents.push_back ({ onset, trigger.ttlLine, true });
+            m_pendingEvents.push_back (
+                { onset + std::max<SampleNumber> (1, std::llround (trigger.pulseMs * samplesPerMs)),
+                  trigger.ttlLine,
+                  false });
+
+            next += getTriggerInterval (trigger, random);
+            scheduled = true;
+        }
+    }
+
+    if (scheduled)
+    {
+        std::stable_sort (m_pendingEvents.begin(),
+                          m_pendingEvents.end(),
+                          [] (const TtlEvent& a, const TtlEvent& b)
+                          { return a.sampleNumber < b.sampleNumber; });
+    }
+}
+
+SampleNumber SyntheticSource::nextBlock (juce::AudioBuffer<float>& buffer,
+                                         int numSamples,
+                                         std::vector<TtlEvent>& events)
+{
+    for (;;)
+    {
+        const SampleNumber firstSample = m_nextSample;
+        const SampleNumber endSample = firstSample + numSamples;
+        m_nextSample = endSample;
+        scheduleTriggersUntil (endSample);
+
+        const bool dropped = m_settings.dropBlockProbability > 0.0
+                             && m_dropRandom.nextDouble() < m_settings.dropBlockProbability;
+
+        const auto blockEnd =
+            std::find_if (m_pendingEvents.begin(),
+                          m_pendingEvents.end(),
+                          [endSample] (const TtlEvent& e) { return e.sampleNumber >= endSample; });
+        if (! dropped)
+            events.insert (events.end(), m_pendingEvents.begin(), blockEnd);
+        m_pendingEvents.erase (m_pendingEvents.begin(), blockEnd);
+
+        // responses that have ended before this block are no longer needed
+        double longestResponse = 0.0;
+        for (const auto& response : m_settings.responses)
+            longestResponse = std::max (longestResponse,
+                                        response.latencyMs
+                                            + responseCutoffWidths * response.widthMs);
+        const double longestResponseSamples = longestResponse * m_settings.sampleRate / 1000.0;
+        std::erase_if (m_stimuli,
+                       [&] (const Stimulus& stimulus)
+                       {
+                           return static_cast<double> (stimulus.onset) + stimulus.jitterSamples
+                                      + longestResponseSamples
+                                  < static_cast<double> (firstSample);
+                       });
+
+        if (dropped)
+        {
+            ++m_numDroppedBlocks;
+            continue;
+        }
+
+        generate (buffer, firstSample, numSamples);
+        return firstSample;
+    }
+}
+
+void SyntheticSource::generate (juce::AudioBuffer<float>& buffer,
+                                SampleNumber firstSample,
+                                int numSamples)
+{
+    const int numChannels = m_settings.numChannels;
+    buffer.setSize (numChannels, numSamples, false, false, true);
+    m_scratch.resize (static_cast<size_t> (numSamples));
+
+    const bool hasLineNoise = m_settings.lineNoiseAmplitude != 0.0f;
+    if (hasLineNoise)
+    {
+        const double phasePerSample =
+            juce::MathConstants<double>::twoPi * m_settings.lineNoiseHz / m_settings.sampleRate;
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const double phase = std::fmod (static_cast<double> (firstSample + i) * phasePerSample,
+                                            juce::MathConstants<double>::twoPi);
+            m_scratch[static_cast<size_t> (i)] =
+                m_settings.lineNoiseAmplitude * static_cast<float> (std::sin (phase));
+        }
+    }
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        float* out = buffer.getWritePointer (ch);
+
+        // noise, wrapping around the end of the table
+        int done = 0;
+        while (done < numSamples)
+        {
+            const auto offset = static_cast<int> (
+                (firstSample + done + m_channelNoiseOffsets[static_cast<size_t> (ch)])
+                % noiseTableSize);
+            const int count = std::min (numSamples - done, noiseTableSize - offset);
+            juce::FloatVectorOperations::copyWithMultiply (
+                out + done, m_noiseTable.data() + offset, m_settings.noiseRms, count);
+            done += count;
+        }
+
+        if (const float drift = m_channelDrifts[static_cast<size_t> (ch)]; drift != 0.0f)
+            for (int i = 0; i < numSamples; ++i)
+                out[i] += drift * static_cast<float> (firstSample + i);
+
+        if (hasLineNoise)
+            juce::FloatVectorOperations::add (out, m_scratch.data(), numSamples);
+    }
+
+    addResponses (buffer, firstSample, numSamples);
+}
+
+void SyntheticSource::addResponses (juce::AudioBuffer<float>& buffer,
+                                    SampleNumber firstSample,
+                                    int numSamples)
+{
+    const double samplesPerMs = m_settings.sampleRate / 1000.0;
+    for (const auto& stimulus : m_stimuli)
+    {
+        for (const auto& response : m_settings.responses)
+        {
+            if (response.ttlLine != stimulus.ttlLine)
+                continue;
+
+            const double centre = static_cast<double> (stimulus.onset) + stimulus.jitterSamples
+                                  + response.latencyMs * samplesPerMs;
+            const double width = response.widthMs * samplesPerMs;
+            const auto start = std::max<SampleNumber> (
+                firstSample,
+                static_cast<SampleNumber> (std::floor (centre - responseCutoffWidths * width)));
+            const auto end = std::min<SampleNumber> (
+                firstSample + numSamples,
+                static_cast<SampleNumber> (std::ceil (centre + responseCutoffWidths * width)) + 1);
+            if (start >= end)
+                continue;
+
+            const auto count = static_cast<int> (end - start);
+            for (int i = 0; i < count; ++i)
+                m_scratch[static_cast<size_t> (i)] =
+                    response.amplitude
+                    * gaussianBump (static_cast<double> (start + i) - centre, width);
+
+            for (int ch = 0; ch < m_settings.numChannels; ++ch)
+                juce::FloatVectorOperations::addWithMultiply (
+                    buffer.getWritePointer (ch, static_cast<int> (start - firstSample)),
+                    m_scratch.data(),
+                    m_channelGains[static_cast<size_t> (ch)],
+                    count);
+        }
+    }
+}
+
+float SyntheticSource::getExpectedResponse (int channel,
+                                            int ttlLine,
+                                            double secondsAfterTrigger) const
+{
+    float value = 0.0f;
+    for (const auto& response : m_settings.responses)
+    {
+        if (response.ttlLine == ttlLine)
+            value += response.amplitude
+                     * gaussianBump (secondsAfterTrigger * 1000.0 - response.latencyMs,
+                                     response.widthMs);
+    }
+    return m_channelGains[static_cast<size_t> (channel)] * value;
+}
+
+} // namespace TriggeredAverage
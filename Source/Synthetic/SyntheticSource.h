@@ -0,0 +1,113 @@
+#pragma once
+#include "MultiChannelRingBuffer.h"
+#include "Offline/BinaryRecording.h"
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_core/juce_core.h>
+#include <vector>
+
+namespace TriggeredAverage
+{
+
+/** TTL pulses on one line, either at a fixed interval or as a Poisson process */
+struct SyntheticTrigger
+{
+    int ttlLine = 0;
+    double rateHz = 1.0;
+    bool poisson = true;
+    double pulseMs = 1.0;
+};
+
+/** A Gaussian bump at a fixed latency after every pulse of a TTL line */
+struct SyntheticResponse
+{
+    int ttlLine = 0;
+    double latencyMs = 20.0;
+    double widthMs = 5.0;     // standard deviation, cut off at four
+    float amplitude = 100.0f; // scaled by a gain between 0.5 and 1 per channel
+};
+
+struct SyntheticSettings
+{
+    int numChannels = 64;
+    double sampleRate = 30000.0;
+    juce::int64 seed = 1;
+
+    float noiseRms = 10.0f;
+    float lineNoiseAmplitude = 0.0f;
+    double lineNoiseHz = 50.0;
+    float maxDriftPerSecond = 0.0f; // each channel drifts linearly at up to this rate
+
+    std::vector<SyntheticTrigger> triggers;
+    std::vector<SyntheticResponse> responses;
+
+    double jitterMs = 0.0;             // standard deviation of the response onsets
+    double dropBlockProbability = 0.0; // blocks lost between acquisition and the plugin
+};
+
+/**
+    Deterministic multichannel signal with matching TTL events, for tests and benchmarks that
+    need realistic, reproducible load without hardware.
+
+    The same settings and seed always produce the same output. Apart from which blocks are
+    dropped, the signal and events do not depend on the block sizes, and noise, each trigger
+    line and dropped blocks draw from separate generators, so enabling one feature does not
+    change the others. Noise is read from a precomputed Gaussian table, at an offset per
+    channel, so generating a block costs little more than copying it.
+
+    A dropped block is generated but not delivered: the next block's first sample number
+    skips it, and its TTL events are lost, as when the acquisition drops data.
+*/
+class SyntheticSource
+{
+public:
+    explicit SyntheticSource (SyntheticSettings settings);
+
+    /** Fills buffer with the next delivered block of numSamples samples, appends its TTL
+        events to events and returns the sample number of its first sample */
+    SampleNumber nextBlock (juce::AudioBuffer<float>& buffer,
+                            int numSamples,
+                            std::vector<TtlEvent>& events);
+
+    /** Value of the responses of a line at a time after its TTL, without noise or jitter */
+    float getExpectedResponse (int channel, int ttlLine, double secondsAfterTrigger) const;
+
+    const SyntheticSettings& getSettings() const { return m_settings; }
+    int getNumDroppedBlocks() const { return m_numDroppedBlocks; }
+
+private:
+    struct Stimulus
+    {
+        SampleNumber onset; // sample of the TTL
+        double jitterSamples;
+        int ttlLine;
+    };
+
+    double getTriggerInterval (const SyntheticTrigger&, juce::Random&) const;
+    void scheduleTriggersUntil (SampleNumber endSample);
+    void generate (juce::AudioBuffer<float>& buffer, SampleNumber firstSample, int numSamples);
+    void addResponses (juce::AudioBuffer<float>& buffer, SampleNumber firstSample, int numSamples);
+    static double nextGaussian (juce::Random&);
+
+    SyntheticSettings m_settings;
+    juce::Random m_dropRandom;
+
+    std::vector<float> m_noiseTable;
+    std::vector<int> m_channelNoiseOffsets;
+    std::vector<float> m_channelGains;
+    std::vector<float> m_channelDrifts; // per sample
+
+    // per entry of m_settings.triggers
+    std::vector<juce::Random> m_triggerRandoms;
+    std::vector<double> m_nextTriggerSample;
+
+    std::vector<TtlEvent> m_pendingEvents; // scheduled, in sample order
+    std::vector<Stimulus> m_stimuli;       // with responses that may still be in progress
+
+    std::vector<float> m_scratch; // one block of line noise or of a response
+
+    SampleNumber m_nextSample = 0;
+    int m_numDroppedBlocks = 0;
+};
+
+} // namespace TriggeredAverage
@@ -0,0 +1,225 @@
+#include "TimingZones.h"
+
+#if TRIGGERED_AVG_TIMING_ZONES
+
+    #include <algorithm>
+    #include <array>
+    #include <atomic>
+    #include <limits>
+    #include <map>
+    #include <memory>
+    #include <mutex>
+    #include <vector>
+
+namespace TriggeredAverage::TimingZones
+{
+namespace
+{
+    struct Zone
+    {
+        // atomic, because a dump may read a slot while its thread overwrites it
+        std::atomic<const char*> name { nullptr };
+        std::atomic<juce::int64> startTicks { 0 };
+        std::atomic<juce::int64> endTicks { 0 };
+    };
+
+    /** Zones of one thread. The thread announces a slot in numStarted before overwriting it,
+        so that a reader can tell which of the slots it copied may be torn. */
+    struct ThreadZones
+    {
+        std::array<Zone, zonesPerThread> zones;
+        std::atomic<juce::uint64> numStarted { 0 };
+        std::atomic<juce::uint64> numFinished { 0 };
+        std::atomic<bool> threadHasFinished { false };
+
+        // guarded by the registry
+        int threadIndex = 0;
+        juce::String threadName;
+    };
+
+    struct CopiedZone
+    {
+        const char* name;
+        juce::int64 startTicks;
+        juce::int64 endTicks;
+    };
+
+    struct CopiedThread
+    {
+        int threadIndex;
+        juce::String threadName;
+        std::vector<CopiedZone> zones;
+    };
+
+    class Registry
+    {
+    public:
+        ThreadZones* registerThread (const char* firstZone)
+        {
+            const std::scoped_lock lock (m_mutex);
+
+            // reuse the buffer of a finished thread, e.g. a collector of an earlier acquisition
+            ThreadZones* zones = nullptr;
+            for (auto& candidate : m_threads)
+            {
+                if (candidate->threadHasFinished.load())
+                {
+                    zones = candidate.get();
+                    break;
+                }
+            }
+            if (zones == nullptr)
+                zones = m_threads.emplace_back (std::make_unique<ThreadZones>()).get();
+
+            zones->numStarted.store (0);
+            zones->numFinished.store (0);
+            zones->threadHasFinished.store (false);
+            zones->threadIndex = ++m_numRegistered;
+
+            // threads that are not juce::Threads, such as the message thread, are named after
+            // the first zone they record
+            if (auto* thread = juce::Thread::getCurrentThread())
+                zones->threadName = thread->getThreadName();
+            else
+                zones->threadName = "Thread " + juce::String (zones->threadIndex) + " ("
+                                    + juce::String (firstZone) + ")";
+            return zones;
+        }
+
+        std::vector<CopiedThread> copyAll() const
+        {
+            const std::scoped_lock lock (m_mutex);
+
+            std::vector<CopiedThread> copies;
+            for (const auto& thread : m_threads)
+            {
+                auto& copy = copies.emplace_back (
+                    CopiedThread { thread->threadIndex, thread->threadName, {} });
+
+                const auto numFinished = thread->numFinished.load (std::memory_order_acquire);
+                const auto first = numFinished > zonesPerThread ? numFinished - zonesPerThread : 0;
+                for (auto i = first; i < numFinished; ++i)
+                {
+                    const auto& zone = thread->zones[i % zonesPerThread];
+                    copy.zones.push_back ({ zone.name.load (std::memory_order_relaxed),
+                                            zone.startTicks.load (std::memory_order_relaxed),
+                                            zone.endTicks.load (std::memory_order_relaxed) });
+                }
+
+                // drop the slots the thread has started to overwrite while we were copying
+                std::atomic_thread_fence (std::memory_order_acquire);
+                const auto numStarted = thread->numStarted.load (std::memory_order_relaxed);
+                const auto firstIntact =
+                    numStarted > zonesPerThread ? numStarted - zonesPerThread : 0;
+                if (firstIntact > first)
+                    copy.zones.erase (copy.zones.begin(),
+                                      copy.zones.begin()
+                                          + static_cast<std::ptrdiff_t> (
+                                              std::min (firstIntact, numFinished) - first));
+            }
+            return copies;
+        }
+
+    private:
+        mutable std::mutex m_mutex;
+        std::vector<std::unique_ptr<ThreadZones>> m_threads;
+        int m_numRegistered = 0;
+    };
+
+    Registry& getRegistry()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    struct ThreadHandle
+    {
+        ~ThreadHandle()
+        {
+            if (zones != nullptr)
+                zones->threadHasFinished.store (true);
+        }
+
+        ThreadZones* zones = nullptr;
+    };
+
+    thread_local ThreadHandle currentThread;
+
+    juce::String toJson (const juce::String& text)
+    {
+        return juce::JSON::toString (juce::var (text));
+    }
+} // namespace
+
+void registerCurrentThread (const char* name)
+{
+    auto*& zones = currentThread.zones;
+    if (zones == nullptr)
+        zones = getRegistry().registerThread (name);
+}
+
+void record (const char* name, juce::int64 startTicks, juce::int64 endTicks) noexcept
+{
+    registerCurrentThread (name);
+    auto* zones = currentThread.zones;
+
+    const auto index = zones->numFinished.load (std::memory_order_relaxed);
+    zones->numStarted.store (index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence (std::memory_order_release);
+
+    auto& zone = zones->zones[index % zonesPerThread];
+    zone.name.store (name, std::memory_order_relaxed);
+    zone.startTicks.store (startTicks, std::memory_order_relaxed);
+    zone.endTicks.store (endTicks, std::memory_order_relaxed);
+    zones->numFinished.store (index + 1, std::memory_order_release);
+}
+
+juce::Result writeChromeTrace (const juce::File& file)
+{
+    const auto threads = getRegistry().copyAll();
+
+    // timestamps start at the oldest zone that is still recorded
+    auto originTicks = std::numeric_limits<juce::int64>::max();
+    for (const auto& thread : threads)
+        for (const auto& zone : thread.zones)
+            originTicks = std::min (originTicks, zone.startTicks);
+    const double microsecondsPerTick =
+        1.0e6 / static_cast<double> (juce::Time::getHighResolutionTicksPerSecond());
+
+    file.deleteFile();
+    juce::FileOutputStream stream (file, 1 << 20);
+    if (stream.failedToOpen())
+        return juce::Result::fail ("Could not open " + file.getFullPathName());
+
+    stream << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    const char* separator = "\n";
+    std::map<const char*, juce::String> zoneNames;
+    for (const auto& thread : threads)
+    {
+        const juce::String tid (thread.threadIndex);
+        stream << separator << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+               << tid << ", \"args\": {\"name\": " << toJson (thread.threadName) << "}}";
+        separator = ",\n";
+
+        for (const auto& zone : thread.zones)
+        {
+            auto& zoneName = zoneNames[zone.name];
+            if (zoneName.isEmpty())
+                zoneName = toJson (zone.name);
+
+            const auto start = static_cast<double> (zone.startTicks - originTicks);
+            const auto duration = static_cast<double> (zone.endTicks - zone.startTicks);
+            stream << separator << "{\"name\": " << zoneName
+                   << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+                   << ", \"ts\": " << juce::String (start * microsecondsPerTick, 3)
+                   << ", \"dur\": " << juce::String (duration * microsecondsPerTick, 3) << "}";
+        }
+    }
+    stream << "\n]}\n";
+    stream.flush();
+    return stream.getStatus();
+}
+
+} // namespace TriggeredAverage::TimingZones
+
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+#include <juce_core/juce_core.h>
+
+/**
+    Scoped timing zones for looking at thread interleavings and stalls on a timeline.
+
+    TRIGGERED_AVG_TIMING_ZONE ("name") records when the enclosing scope was entered and left
+    into a ring buffer owned by the calling thread, so recording takes no lock. Each buffer
+    keeps the last zonesPerThread zones. writeChromeTrace() writes the zones of all threads
+    as Chrome trace JSON, which chrome://tracing and ui.perfetto.dev can open.
+
+    Zones are only compiled with TRIGGERED_AVG_TIMING_ZONES; otherwise the macro expands to
+    nothing. A thread's buffer is allocated by its first zone, so the audio thread allocates
+    once, in its first block, unless it called registerCurrentThread() before.
+*/
+namespace TriggeredAverage::TimingZones
+{
+
+#if TRIGGERED_AVG_TIMING_ZONES
+constexpr bool isEnabled = true;
+constexpr int zonesPerThread = 1 << 16;
+
+/** Adds a finished zone to the calling thread's buffer; name must outlive the program,
+    i.e. be a string literal */
+void record (const char* name, juce::int64 startTicks, juce::int64 endTicks) noexcept;
+
+/** Allocates the calling thread's buffer now instead of in its first zone, so that zones in a
+    following real-time section neither allocate nor lock. name is used like a first zone's. */
+void registerCurrentThread (const char* name);
+
+/** Writes the recorded zones of all threads, including threads that have finished */
+juce::Result writeChromeTrace (const juce::File& file);
+
+class ScopedZone
+{
+public:
+    explicit ScopedZone (const char* name) noexcept
+        : m_name (name),
+          m_startTicks (juce::Time::getHighResolutionTicks())
+    {
+    }
+    ~ScopedZone() { record (m_name, m_startTicks, juce::Time::getHighResolutionTicks()); }
+
+    ScopedZone (const ScopedZone&) = delete;
+    ScopedZone& operator= (const ScopedZone&) = delete;
+
+private:
+    const char* m_name;
+    juce::int64 m_startTicks;
+};
+
+    #define TRIGGERED_AVG_TIMING_ZONE(name)                                                    \
+        const TriggeredAverage::TimingZones::ScopedZone JUCE_JOIN_MACRO (timingZone_,           \
+                                                                         __LINE__) (name)
+#else
+constexpr bool isEnabled = false;
+
+inline void registerCurrentThread (const char*) {}
+
+inline juce::Result writeChromeTrace (const juce::File&)
+{
+    return juce::Result::fail ("Built without TRIGGERED_AVG_TIMING_ZONES");
+}
+
+    #define TRIGGERED_AVG_TIMING_ZONE(name)
+#endif
+
+} // namespace TriggeredAverage::TimingZones
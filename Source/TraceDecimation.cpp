@@ -0,0 +1,136 @@
+#include "TraceDecimation.h"
+
+namespace TriggeredAverage
+{
+
+void decimateMinMax (const float* data, int numSamples, std::span<MinMaxColumn> columns)
+{
+    const auto numColumns = static_cast<std::int64_t> (columns.size());
+    jassert (numColumns > 0 && numSamples >= numColumns);
+
+    int start = 0;
+    for (std::int64_t column = 0; column < numColumns; ++column)
+    {
+        const auto end = static_cast<int> ((column + 1) * numSamples / numColumns);
+        const auto range = juce::FloatVectorOperations::findMinAndMax (data + start, end - start);
+        columns[column] = { range.getStart(), range.getEnd() };
+        start = end;
+    }
+}
+
+void decimateMean (const float* data, int numSamples, std::span<float> columns)
+{
+    const auto numColumns = static_cast<std::int64_t> (columns.size());
+    jassert (numColumns > 0 && numSamples >= numColumns);
+
+    int start = 0;
+    for (std::int64_t column = 0; column < numColumns; ++column)
+    {
+        const auto end = static_cast<int> ((column + 1) * numSamples / numColumns);
+        float sum = 0.0f;
+        for (int i = start; i < end; ++i)
+            sum += data[i];
+        columns[column] = sum / static_cast<float> (end - start);
+        start = end;
+    }
+}
+
+juce::Range<float> getRange (std::span<const MinMaxColumn> columns)
+{
+    if (columns.empty())
+        return {};
+
+    float minVal = columns.front().min;
+    float maxVal = columns.front().max;
+    for (const auto& column : columns)
+    {
+        minVal = std::min (minVal, column.min);
+        maxVal = std::max (maxVal, column.max);
+    }
+    return { minVal, maxVal };
+}
+
+void MinMaxPyramid::build (const float* data, int numSamples)
+{
+    m_samples = { data, static_cast<size_t> (numSamples) };
+    m_levels.clear();
+
+    // level 0 pairs up samples, every further level pairs up the blocks of the one below
+    std::vector<MinMaxColumn> level ((m_samples.size() + 1) / 2);
+    for (size_t i = 0; i < level.size(); ++i)
+    {
+        const float first = m_samples[2 * i];
+        const float second = 2 * i + 1 < m_samples.size() ? m_samples[2 * i + 1] : first;
+        level[i] = { std::min (first, second), std::max (first, second) };
+    }
+
+    while (level.size() > 1)
+    {
+        std::vector<MinMaxColumn> next ((level.size() + 1) / 2);
+        for (size_t i = 0; i < next.size(); ++i)
+        {
+            const auto& first = level[2 * i];
+            const auto& second = 2 * i + 1 < level.size() ? level[2 * i + 1] : first;
+            next[i] = { std::min (first.min, second.min), std::max (first.max, second.max) };
+        }
+        m_levels.push_back (std::move (level));
+        level = std::move (next);
+    }
+
+    if (! level.empty())
+        m_levels.push_back (std::move (level));
+}
+
+MinMaxColumn MinMaxPyramid::getMinMax (int startSample, int endSample) const
+{
+    jassert (startSample >= 0 && startSample < endSample && endSample <= getNumSamples());
+
+    MinMaxColumn result { m_samples[startSample], m_samples[startSample] };
+    int position = startSample;
+    while (position < endSample)
+    {
+        // take the largest block that starts here and does not reach past the end
+        int level = -1;
+        while (level + 1 < getNumLevels())
+        {
+            const int blockSize = 2 << (level + 1);
+            if (position % blockSize != 0 || position + blockSize > endSample)
+                break;
+            ++level;
+        }
+
+        if (level < 0)
+        {
+            result.min = std::min (result.min, m_samples[position]);
+            result.max = std::max (result.max, m_samples[position]);
+            ++position;
+        }
+        else
+        {
+            const auto& block = m_levels[level][position >> (level + 1)];
+            result.min = std::min (result.min, block.min);
+            result.max = std::max (result.max, block.max);
+            position += 2 << level;
+        }
+    }
+    return result;
+}
+
+void MinMaxPyramid::decimate (int startSample,
+                              int numSamples,
+                              std::span<MinMaxColumn> columns) const
+{
+    const auto numColumns = static_cast<std::int64_t> (columns.size());
+    jassert (numColumns > 0 && numSamples >= numColumns);
+    jassert (startSample >= 0 && startSample + numSamples <= getNumSamples());
+
+    int start = 0;
+    for (std::int64_t column = 0; column < numColumns; ++column)
+    {
+        const auto end = static_cast<int> ((column + 1) * numSamples / numColumns);
+        columns[column] = getMinMax (startSample + start, startSample + end);
+        start = end;
+    }
+}
+
+} // namespace TriggeredAverage
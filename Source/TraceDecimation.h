@@ -0,0 +1,55 @@
+#pragma once
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <span>
+#include <vector>
+
+namespace TriggeredAverage
+{
+
+/** The extremes of all samples that fall into one horizontal pixel */
+struct MinMaxColumn
+{
+    float min = 0.0f;
+    float max = 0.0f;
+};
+
+/**
+ * Reduces a trace to one min/max pair per output column.
+ * Sample i is assigned to column floor(i * numColumns / numSamples), so every sample
+ * lands in exactly one column and peaks narrower than a pixel are preserved.
+ * Requires numSamples >= columns.size() > 0.
+ */
+void decimateMinMax (const float* data, int numSamples, std::span<MinMaxColumn> columns);
+
+/** Reduces a trace to the mean of each column, using the same column layout as decimateMinMax */
+void decimateMean (const float* data, int numSamples, std::span<float> columns);
+
+/** Overall range of already decimated columns */
+juce::Range<float> getRange (std::span<const MinMaxColumn> columns);
+
+/**
+ * Min/max mip pyramid of a trace. Level k holds the extremes of aligned blocks of 2^(k+1)
+ * samples, so the extremes of any sample range are found by combining O(log n) blocks, and
+ * a zoomed view of any part of the trace decimates in O(pixels * log(samples per pixel)).
+ */
+class MinMaxPyramid
+{
+public:
+    /** Indexes the trace without copying it; data must outlive the pyramid or the next build */
+    void build (const float* data, int numSamples);
+
+    /** Extremes of the samples in [startSample, endSample) */
+    MinMaxColumn getMinMax (int startSample, int endSample) const;
+
+    /** Same column layout as decimateMinMax, for the samples starting at startSample */
+    void decimate (int startSample, int numSamples, std::span<MinMaxColumn> columns) const;
+
+    int getNumSamples() const { return static_cast<int> (m_samples.size()); }
+    int getNumLevels() const { return static_cast<int> (m_levels.size()); }
+
+private:
+    std::span<const float> m_samples;
+    std::vector<std::vector<MinMaxColumn>> m_levels;
+};
+
+} // namespace TriggeredAverage
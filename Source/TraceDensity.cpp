@@ -0,0 +1,125 @@
+#include "TraceDensity.h"
+
+#include <atomic>
+
+namespace TriggeredAverage
+{
+
+namespace
+{
+// unique across instances, so a cached version never matches a recreated density
+std::uint64_t nextVersion()
+{
+    static std::atomic<std::uint64_t> counter { 0 };
+    return ++counter;
+}
+} // namespace
+
+TraceDensity::TraceDensity (int numChannels, int numColumns, int numRows)
+    : m_numChannels (numChannels),
+      m_numColumns (numColumns),
+      m_numRows (numRows),
+      m_counts (static_cast<size_t> (numChannels) * numColumns * numRows),
+      m_maxCounts (static_cast<size_t> (numChannels)),
+      m_limits (static_cast<size_t> (numChannels)),
+      m_columns (static_cast<size_t> (numColumns)),
+      m_rebinned (static_cast<size_t> (numColumns) * numRows),
+      m_version (nextVersion())
+{
+}
+
+void TraceDensity::addTrial (const juce::AudioBuffer<float>& trial)
+{
+    jassert (trial.getNumChannels() == m_numChannels);
+    if (trial.getNumSamples() < m_numColumns)
+        return;
+
+    for (int ch = 0; ch < m_numChannels; ++ch)
+    {
+        decimateMinMax (trial.getReadPointer (ch), trial.getNumSamples(), m_columns);
+
+        const auto range = getRange (m_columns);
+        const float required = std::max (std::abs (range.getStart()), std::abs (range.getEnd()));
+        if (required > m_limits[ch])
+            growRange (ch, required);
+
+        // each column covers the rows between its extremes, which keeps the trace connected
+        const float limit = m_limits[ch];
+        std::uint32_t* counts = m_counts.data() + getChannelOffset (ch);
+        std::uint32_t maxCount = m_maxCounts[ch];
+        for (int column = 0; column < m_numColumns; ++column)
+        {
+            const int firstRow = toRow (m_columns[column].max, limit);
+            const int lastRow = toRow (m_columns[column].min, limit);
+            for (int row = firstRow; row <= lastRow; ++row)
+                maxCount = std::max (maxCount, ++counts[row * m_numColumns + column]);
+        }
+        m_maxCounts[ch] = maxCount;
+    }
+
+    ++m_numTrials;
+    m_version = nextVersion();
+}
+
+void TraceDensity::clear()
+{
+    std::fill (m_counts.begin(), m_counts.end(), 0u);
+    std::fill (m_maxCounts.begin(), m_maxCounts.end(), 0u);
+    std::fill (m_limits.begin(), m_limits.end(), 0.0f);
+    m_numTrials = 0;
+    m_version = nextVersion();
+}
+
+const std::uint32_t* TraceDensity::getCounts (int channel) const
+{
+    return m_counts.data() + getChannelOffset (channel);
+}
+
+size_t TraceDensity::getChannelOffset (int channel) const
+{
+    return static_cast<size_t> (channel) * m_numColumns * m_numRows;
+}
+
+juce::Range<float> TraceDensity::getAmplitudeRange (int channel) const
+{
+    return { -m_limits[channel], m_limits[channel] };
+}
+
+int TraceDensity::toRow (float value, float limit) const
+{
+    const float position = (limit - value) / (2.0f * limit);
+    const auto row = static_cast<int> (position * static_cast<float> (m_numRows));
+    return juce::jlimit (0, m_numRows - 1, row);
+}
+
+void TraceDensity::growRange (int channel, float requiredLimit)
+{
+    float& limit = m_limits[channel];
+    if (limit <= 0.0f)
+    {
+        // first trial: leave headroom so that the next few trials fit
+        limit = requiredLimit > 1e-6f ? 1.5f * requiredLimit : 1.0f;
+        return;
+    }
+
+    const float oldLimit = limit;
+    while (limit < requiredLimit)
+        limit *= 2.0f;
+
+    // move every bin to the row that now contains its centre
+    std::uint32_t* counts = m_counts.data() + getChannelOffset (channel);
+    std::fill (m_rebinned.begin(), m_rebinned.end(), 0u);
+    const float rowHeight = 2.0f * oldLimit / static_cast<float> (m_numRows);
+    for (int row = 0; row < m_numRows; ++row)
+    {
+        const float centre = oldLimit - (static_cast<float> (row) + 0.5f) * rowHeight;
+        std::uint32_t* dest = m_rebinned.data() + toRow (centre, limit) * m_numColumns;
+        const std::uint32_t* source = counts + row * m_numColumns;
+        for (int column = 0; column < m_numColumns; ++column)
+            dest[column] += source[column];
+    }
+    std::copy (m_rebinned.begin(), m_rebinned.end(), counts);
+    m_maxCounts[channel] = *std::max_element (m_rebinned.begin(), m_rebinned.end());
+}
+
+} // namespace TriggeredAverage
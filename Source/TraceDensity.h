@@ -0,0 +1,65 @@
+#pragma once
+#include "TraceDecimation.h"
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <cstdint>
+#include <vector>
+
+namespace TriggeredAverage
+{
+
+/**
+    Two-dimensional histogram (time bins x amplitude bins) of all trials of one condition.
+
+    Each trial is rasterized into the counts once when it arrives, so drawing every trial
+    ever collected costs the same as drawing one. The amplitude range of each channel is
+    symmetric around zero and doubles when a trial does not fit, merging the existing bins.
+*/
+class TraceDensity
+{
+public:
+    TraceDensity (int numChannels, int numColumns, int numRows);
+
+    /** Adds one trial; the trial needs at least getNumColumns() samples */
+    void addTrial (const juce::AudioBuffer<float>& trial);
+
+    void clear();
+
+    /** Counts of one channel, row by row with the largest amplitude in row 0 */
+    const std::uint32_t* getCounts (int channel) const;
+    std::uint32_t getMaxCount (int channel) const { return m_maxCounts[channel]; }
+    juce::Range<float> getAmplitudeRange (int channel) const;
+
+    /** Changes with every update and differs between instances, so readers can cache what
+        they derived from the counts */
+    std::uint64_t getVersion() const { return m_version; }
+    int getNumTrials() const { return m_numTrials; }
+
+    int getNumChannels() const { return m_numChannels; }
+    int getNumColumns() const { return m_numColumns; }
+    int getNumRows() const { return m_numRows; }
+
+private:
+    size_t getChannelOffset (int channel) const;
+    int toRow (float value, float limit) const;
+    void growRange (int channel, float requiredLimit);
+
+    int m_numChannels;
+    int m_numColumns;
+    int m_numRows;
+
+    // [channel][row][column]
+    std::vector<std::uint32_t> m_counts;
+    std::vector<std::uint32_t> m_maxCounts;
+    // half width of each channel's amplitude range; 0 until the first trial
+    std::vector<float> m_limits;
+
+    // preallocated so that adding a trial does not allocate
+    std::vector<MinMaxColumn> m_columns;
+    std::vector<std::uint32_t> m_rebinned;
+
+    int m_numTrials = 0;
+    std::uint64_t m_version;
+};
+
+} // namespace TriggeredAverage
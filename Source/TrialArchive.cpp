@@ -0,0 +1,270 @@
+#include "TrialArchive.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace TriggeredAverage
+{
+
+namespace
+{
+void pushIndex (juce::AbstractFifo& fifo, std::vector<int>& slots, int index)
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite (1, start1, size1, start2, size2);
+    jassert (size1 == 1);
+    slots[static_cast<size_t> (start1)] = index;
+    fifo.finishedWrite (1);
+}
+
+int popIndex (juce::AbstractFifo& fifo, const std::vector<int>& slots)
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToRead (1, start1, size1, start2, size2);
+    if (size1 == 0)
+        return -1;
+
+    const int index = slots[static_cast<size_t> (start1)];
+    fifo.finishedRead (1);
+    return index;
+}
+} // namespace
+
+void TrialArchiveWriter::AlignedDelete::operator() (char* data) const
+{
+    ::operator delete[] (data, std::align_val_t { blockAlignment });
+}
+
+TrialArchiveWriter::TrialArchiveWriter (const juce::File& file,
+                                        size_t bufferBytes,
+                                        size_t blockBytes)
+    : juce::Thread ("TriggeredAvg: Trial archive"),
+      m_file (file),
+      m_blockBytes ((std::max<size_t> (blockBytes, 1) + blockAlignment - 1) / blockAlignment
+                    * blockAlignment),
+      m_filledFifo (1),
+      m_freeFifo (1)
+{
+    // a fifo holds one element less than its size
+    const auto numBlocks = std::max<size_t> (2, bufferBytes / m_blockBytes);
+    m_blocks.resize (numBlocks);
+    m_filledFifo.setTotalSize (static_cast<int> (numBlocks) + 1);
+    m_filledSlots.resize (numBlocks + 1);
+    m_freeFifo.setTotalSize (static_cast<int> (numBlocks) + 1);
+    m_freeSlots.resize (numBlocks + 1);
+    for (size_t i = 0; i < numBlocks; ++i)
+    {
+        m_blocks[i].data.reset (static_cast<char*> (
+            ::operator new[] (m_blockBytes, std::align_val_t { blockAlignment })));
+        pushIndex (m_freeFifo, m_freeSlots, static_cast<int> (i));
+    }
+
+    // unbuffered, as every block is written in one call
+    m_file.deleteFile();
+    m_stream = std::make_unique<juce::FileOutputStream> (m_file, 0);
+    if (m_stream->failedToOpen())
+    {
+        m_finished = true;
+        return;
+    }
+
+    TrialArchiveFileHeader header {};
+    std::memcpy (header.magic, TrialArchiveFileHeader::expectedMagic, sizeof (header.magic));
+    header.version = TrialArchiveFileHeader::currentVersion;
+    header.recordHeaderBytes = sizeof (TrialRecordHeader);
+    append (&header, sizeof (header));
+
+    startThread();
+}
+
+TrialArchiveWriter::~TrialArchiveWriter() { finish(); }
+
+size_t TrialArchiveWriter::getBufferBytesFor (int numChannels, int numSamples)
+{
+    const auto recordBytes = sizeof (TrialRecordHeader)
+                             + static_cast<size_t> (std::max (numChannels, 0))
+                                   * static_cast<size_t> (std::max (numSamples, 0))
+                                   * sizeof (float);
+    return std::max<size_t> (64 << 20, 4 * recordBytes);
+}
+
+juce::Result TrialArchiveWriter::getStatus() const
+{
+    if (m_stream->failedToOpen())
+        return juce::Result::fail ("Could not open " + m_file.getFullPathName());
+    if (m_writeFailed.load())
+        return juce::Result::fail ("Could not write " + m_file.getFullPathName());
+    return juce::Result::ok();
+}
+
+bool TrialArchiveWriter::addTrial (ConditionId id,
+                                   SampleNumber triggerSample,
+                                   int preSamples,
+                                   const juce::AudioBuffer<float>& trial)
+{
+    if (m_finished)
+        return false;
+
+    const auto channelBytes = static_cast<size_t> (trial.getNumSamples()) * sizeof (float);
+    const auto recordBytes =
+        sizeof (TrialRecordHeader) + channelBytes * static_cast<size_t> (trial.getNumChannels());
+    if (recordBytes > getFreeBytes())
+    {
+        ++m_numDroppedTrials;
+        m_droppedSinceLastTrial = true;
+        return false;
+    }
+
+    TrialRecordHeader header {};
+    header.conditionId = id;
+    header.flags =
+        m_droppedSinceLastTrial ? std::uint32_t (TrialRecordHeader::afterDroppedTrials) : 0u;
+    header.triggerSample = triggerSample;
+    header.preSamples = preSamples;
+    header.numChannels = trial.getNumChannels();
+    header.numSamples = trial.getNumSamples();
+    m_droppedSinceLastTrial = false;
+
+    append (&header, sizeof (header));
+    for (int ch = 0; ch < trial.getNumChannels(); ++ch)
+        append (trial.getReadPointer (ch), channelBytes);
+
+    ++m_numArchivedTrials;
+    return true;
+}
+
+void TrialArchiveWriter::finish()
+{
+    if (m_finished)
+        return;
+    m_finished = true;
+
+    if (m_currentBlock >= 0)
+    {
+        pushIndex (m_filledFifo, m_filledSlots, m_currentBlock);
+        m_currentBlock = -1;
+    }
+
+    // run() writes the remaining blocks before it returns
+    stopThread (-1);
+    m_stream->flush();
+}
+
+size_t TrialArchiveWriter::getFreeBytes() const
+{
+    const size_t inCurrentBlock =
+        m_currentBlock >= 0 ? m_blockBytes - m_blocks[static_cast<size_t> (m_currentBlock)].numBytes
+                            : 0;
+    return inCurrentBlock + static_cast<size_t> (m_freeFifo.getNumReady()) * m_blockBytes;
+}
+
+void TrialArchiveWriter::append (const void* data, size_t numBytes)
+{
+    const auto* bytes = static_cast<const char*> (data);
+    while (numBytes > 0)
+    {
+        if (m_currentBlock < 0)
+        {
+            // getFreeBytes() was checked for the whole record
+            m_currentBlock = popIndex (m_freeFifo, m_freeSlots);
+            jassert (m_currentBlock >= 0);
+            m_blocks[static_cast<size_t> (m_currentBlock)].numBytes = 0;
+        }
+
+        auto& block = m_blocks[static_cast<size_t> (m_currentBlock)];
+        const auto count = std::min (numBytes, m_blockBytes - block.numBytes);
+        std::memcpy (block.data.get() + block.numBytes, bytes, count);
+        block.numBytes += count;
+        bytes += count;
+        numBytes -= count;
+
+        if (block.numBytes == m_blockBytes)
+        {
+            pushIndex (m_filledFifo, m_filledSlots, m_currentBlock);
+            m_currentBlock = -1;
+            notify();
+        }
+    }
+}
+
+void TrialArchiveWriter::run()
+{
+    while (! threadShouldExit())
+    {
+        wait (100);
+        writeFilledBlocks();
+    }
+    writeFilledBlocks();
+}
+
+void TrialArchiveWriter::writeFilledBlocks()
+{
+    for (int index = popIndex (m_filledFifo, m_filledSlots); index >= 0;
+         index = popIndex (m_filledFifo, m_filledSlots))
+    {
+        // after a failed write the blocks are still recycled, so addTrial() keeps going
+        const auto& block = m_blocks[static_cast<size_t> (index)];
+        if (! m_writeFailed.load() && ! m_stream->write (block.data.get(), block.numBytes))
+            m_writeFailed.store (true);
+        pushIndex (m_freeFifo, m_freeSlots, index);
+    }
+}
+
+juce::Result TrialArchiveReader::open (const juce::File& file)
+{
+    m_recordOffsets.clear();
+    m_file = std::make_unique<juce::MemoryMappedFile> (file, juce::MemoryMappedFile::readOnly);
+    const auto* bytes = static_cast<const char*> (m_file->getData());
+    const size_t fileSize = m_file->getSize();
+
+    TrialArchiveFileHeader fileHeader;
+    if (bytes == nullptr || fileSize < sizeof (fileHeader))
+        return juce::Result::fail ("Not a trial archive: " + file.getFullPathName());
+    std::memcpy (&fileHeader, bytes, sizeof (fileHeader));
+    if (std::memcmp (fileHeader.magic, TrialArchiveFileHeader::expectedMagic, 8) != 0
+        || fileHeader.recordHeaderBytes != sizeof (TrialRecordHeader))
+        return juce::Result::fail ("Not a trial archive: " + file.getFullPathName());
+    if (fileHeader.version != TrialArchiveFileHeader::currentVersion)
+        return juce::Result::fail ("Unsupported trial archive version "
+                                   + juce::String (fileHeader.version) + ": "
+                                   + file.getFullPathName());
+
+    // a truncated last record, e.g. after a crash, is ignored
+    for (size_t offset = sizeof (fileHeader); offset + sizeof (TrialRecordHeader) <= fileSize;)
+    {
+        TrialRecordHeader header;
+        std::memcpy (&header, bytes + offset, sizeof (header));
+        if (header.numChannels < 0 || header.numSamples < 0)
+            return juce::Result::fail ("Corrupt trial record in " + file.getFullPathName());
+
+        const auto recordBytes = sizeof (header)
+                                 + static_cast<size_t> (header.numChannels)
+                                       * static_cast<size_t> (header.numSamples) * sizeof (float);
+        if (offset + recordBytes > fileSize)
+            break;
+
+        m_recordOffsets.push_back (offset);
+        offset += recordBytes;
+    }
+    return juce::Result::ok();
+}
+
+TrialRecordHeader TrialArchiveReader::getHeader (int trial) const
+{
+    TrialRecordHeader header;
+    const auto* bytes = static_cast<const char*> (m_file->getData());
+    std::memcpy (&header, bytes + m_recordOffsets[static_cast<size_t> (trial)], sizeof (header));
+    return header;
+}
+
+const float* TrialArchiveReader::getChannel (int trial, int channel) const
+{
+    const auto* bytes = static_cast<const char*> (m_file->getData());
+    const auto* samples = reinterpret_cast<const float*> (
+        bytes + m_recordOffsets[static_cast<size_t> (trial)] + sizeof (TrialRecordHeader));
+    const auto numSamples = static_cast<size_t> (getHeader (trial).numSamples);
+    return samples + static_cast<size_t> (channel) * numSamples;
+}
+
+} // namespace TriggeredAverage
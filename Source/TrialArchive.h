@@ -0,0 +1,150 @@
+#pragma once
+#include "ConditionId.h"
+#include "MultiChannelRingBuffer.h"
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace TriggeredAverage
+{
+
+/**
+    Archive file layout, all little-endian: a TrialArchiveFileHeader, followed by one record
+    per trial, each a TrialRecordHeader and the snippet as float32 [channels][samples].
+*/
+struct TrialArchiveFileHeader
+{
+    static constexpr char expectedMagic[8] = { 'T', 'A', 'V', 'G', 'T', 'R', 'L', 'S' };
+    static constexpr std::uint32_t currentVersion = 1;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t recordHeaderBytes;
+};
+static_assert (sizeof (TrialArchiveFileHeader) == 16);
+
+struct TrialRecordHeader
+{
+    enum Flags : std::uint32_t
+    {
+        // trials were dropped before this one because the disk could not keep up
+        afterDroppedTrials = 1 << 0,
+    };
+
+    std::uint32_t conditionId;
+    std::uint32_t flags;
+    std::int64_t triggerSample;
+    std::int32_t preSamples;
+    std::int32_t numChannels;
+    std::int32_t numSamples;
+    std::uint32_t reserved;
+};
+static_assert (sizeof (TrialRecordHeader) == 32);
+
+/**
+    Appends every trial it is given to an archive file for later re-analysis.
+
+    addTrial() only copies the trial into preallocated blocks; a dedicated thread writes full
+    blocks to the file, so each write is large, block-aligned in memory and in the file. While
+    one block is written the next one is filled. If the disk falls so far behind that a trial
+    does not fit into the free blocks, the trial is dropped and counted instead of waiting,
+    and the next archived trial is flagged with afterDroppedTrials.
+
+    There may only be one thread calling addTrial() and finish(), e.g. the data collector.
+*/
+class TrialArchiveWriter : private juce::Thread
+{
+public:
+    static constexpr int blockAlignment = 4096;
+
+    /** bufferBytes is divided into blocks of blockBytes (rounded up to blockAlignment); a
+        trial larger than the whole buffer is never archived */
+    TrialArchiveWriter (const juce::File& file,
+                        size_t bufferBytes = 64 << 20,
+                        size_t blockBytes = 4 << 20);
+    ~TrialArchiveWriter() override;
+
+    /** A buffer size that holds at least four trials of this size, so that single slow
+        writes do not drop trials */
+    static size_t getBufferBytesFor (int numChannels, int numSamples);
+
+    /** Fails if the file could not be opened; no trials are archived then */
+    juce::Result getStatus() const;
+    const juce::File& getFile() const { return m_file; }
+
+    /** Queues the trial, with the trigger at preSamples, for writing. Never blocks; returns
+        false if the trial was dropped. */
+    bool addTrial (ConditionId id,
+                   SampleNumber triggerSample,
+                   int preSamples,
+                   const juce::AudioBuffer<float>& trial);
+
+    /** Writes the partially filled block and waits until everything is on disk. No trials
+        can be added afterwards. Called by the destructor. */
+    void finish();
+
+    int getNumArchivedTrials() const { return m_numArchivedTrials.load(); }
+    int getNumDroppedTrials() const { return m_numDroppedTrials.load(); }
+
+private:
+    struct AlignedDelete
+    {
+        void operator() (char* data) const;
+    };
+
+    struct Block
+    {
+        std::unique_ptr<char[], AlignedDelete> data;
+        size_t numBytes = 0;
+    };
+
+    void run() override;
+    void writeFilledBlocks();
+    void append (const void* data, size_t numBytes);
+    size_t getFreeBytes() const;
+
+    juce::File m_file;
+    std::unique_ptr<juce::FileOutputStream> m_stream;
+    size_t m_blockBytes;
+    std::vector<Block> m_blocks;
+
+    // indices of blocks, passed between the writing thread and the I/O thread
+    juce::AbstractFifo m_filledFifo;
+    std::vector<int> m_filledSlots;
+    juce::AbstractFifo m_freeFifo;
+    std::vector<int> m_freeSlots;
+
+    // writing thread only
+    int m_currentBlock = -1;
+    bool m_droppedSinceLastTrial = false;
+    bool m_finished = false;
+
+    std::atomic<int> m_numArchivedTrials { 0 };
+    std::atomic<int> m_numDroppedTrials { 0 };
+    std::atomic<bool> m_writeFailed { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TrialArchiveWriter)
+};
+
+/** Memory-mapped, read-only view of an archive written by TrialArchiveWriter */
+class TrialArchiveReader
+{
+public:
+    juce::Result open (const juce::File& file);
+
+    int getNumTrials() const { return static_cast<int> (m_recordOffsets.size()); }
+    TrialRecordHeader getHeader (int trial) const;
+
+    /** Samples of one channel of a trial */
+    const float* getChannel (int trial, int channel) const;
+
+private:
+    std::unique_ptr<juce::MemoryMappedFile> m_file;
+    // records are only 4-byte aligned, so headers are copied out rather than referenced
+    std::vector<size_t> m_recordOffsets;
+};
+
+} // namespace TriggeredAverage
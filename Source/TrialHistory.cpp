@@ -0,0 +1,65 @@
+#include "TrialHistory.h"
+#include "TraceDecimation.h"
+
+#include <atomic>
+
+namespace TriggeredAverage
+{
+
+namespace
+{
+// unique across instances, so a reader can't mistake a new history at a reused address
+std::uint64_t nextGeneration()
+{
+    static std::atomic<std::uint64_t> counter { 0 };
+    return ++counter;
+}
+} // namespace
+
+TrialHistory::TrialHistory (int numChannels, int numColumns, int capacity)
+    : m_numChannels (numChannels),
+      m_numColumns (numColumns),
+      m_capacity (capacity),
+      m_data (static_cast<size_t> (numChannels) * numColumns * capacity),
+      m_generation (nextGeneration())
+{
+}
+
+void TrialHistory::addTrial (const juce::AudioBuffer<float>& trial)
+{
+    jassert (trial.getNumChannels() == m_numChannels);
+    if (trial.getNumSamples() < m_numColumns)
+        return;
+
+    const auto slot =
+        static_cast<size_t> (m_numTrialsAdded % static_cast<std::uint64_t> (m_capacity));
+    for (int ch = 0; ch < m_numChannels; ++ch)
+    {
+        float* dest = m_data.data() + (slot * m_numChannels + ch) * m_numColumns;
+        decimateMean (trial.getReadPointer (ch),
+                      trial.getNumSamples(),
+                      std::span<float> (dest, static_cast<size_t> (m_numColumns)));
+    }
+    ++m_numTrialsAdded;
+}
+
+void TrialHistory::clear()
+{
+    m_numTrialsAdded = 0;
+    m_generation = nextGeneration();
+}
+
+std::uint64_t TrialHistory::getFirstStoredTrial() const
+{
+    const auto capacity = static_cast<std::uint64_t> (m_capacity);
+    return m_numTrialsAdded > capacity ? m_numTrialsAdded - capacity : 0;
+}
+
+const float* TrialHistory::getTrial (int channel, std::uint64_t trialIndex) const
+{
+    jassert (trialIndex >= getFirstStoredTrial() && trialIndex < m_numTrialsAdded);
+    const auto slot = static_cast<size_t> (trialIndex % static_cast<std::uint64_t> (m_capacity));
+    return m_data.data() + (slot * m_numChannels + channel) * m_numColumns;
+}
+
+} // namespace TriggeredAverage
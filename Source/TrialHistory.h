@@ -0,0 +1,53 @@
+#pragma once
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <cstdint>
+#include <vector>
+
+namespace TriggeredAverage
+{
+
+/**
+    The most recent single trials of one condition, for trial-by-trial displays.
+
+    Every trial is reduced to a fixed number of time columns per channel and written into a
+    preallocated circular buffer, so adding a trial never allocates. Trials are addressed by
+    their running index, which keeps increasing as old trials are overwritten.
+*/
+class TrialHistory
+{
+public:
+    TrialHistory (int numChannels, int numColumns, int capacity);
+
+    /** Decimates each channel of the trial into columns and stores it as the newest trial */
+    void addTrial (const juce::AudioBuffer<float>& trial);
+
+    /** Drops all stored trials, e.g. when the window changed */
+    void clear();
+
+    /** Running index of the next trial; the stored trials are [getFirstStoredTrial(), this) */
+    std::uint64_t getNumTrialsAdded() const { return m_numTrialsAdded; }
+    std::uint64_t getFirstStoredTrial() const;
+
+    /** Columns of one channel of a stored trial */
+    const float* getTrial (int channel, std::uint64_t trialIndex) const;
+
+    /** Changes on clear() and differs between instances, so readers know when their
+        incremental state is invalid */
+    std::uint64_t getGeneration() const { return m_generation; }
+
+    int getNumChannels() const { return m_numChannels; }
+    int getNumColumns() const { return m_numColumns; }
+    int getCapacity() const { return m_capacity; }
+
+private:
+    int m_numChannels;
+    int m_numColumns;
+    int m_capacity;
+
+    // [slot][channel][column]
+    std::vector<float> m_data;
+    std::uint64_t m_numTrialsAdded = 0;
+    std::uint64_t m_generation;
+};
+
+} // namespace TriggeredAverage
@@ -0,0 +1,107 @@
+#include "TriggerDispatchTable.h"
+
+using namespace TriggeredAverage;
+
+namespace
+{
+int getSlotForLine (int line)
+{
+    if (line == TriggerDispatchTable::anyLine)
+        return TriggerDispatchTable::numTtlLines;
+    if (line < 0 || line >= TriggerDispatchTable::numTtlLines)
+        return -1;
+    return line;
+}
+
+bool canBeTriggeredByTtl (TriggerType type)
+{
+    return type == TriggerType::TTL_TRIGGER || type == TriggerType::TTL_AND_MSG_TRIGGER;
+}
+} // namespace
+
+TriggerDispatchTable::TriggerDispatchTable (const juce::Array<TriggerSource*>& sources,
+                                            int preSamples,
+                                            int postSamples,
+                                            const TriggerDispatchTable* previous)
+    : m_armed (std::make_unique<std::atomic<bool>[]> (static_cast<size_t> (sources.size()))),
+      m_preSamples (preSamples),
+      m_postSamples (postSamples)
+{
+    m_sources.reserve (static_cast<size_t> (sources.size()));
+    for (auto* source : sources)
+    {
+        const int sourceIndex = static_cast<int> (m_sources.size());
+        m_sources.push_back (TriggerSourceSnapshot { .id = source->id,
+                                                     .name = source->name,
+                                                     .line = source->line,
+                                                     .type = source->type });
+
+        bool armed = source->canTrigger;
+        if (previous != nullptr && source->type == TriggerType::TTL_AND_MSG_TRIGGER)
+        {
+            const auto& previousSources = previous->getSources();
+            for (size_t i = 0; i < previousSources.size(); ++i)
+            {
+                if (previousSources[i].id == source->id
+                    && previousSources[i].type == TriggerType::TTL_AND_MSG_TRIGGER)
+                {
+                    armed = previous->isArmed (static_cast<int> (i));
+                    break;
+                }
+            }
+        }
+        m_armed[sourceIndex].store (armed);
+    }
+
+    // count entries per slot, then turn counts into offsets
+    std::array<std::uint32_t, numSlots> counts {};
+    for (const auto& source : m_sources)
+    {
+        const int slot = getSlotForLine (source.line);
+        if (slot >= 0 && canBeTriggeredByTtl (source.type))
+            ++counts[slot];
+    }
+
+    m_slotOffsets[0] = 0;
+    for (int slot = 0; slot < numSlots; ++slot)
+        m_slotOffsets[slot + 1] = m_slotOffsets[slot] + counts[slot];
+
+    // fill in source order so that dispatch order matches the order in the editor
+    m_entries.resize (m_slotOffsets[numSlots]);
+    std::array<std::uint32_t, numSlots> fillIndex {};
+    std::copy (m_slotOffsets.begin(), m_slotOffsets.end() - 1, fillIndex.begin());
+
+    for (size_t sourceIndex = 0; sourceIndex < m_sources.size(); ++sourceIndex)
+    {
+        const auto& source = m_sources[sourceIndex];
+        const int slot = getSlotForLine (source.line);
+        if (slot < 0 || ! canBeTriggeredByTtl (source.type))
+            continue;
+
+        m_entries[fillIndex[slot]++] =
+            TriggerDispatchEntry { .sourceIndex = static_cast<int> (sourceIndex),
+                                   .preSamples = preSamples,
+                                   .postSamples = postSamples };
+    }
+}
+
+std::span<const TriggerDispatchEntry> TriggerDispatchTable::getEntriesForLine (int line) const
+{
+    if (line < 0 || line >= numTtlLines)
+        return {};
+    return getEntriesForSlot (line);
+}
+
+std::span<const TriggerDispatchEntry> TriggerDispatchTable::getEntriesForSlot (int slot) const
+{
+    const auto begin = m_slotOffsets[slot];
+    const auto end = m_slotOffsets[slot + 1];
+    return { m_entries.data() + begin, end - begin };
+}
+
+bool TriggerDispatchTable::tryTrigger (int sourceIndex) const
+{
+    if (m_sources[sourceIndex].type == TriggerType::TTL_AND_MSG_TRIGGER)
+        return m_armed[sourceIndex].exchange (false);
+    return m_armed[sourceIndex].load();
+}
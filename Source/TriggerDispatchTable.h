@@ -0,0 +1,92 @@
+#pragma once
+#include "TriggerSource.h"
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace TriggeredAverage
+{
+
+/** Copy of the trigger source fields the audio thread needs */
+struct TriggerSourceSnapshot
+{
+    ConditionId id;
+    juce::String name;
+    int line;
+    TriggerType type;
+};
+
+struct TriggerDispatchEntry
+{
+    int sourceIndex;
+    int preSamples;
+    int postSamples;
+};
+
+/**
+    Immutable snapshot of the trigger configuration as seen by the audio thread.
+
+    Built on the message thread whenever the trigger sources or the window parameters
+    change and published through a SnapshotPublisher, so the audio thread reads it
+    without allocating or taking locks. Entries are stored contiguously per TTL line
+    (CSR layout), so a lookup is a pair of array reads.
+
+    The only mutable state is whether a TTL_AND_MSG_TRIGGER source is armed; it is
+    atomic and carried over from the previous snapshot by condition id.
+*/
+class TriggerDispatchTable
+{
+public:
+    static constexpr int numTtlLines = 256;
+    static constexpr int anyLine = -1;
+
+    TriggerDispatchTable (const juce::Array<TriggerSource*>& sources,
+                          int preSamples,
+                          int postSamples,
+                          const TriggerDispatchTable* previous = nullptr);
+
+    /** Sources listening on exactly this line (does not include the "any line" sources) */
+    std::span<const TriggerDispatchEntry> getEntriesForLine (int line) const;
+
+    /** Sources that trigger on any TTL line */
+    std::span<const TriggerDispatchEntry> getEntriesForAnyLine() const
+    {
+        return getEntriesForSlot (anyLineSlot);
+    }
+
+    const std::vector<TriggerSourceSnapshot>& getSources() const { return m_sources; }
+    const TriggerSourceSnapshot& getSource (int sourceIndex) const { return m_sources[sourceIndex]; }
+
+    /** Returns true if the source may fire now, disarming TTL_AND_MSG sources */
+    bool tryTrigger (int sourceIndex) const;
+
+    /** Arms a TTL_AND_MSG source so that it fires on its next TTL event */
+    void arm (int sourceIndex) const { m_armed[sourceIndex].store (true); }
+    bool isArmed (int sourceIndex) const { return m_armed[sourceIndex].load(); }
+
+    int getPreSamples() const { return m_preSamples; }
+    int getPostSamples() const { return m_postSamples; }
+
+private:
+    static constexpr int anyLineSlot = numTtlLines;
+    static constexpr int numSlots = numTtlLines + 1;
+
+    std::span<const TriggerDispatchEntry> getEntriesForSlot (int slot) const;
+
+    std::vector<TriggerSourceSnapshot> m_sources;
+    std::unique_ptr<std::atomic<bool>[]> m_armed;
+
+    std::vector<TriggerDispatchEntry> m_entries;
+    std::array<std::uint32_t, numSlots + 1> m_slotOffsets {};
+    int m_preSamples;
+    int m_postSamples;
+
+    JUCE_DECLARE_NON_COPYABLE (TriggerDispatchTable)
+};
+
+} // namespace TriggeredAverage
@@ -9,8 +9,10 @@ using namespace TriggeredAverage;
 TriggeredAverage::TriggerSource::TriggerSource (TriggeredAvgNode* processor_,
                                                 const juce::String& name_,
                                                 int line_,
-                                                TriggerType type_)
-    : name (name_),
+                                                TriggerType type_,
+                                                ConditionId id_)
+    : id (id_),
+      name (name_),
       line (line_),
       type (type_),
       processor (processor_)
@@ -47,12 +49,30 @@ TriggerSource* TriggerSources::getByIndex (int index) const
     return m_triggerSources[index];
 }
 
-TriggerSource* TriggerSources::addTriggerSource (int line, TriggerType type, int index)
+TriggerSource* TriggerSources::getById (ConditionId id) const
+{
+    for (auto* source : m_triggerSources)
+    {
+        if (source->id == id)
+            return source;
+    }
+    return nullptr;
+}
+
+TriggerSource* TriggerSources::addTriggerSource (int line,
+                                                 TriggerType type,
+                                                 int index,
+                                                 ConditionId id,
+                                                 const String& savedName)
 {
     String name = "Condition " + String (m_nextConditionIndex++);
-    name = ensureUniqueTriggerSourceName (name);
+    name = savedName.isNotEmpty() ? savedName : ensureUniqueTriggerSourceName (name);
+
+    if (id == invalidConditionId || getById (id) != nullptr)
+        id = m_nextConditionId;
+    m_nextConditionId = std::max (m_nextConditionId, id + 1);
 
-    TriggerSource* source = new TriggerSource (m_parentProcessor, name, line, type);
+    TriggerSource* source = new TriggerSource (m_parentProcessor, name, line, type, id);
 
     if (index == -1)
         m_triggerSources.add (source);
@@ -62,6 +82,7 @@ TriggerSource* TriggerSources::addTriggerSource (int line, TriggerType type, int
     m_currentTriggerSource = source;
     m_parentProcessor->getParameter (ParameterNames::trigger_type)
         ->setNextValue ((int) type, false);
+    notifyProcessor();
 
     return source;
 }
@@ -72,17 +93,24 @@ void TriggerSources::removeTriggerSources (Array<TriggerSource*> sources)
     {
         m_triggerSources.removeObject (source);
     }
+    notifyProcessor();
 }
 
 void TriggerSources::removeTriggerSource (int indexToRemove)
 {
     if (indexToRemove >= 0 && indexToRemove < m_triggerSources.size())
     {
-        TriggerSource* source = m_triggerSources[indexToRemove];
         m_triggerSources.remove (indexToRemove);
+        notifyProcessor();
     }
 }
 
+void TriggerSources::clear()
+{
+    m_triggerSources.clear();
+    notifyProcessor();
+}
+
 String TriggerSources::ensureUniqueTriggerSourceName (String name)
 {
     Array<String> existingNames;
@@ -102,6 +130,8 @@ String TriggerSources::ensureUniqueTriggerSourceName (String name)
 void TriggerSources::setTriggerSourceName (TriggerSource* source, String name, bool updateEditor)
 {
     source->name = ensureUniqueTriggerSourceName (name);
+    // broadcast messages are matched against the name in the audio thread's view
+    notifyProcessor();
 
     if (auto* editor = dynamic_cast<TriggeredAvgEditor*> (m_parentProcessor->getEditor());
         updateEditor && editor)
@@ -114,6 +144,7 @@ void TriggerSources::setTriggerSourceLine (TriggerSource* source, int line, bool
 {
     source->line = line;
     source->colour = TriggerSource::getColourForLine (line);
+    notifyProcessor();
     if (m_parentProcessor && updateEditor)
     {
         m_parentProcessor->getParameter (ParameterNames::trigger_line)->setNextValue (line, false);
@@ -142,7 +173,14 @@ void TriggerSources::setTriggerSourceTriggerType (TriggerSource* source,
         source->canTrigger = true;
     else
         source->canTrigger = false;
+    notifyProcessor();
     if (m_parentProcessor && updateEditor)
         m_parentProcessor->getParameter (ParameterNames::trigger_type)
             ->setNextValue ((int) type, false);
-}
\ No newline at end of file
+}
+
+void TriggerSources::notifyProcessor() const
+{
+    if (m_parentProcessor)
+        m_parentProcessor->updateTriggerConfiguration();
+}
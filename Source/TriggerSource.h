@@ -1,4 +1,6 @@
 #pragma once
+#include "ConditionId.h"
+
 #include <JuceHeader.h>
 #include <cstdint>
 namespace TriggeredAverage
@@ -31,10 +33,12 @@ public:
     TriggerSource (TriggeredAvgNode* processor_,
                    const juce::String& name_,
                    int line_,
-                   TriggerType type_);
+                   TriggerType type_,
+                   ConditionId id_);
 
     static juce::Colour getColourForLine (int line);
 
+    const ConditionId id;
     juce::String name;
     int line;
     TriggerType type;
@@ -54,6 +58,7 @@ public:
         m_parentProcessor = std::move (other.m_parentProcessor);
         m_triggerSources = std::move (other.m_triggerSources);
         m_nextConditionIndex = other.m_nextConditionIndex;
+        m_nextConditionId = other.m_nextConditionId;
         m_currentTriggerSource = other.m_currentTriggerSource;
     }
     TriggerSources& operator= (const TriggerSources&) = delete;
@@ -64,6 +69,7 @@ public:
             m_parentProcessor = std::move (other.m_parentProcessor);
             m_triggerSources = std::move (other.m_triggerSources);
             m_nextConditionIndex = other.m_nextConditionIndex;
+            m_nextConditionId = other.m_nextConditionId;
             m_currentTriggerSource = other.m_currentTriggerSource;
         }
         return *this;
@@ -72,8 +78,15 @@ public:
 
     juce::Array<TriggerSource*> getAll();
     TriggerSource* getByIndex (int index) const;
+    TriggerSource* getById (ConditionId id) const;
     int getIndexOf (const TriggerSource* source) const { return m_triggerSources.indexOf (source); }
-    TriggerSource* addTriggerSource (int line, TriggerType type, int index = -1);
+    // a new id is assigned unless a previously used one is passed in (e.g. on undo); likewise
+    // a saved name is used as is instead of a generated one
+    TriggerSource* addTriggerSource (int line,
+                                     TriggerType type,
+                                     int index = -1,
+                                     ConditionId id = invalidConditionId,
+                                     const String& savedName = {});
     TriggerSource* getLastAddedTriggerSource() const { return m_currentTriggerSource; }
     void removeTriggerSources (Array<TriggerSource*> sources);
     void removeTriggerSource (int indexToRemove);
@@ -86,16 +99,20 @@ public:
                                       bool updateEditor = true);
     String ensureUniqueTriggerSourceName (String name);
     int getNextConditionIndex() const { return m_nextConditionIndex; }
-    void clear() { m_triggerSources.clear(); }
+    void clear();
     size_t size() const { return m_triggerSources.size(); }
 
 private:
+    // republishes the processor's audio-thread view of the trigger sources
+    void notifyProcessor() const;
+
     // dependencies
     TriggeredAvgNode* m_parentProcessor = nullptr;
 
     // data
     OwnedArray<TriggerSource> m_triggerSources;
     int m_nextConditionIndex = 1;
+    ConditionId m_nextConditionId = 1;
     TriggerSource* m_currentTriggerSource = nullptr;
 };
 
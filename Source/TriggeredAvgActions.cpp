@@ -16,6 +16,7 @@ AddTriggerConditions::AddTriggerConditions (TriggeredAverage::TriggeredAvgNode*
     triggerSources.clear();
     triggerNames.clear();
     triggerIndices.insertMultiple (0, -1, triggerLines.size());
+    triggerIds.insertMultiple (0, invalidConditionId, triggerLines.size());
 }
 
 AddTriggerConditions::~AddTriggerConditions() = default;
@@ -28,10 +29,11 @@ void AddTriggerConditions::restoreOwner (GenericProcessor* owner)
 
 bool AddTriggerConditions::perform()
 {
+    // on redo the names from the first perform() are restored
     for (int i = 0; i < triggerLines.size(); i++)
     {
         TriggerSource* source = processorNode->getTriggerSources().addTriggerSource (
-            triggerLines[i], type, triggerIndices[i]);
+            triggerLines[i], type, triggerIndices[i], triggerIds[i], triggerNames[i]);
         triggerSources.add (source);
     }
 
@@ -42,13 +44,7 @@ bool AddTriggerConditions::perform()
         {
             triggerNames.add (triggerSources[i]->name);
             triggerIndices.set (i, allSources.indexOf (triggerSources[i]));
-        }
-    }
-    else
-    {
-        for (int i = 0; i < triggerSources.size(); i++)
-        {
-            triggerSources[i]->name = triggerNames[i];
+            triggerIds.set (i, triggerSources[i]->id);
         }
     }
 
@@ -89,6 +85,7 @@ RemoveTriggerConditions::RemoveTriggerConditions (TriggeredAvgNode* processor_,
     for (auto source : triggerSourcesToRemove)
     {
         XmlElement* sourceXml = settings->createNewChildElement ("SOURCE");
+        sourceXml->setAttribute ("id", static_cast<int> (source->id));
         sourceXml->setAttribute ("name", source->name);
         sourceXml->setAttribute ("line", source->line);
         sourceXml->setAttribute ("type", static_cast<int> (source->type));
@@ -136,12 +133,11 @@ bool RemoveTriggerConditions::undo()
             sourceXml->getIntAttribute ("type", static_cast<int> (TriggerType::TTL_TRIGGER));
         String savedColour = sourceXml->getStringAttribute ("colour", "");
         int savedIndex = sourceXml->getIntAttribute ("index", -1);
+        auto savedId = static_cast<ConditionId> (
+            sourceXml->getIntAttribute ("id", static_cast<int> (invalidConditionId)));
 
         TriggerSource* source = processorNode->getTriggerSources().addTriggerSource (
-            savedLine, (TriggerType) savedType, savedIndex);
-
-        if (savedName.isNotEmpty())
-            source->name = savedName;
+            savedLine, (TriggerType) savedType, savedIndex, savedId, savedName);
 
         if (savedColour.length() > 0)
             source->colour = Colour::fromString (savedColour);
@@ -60,6 +60,7 @@ private:
     Array<TriggerSource*> triggerSources;
     StringArray triggerNames;
     Array<int> triggerIndices;
+    Array<ConditionId> triggerIds;
 };
 
 class RemoveTriggerConditions : public ProcessorAction
@@ -25,6 +25,9 @@
 #include "TriggeredAvgNode.h"
 #include "DataCollector.h"
 #include "MultiChannelRingBuffer.h"
+#include "Offline/SnapshotExport.h"
+#include "TimingZones.h"
+#include "TrialArchive.h"
 #include "TriggerSource.h"
 #include "Ui/TriggeredAvgCanvas.h"
 #include "Ui/TriggeredAvgEditor.h"
@@ -110,6 +113,7 @@ void TriggeredAvgNode::parameterValueChanged (Parameter* param)
         if (auto source = m_triggerSources.getLastAddedTriggerSource())
         {
             source->line = (int) param->getValue();
+            updateTriggerConfiguration();
         }
     }
     else if (param->getName().equalsIgnoreCase (trigger_type))
@@ -122,24 +126,34 @@ void TriggeredAvgNode::parameterValueChanged (Parameter* param)
                 source->canTrigger = true;
             else
                 source->canTrigger = false;
+            updateTriggerConfiguration();
         }
     }
-    else if (param->getName().equalsIgnoreCase (ParameterNames::pre_ms))
+    else if (param->getName().equalsIgnoreCase (ParameterNames::pre_ms)
+             || param->getName().equalsIgnoreCase (ParameterNames::post_ms))
     {
-        // TODO:
-    }
-    else if (param->getName().equalsIgnoreCase (ParameterNames::post_ms))
-    {
-        // TODO:
+        updateTriggerConfiguration();
+
+        // accumulated trials are kept; only the newly covered samples start from zero
+        if (m_dataCollector && m_threadsInitialized.load())
+            m_dataCollector->setWindowSize (getNumberOfPreSamples(),
+                                            getNumberOfPostSamplesIncludingTrigger());
+        else
+            m_dataStore->resizeWindowForAllConditions (getNumberOfPreSamples(),
+                                                       getNumberOfPostSamplesIncludingTrigger());
+
+        if (m_canvas)
+            m_canvas->setWindowSizeMs (getPreWindowSizeMs(), getPostWindowSizeMs());
     }
 }
 
 void TriggeredAvgNode::process (AudioBuffer<float>& buffer)
 {
+    TRIGGERED_AVG_TIMING_ZONE ("TriggeredAvgNode::process");
     // For now: first stream only
     static SampleNumber lastSampleNumber = 0;
     // TODO: Add handling of multiple streams (ring buffer per stream?)
-    StreamId streamId = getDataStreams()[m_dataStreamIndex]->getStreamId();
+    const StreamId streamId = m_streamId;
     auto timestamp = getFirstTimestampForBlock (streamId);
 
     SampleNumber firstSampleNumber = getFirstSampleNumberForBlock (streamId);
@@ -154,38 +168,91 @@ void TriggeredAvgNode::process (AudioBuffer<float>& buffer)
 
     auto nSamplesInBlock = getNumSamplesInBlock (streamId);
     m_ringBuffer->addData (buffer, firstSampleNumber, nSamplesInBlock);
+
+    const SnapshotPublisher<TriggerDispatchTable>::ReadScope triggerConfig (m_triggerConfig);
+    m_blockTriggerConfig = triggerConfig.get();
     checkForEvents (false);
+    m_blockTriggerConfig = nullptr;
 }
 
 void TriggeredAvgNode::prepareToPlay (double sampleRate, int maximumExpectedSamplesPerBlock)
 {
     GenericProcessor::prepareToPlay (sampleRate, maximumExpectedSamplesPerBlock);
+    updateStreamId();
+    updateTriggerConfiguration();
     initializeThreads();
 }
 
+void TriggeredAvgNode::updateSettings()
+{
+    updateStreamId();
+    updateTriggerConfiguration();
+}
+
+void TriggeredAvgNode::updateStreamId()
+{
+    // getDataStreams() returns a copy, so process() uses the id cached here
+    const auto streams = getDataStreams();
+    if (static_cast<int> (m_dataStreamIndex) < streams.size())
+        m_streamId = streams[m_dataStreamIndex]->getStreamId();
+}
+
+void TriggeredAvgNode::updateTriggerConfiguration()
+{
+    m_triggerConfig.publish (
+        std::make_unique<const TriggerDispatchTable> (m_triggerSources.getAll(),
+                                                      getNumberOfPreSamples(),
+                                                      getNumberOfPostSamplesIncludingTrigger(),
+                                                      m_triggerConfig.getLatest()));
+}
+
+void TriggeredAvgNode::saveAveragesAsNpy (const File& folder, const String& prefix)
+{
+    std::vector<ExportedCondition> conditions;
+    for (const auto* source : m_triggerSources.getAll())
+        conditions.push_back ({ source->id, source->name });
+
+    m_exportPool.addJob (
+        [store = m_dataStore.get(), conditions = std::move (conditions), folder, prefix]
+        {
+            const double start = Time::getMillisecondCounterHiRes();
+            const auto result = exportConditionsAsNpy (*store, conditions, folder, prefix);
+            const auto message =
+                result.wasOk() ? "Saved averages to " + folder.getFullPathName() + " in "
+                                     + String (Time::getMillisecondCounterHiRes() - start, 0)
+                                     + " ms"
+                               : "Saving averages failed: " + result.getErrorMessage();
+            MessageManager::callAsync ([message] { CoreServices::sendStatusMessage (message); });
+        });
+}
+
+float TriggeredAvgNode::getTriggerStreamSampleRate() const
+{
+    const auto streams = getDataStreams();
+    if (static_cast<int> (m_dataStreamIndex) >= streams.size())
+        return 0.0f;
+    return streams[m_dataStreamIndex]->getSampleRate();
+}
+
 float TriggeredAvgNode::getPreWindowSizeMs() const
 {
     return getParameter (ParameterNames::pre_ms)->getValue();
 }
 int TriggeredAvgNode::getNumberOfPreSamples() const
 {
-    const float sampleRate = getDataStreams()[m_dataStreamIndex]->getSampleRate();
+    const float sampleRate = getTriggerStreamSampleRate();
     const int preSamples = static_cast<int> (sampleRate * (getPreWindowSizeMs() / 1000.0f));
     return preSamples;
 }
 int TriggeredAvgNode::getNumberOfPostSamplesIncludingTrigger() const
 {
-    const float sampleRate = getDataStreams()[m_dataStreamIndex]->getSampleRate();
+    const float sampleRate = getTriggerStreamSampleRate();
     const int postSamples = static_cast<int> (sampleRate * (getPostWindowSizeMs() / 1000.0f));
     return postSamples;
 }
 int TriggeredAvgNode::getNumberOfSamples() const
 {
-    const float sampleRate = getDataStreams()[m_dataStreamIndex]->getSampleRate();
-    const int preSamples = static_cast<int> (sampleRate * (getPreWindowSizeMs() / 1000.0f));
-    const int postSamples = static_cast<int> (sampleRate * (getPostWindowSizeMs() / 1000.0f));
-    const int totalSamples = preSamples + postSamples;
-    return totalSamples;
+    return getNumberOfPreSamples() + getNumberOfPostSamplesIncludingTrigger();
 }
 
 float TriggeredAvgNode::getPostWindowSizeMs() const
@@ -198,6 +265,7 @@ void TriggeredAvgNode::saveCustomParametersToXml (XmlElement* xml)
     for (auto source : m_triggerSources.getAll())
     {
         XmlElement* sourceXml = xml->createNewChildElement ("TRIGGERSOURCE");
+        sourceXml->setAttribute ("id", static_cast<int> (source->id));
         sourceXml->setAttribute ("name", source->name);
         sourceXml->setAttribute ("line", source->line);
         sourceXml->setAttribute ("type", static_cast<int> (source->type));
@@ -219,12 +287,11 @@ void TriggeredAvgNode::loadCustomParametersFromXml (XmlElement* xml)
             int savedType =
                 sourceXml->getIntAttribute ("type", static_cast<int> (TriggerType::TTL_TRIGGER));
             String savedColour = sourceXml->getStringAttribute ("colour", "");
+            auto savedId = static_cast<ConditionId> (
+                sourceXml->getIntAttribute ("id", static_cast<int> (invalidConditionId)));
 
-            TriggerSource* source =
-                m_triggerSources.addTriggerSource (savedLine, static_cast<TriggerType> (savedType));
-
-            if (savedName.isNotEmpty())
-                source->name = savedName;
+            TriggerSource* source = m_triggerSources.addTriggerSource (
+                savedLine, static_cast<TriggerType> (savedType), -1, savedId, savedName);
 
             if (savedColour.length() > 0)
                 source->colour = Colour::fromString (savedColour);
@@ -234,31 +301,96 @@ void TriggeredAvgNode::loadCustomParametersFromXml (XmlElement* xml)
 
 void TriggeredAvgNode::handleBroadcastMessage (const String& message, const int64 sysTimeMs)
 {
-    if (m_dataCollector && m_threadsInitialized.load())
+    const auto* config = m_blockTriggerConfig;
+    if (! m_dataCollector || ! m_threadsInitialized.load() || ! config)
+        return;
+
+    const auto& sources = config->getSources();
+    for (int sourceIndex = 0; sourceIndex < static_cast<int> (sources.size()); ++sourceIndex)
     {
-        for (auto source : m_triggerSources.getAll())
+        const auto& source = sources[sourceIndex];
+        if (! message.equalsIgnoreCase (source.name))
+            continue;
+
+        if (source.type == TriggerType::TTL_AND_MSG_TRIGGER)
         {
-            if (message.equalsIgnoreCase (source->name))
-            {
-                if (source->type == TriggerType::TTL_AND_MSG_TRIGGER)
-                {
-                    source->canTrigger = true;
-                }
-                else if (source->type == TriggerType::MSG_TRIGGER)
-                {
-                    for (auto stream : getDataStreams())
-                    {
-                        const uint16 streamId = stream->getStreamId();
-                        // TODO: Do something
-                        assert (false);
-                    }
-                }
-            }
+            config->arm (sourceIndex);
+        }
+        else if (source.type == TriggerType::MSG_TRIGGER)
+        {
+            // TODO: Register a capture request at the current sample number
+            jassertfalse;
         }
     }
 }
 
-String TriggeredAvgNode::handleConfigMessage (const String& message) { return ""; }
+String TriggeredAvgNode::handleConfigMessage (const String& message)
+{
+    const auto command = message.trim().upToFirstOccurrenceOf (" ", false, false);
+    const auto argument = message.trim().fromFirstOccurrenceOf (" ", false, false).trim();
+    const auto documents = File::getSpecialLocation (File::userDocumentsDirectory);
+    auto getFile = [&] (const String& name, const String& suffix)
+    {
+        return argument.isNotEmpty() ? File::getCurrentWorkingDirectory().getChildFile (argument)
+                                     : documents.getNonexistentChildFile (name, suffix, false);
+    };
+
+    // "trace [file]" writes the recorded timing zones as a Chrome trace
+    if (command.equalsIgnoreCase ("trace"))
+    {
+        const auto file = getFile ("triggered-avg-trace", ".json");
+        const auto result = TimingZones::writeChromeTrace (file);
+        return result.wasOk() ? file.getFullPathName() : result.getErrorMessage();
+    }
+
+    // "archive [file]" writes every accumulated trial to file until "archive stop" or the end
+    // of acquisition
+    if (command.equalsIgnoreCase ("archive"))
+    {
+        if (argument.equalsIgnoreCase ("stop"))
+        {
+            const auto outcome = finishTrialArchive();
+            return outcome.isNotEmpty() ? outcome : "No trials are being archived";
+        }
+
+        if (! m_dataCollector || ! m_threadsInitialized.load()
+            || ! CoreServices::getAcquisitionStatus())
+            return "Trials can only be archived during acquisition";
+
+        auto archive = std::make_unique<TrialArchiveWriter> (
+            getFile ("triggered-avg-trials", ".bin"),
+            TrialArchiveWriter::getBufferBytesFor (getNumInputs(), getNumberOfSamples()));
+        if (const auto status = archive->getStatus(); status.failed())
+            return status.getErrorMessage();
+
+        const auto path = archive->getFile().getFullPathName();
+        m_dataCollector->setTrialArchive (std::move (archive));
+        return "Archiving trials to " + path;
+    }
+    return "";
+}
+
+String TriggeredAvgNode::finishTrialArchive()
+{
+    auto archive = m_dataCollector ? m_dataCollector->setTrialArchive (nullptr) : nullptr;
+    if (archive == nullptr)
+        return {};
+
+    // waits for the remaining blocks to reach the disk
+    archive->finish();
+    if (const auto status = archive->getStatus(); status.failed())
+        return status.getErrorMessage();
+    return String (archive->getNumArchivedTrials()) + " trials archived to "
+           + archive->getFile().getFullPathName() + ", "
+           + String (archive->getNumDroppedTrials()) + " dropped";
+}
+
+bool TriggeredAvgNode::stopAcquisition()
+{
+    if (const auto outcome = finishTrialArchive(); outcome.isNotEmpty())
+        CoreServices::sendStatusMessage (outcome);
+    return true;
+}
 
 bool TriggeredAvgNode::getIntField (DynamicObject::Ptr payload,
                                     String name,
@@ -277,34 +409,34 @@ bool TriggeredAvgNode::getIntField (DynamicObject::Ptr payload,
 
 void TriggeredAvgNode::handleTTLEvent (TTLEventPtr event)
 {
-    if (m_dataCollector && m_threadsInitialized.load())
+    const auto* config = m_blockTriggerConfig;
+    if (! m_dataCollector || ! m_threadsInitialized.load() || ! config || ! event->getState())
+        return;
+
+    const SampleNumber triggerSample = event->getSampleNumber();
+    auto dispatch = [&] (const TriggerDispatchEntry& entry)
     {
-        for (auto source : m_triggerSources.getAll())
-        {
-            if (event->getLine() == source->line && event->getState() && source->canTrigger)
-            {
-                const float sampleRate = getDataStreams()[m_dataStreamIndex]->getSampleRate();
-                int preSamples = static_cast<int> (sampleRate * (getPreWindowSizeMs() / 1000.0f));
-                int postSamples = static_cast<int> (sampleRate * (getPostWindowSizeMs() / 1000.0f));
-
-                auto triggerSample = event->getSampleNumber();
-                m_dataCollector->registerCaptureRequest (
-                    CaptureRequest { .triggerSource = source,
-                                     .triggerSample = event->getSampleNumber(),
-                                     .preSamples = preSamples,
-                                     .postSamples = postSamples });
-
-                if (source->type == TriggerType::TTL_AND_MSG_TRIGGER)
-                    source->canTrigger = false;
-            }
-        }
-    }
+        if (! config->tryTrigger (entry.sourceIndex))
+            return;
+
+        m_dataCollector->registerCaptureRequest (
+            CaptureRequest { .conditionId = config->getSource (entry.sourceIndex).id,
+                             .triggerSample = triggerSample,
+                             .preSamples = entry.preSamples,
+                             .postSamples = entry.postSamples });
+    };
+
+    for (const auto& entry : config->getEntriesForLine (event->getLine()))
+        dispatch (entry);
+    for (const auto& entry : config->getEntriesForAnyLine())
+        dispatch (entry);
 }
 
 void TriggeredAvgNode::handleAsyncUpdate()
 {
+    TRIGGERED_AVG_TIMING_ZONE ("TriggeredAvgNode::handleAsyncUpdate");
     // TODO: handle redrawring on message thread (here)
-    int tst = 0;
+    m_triggerConfig.collectGarbage();
     m_canvas->refresh();
 }
 
@@ -314,7 +446,9 @@ void TriggeredAvgNode::initializeThreads()
         shutdownThreads();
 
     m_ringBuffer = std::make_unique<MultiChannelRingBuffer> (getNumInputs(), m_ringBufferSize);
-    m_dataCollector = std::make_unique<DataCollector> (this, m_ringBuffer.get(), m_dataStore.get());
+    m_dataCollector = std::make_unique<DataCollector> ([this] { triggerAsyncUpdate(); },
+                                                       m_ringBuffer.get(),
+                                                       m_dataStore.get());
     if (getNumInputs() > 0 && m_ringBufferSize > 0)
     {
         m_dataCollector->startThread (Thread::Priority::high);
@@ -23,6 +23,8 @@
 */
 #pragma once
 
+#include "SnapshotPublisher.h"
+#include "TriggerDispatchTable.h"
 #include "TriggerSource.h"
 
 #include <ProcessorHeaders.h>
@@ -62,6 +64,8 @@ public:
     void parameterValueChanged (Parameter* param) override;
     void process (AudioBuffer<float>& buffer) override;
     void prepareToPlay (double sampleRate, int maximumExpectedSamplesPerBlock) override;
+    bool stopAcquisition() override;
+    void updateSettings() override;
 
     // parameters
     int getMaxTrials() const { return (int) getParameter (ParameterNames::max_trials)->getValue(); }
@@ -76,8 +80,17 @@ public:
     // trigger sources
     TriggerSources& getTriggerSources() { return m_triggerSources; }
 
+    /** Publishes a new snapshot of the trigger sources and windows to the audio thread.
+        Must be called on the message thread after trigger sources or windows change. */
+    void updateTriggerConfiguration();
+
     TriggeredAverage::DataStore* getDataStore() { return m_dataStore.get(); }
 
+    /** Writes the mean, SD, trial counts and stored trials of every condition as .npy files
+        named <prefix>_<condition>_* into folder, on a background thread. Reports the outcome
+        as a status message. */
+    void saveAveragesAsNpy (const File& folder, const String& prefix);
+
     void setCanvas (TriggeredAvgCanvas* canvas) { m_canvas = canvas; }
 
     int getNextConditionIndex() const { return m_triggerSources.getNextConditionIndex(); }
@@ -107,6 +120,10 @@ private:
 
     void initializeThreads();
     void shutdownThreads();
+    /** Detaches and finishes the trial archive, if any; returns its outcome for the user */
+    String finishTrialArchive();
+    float getTriggerStreamSampleRate() const;
+    void updateStreamId();
 
     std::unique_ptr<DataStore> m_dataStore;
     std::unique_ptr<MultiChannelRingBuffer> m_ringBuffer;
@@ -115,10 +132,23 @@ private:
 
     TriggerSources m_triggerSources;
 
+    // id of the stream at m_dataStreamIndex, read by the audio thread
+    StreamId m_streamId = 0;
+
+    // trigger configuration as seen by the audio thread; the UI only edits m_triggerSources
+    SnapshotPublisher<TriggerDispatchTable> m_triggerConfig;
+    // snapshot pinned for the duration of process(), audio thread only
+    const TriggerDispatchTable* m_blockTriggerConfig = nullptr;
+
     // Buffer parameters
     int m_ringBufferSize;
     std::atomic<bool> m_threadsInitialized;
 
+    // declared after m_dataStore, so running exports finish before the store is destroyed
+    ThreadPool m_exportPool {
+        ThreadPoolOptions {}.withThreadName ("Triggered Avg export").withNumberOfThreads (1)
+    };
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TriggeredAvgNode)
 };
 
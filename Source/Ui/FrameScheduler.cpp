@@ -0,0 +1,45 @@
+#include "FrameScheduler.h"
+
+using namespace TriggeredAverage;
+
+FrameScheduler::FrameScheduler (std::function<void()> renderFrame)
+    : m_renderFrame (std::move (renderFrame))
+{
+}
+
+FrameScheduler::~FrameScheduler() { stopTimer(); }
+
+void FrameScheduler::setMaxFramesPerSecond (int framesPerSecond)
+{
+    m_maxFramesPerSecond = jmax (minFramesPerSecond, framesPerSecond);
+    m_frameIntervalMs = 1000.0 / m_maxFramesPerSecond;
+}
+
+void FrameScheduler::requestFrame()
+{
+    if (isTimerRunning())
+        return;
+
+    const double sinceLastFrame = Time::getMillisecondCounterHiRes() - m_lastFrameStartMs;
+    startTimer (jmax (1, roundToInt (m_frameIntervalMs - sinceLastFrame)));
+}
+
+void FrameScheduler::timerCallback()
+{
+    stopTimer();
+
+    const double frameStart = Time::getMillisecondCounterHiRes();
+    m_renderFrame();
+    const double frameCost = Time::getMillisecondCounterHiRes() - frameStart + m_paintTimeMs;
+
+    m_lastFrameStartMs = frameStart;
+    m_paintTimeMs = 0.0;
+
+    // keep at least half of the message thread free for the rest of the GUI
+    const double targetIntervalMs = 1000.0 / m_maxFramesPerSecond;
+    const double maxIntervalMs = 1000.0 / minFramesPerSecond;
+    if (frameCost > 0.5 * m_frameIntervalMs)
+        m_frameIntervalMs = jmin (maxIntervalMs, jmax (m_frameIntervalMs * 1.5, 2.0 * frameCost));
+    else if (frameCost < 0.25 * m_frameIntervalMs)
+        m_frameIntervalMs = jmax (targetIntervalMs, m_frameIntervalMs * 0.8);
+}
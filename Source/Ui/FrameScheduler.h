@@ -0,0 +1,43 @@
+#pragma once
+
+#include <VisualizerWindowHeaders.h>
+#include <functional>
+
+namespace TriggeredAverage
+{
+
+/**
+    Paces display updates. Update requests are coalesced into frames that run at most at the
+    configured rate. When a frame, including the painting it caused, takes more than half of
+    the frame interval on the message thread, the interval is stretched, and it recovers
+    towards the configured rate once frames are cheap again.
+*/
+class FrameScheduler : private Timer
+{
+public:
+    explicit FrameScheduler (std::function<void()> renderFrame);
+    ~FrameScheduler() override;
+
+    void setMaxFramesPerSecond (int framesPerSecond);
+    int getMaxFramesPerSecond() const { return m_maxFramesPerSecond; }
+    double getFrameIntervalMs() const { return m_frameIntervalMs; }
+
+    /** Schedules a frame; requests arriving before it runs are merged into it */
+    void requestFrame();
+
+    /** Adds message thread time spent on behalf of the last frame, e.g. painting */
+    void addPaintTime (double milliseconds) { m_paintTimeMs += milliseconds; }
+
+private:
+    void timerCallback() override;
+
+    static constexpr int minFramesPerSecond = 2;
+
+    std::function<void()> m_renderFrame;
+    int m_maxFramesPerSecond = 30;
+    double m_frameIntervalMs = 1000.0 / 30.0;
+    double m_lastFrameStartMs = 0.0;
+    double m_paintTimeMs = 0.0;
+};
+
+} // namespace TriggeredAverage
@@ -3,71 +3,267 @@
 #include "DataCollector.h"
 #include "SinglePlotPanel.h"
 #include "TriggerSource.h"
+#include "TriggeredAvgCanvas.h"
 #include "TriggeredAvgNode.h"
 
-TriggeredAverage::GridDisplay::GridDisplay() = default;
+#include <algorithm>
+#include <unordered_map>
 
-void TriggeredAverage::GridDisplay::refresh()
+TriggeredAverage::GridDisplay::GridDisplay (DataStore* dataStore)
+    : m_dataStore (dataStore),
+      scaleMode (ScaleMode::PER_PANEL),
+      rasterPool (ThreadPoolOptions {}
+                      .withThreadName ("TriggeredAvg: Rasterizer")
+                      .withNumberOfThreads (jlimit (1, 4, SystemStats::getNumCpus() - 1)))
 {
-    for (auto panel : panels)
+    setPlotType (DisplayMode::INDIVIDUAL_TRACES);
+}
+
+std::shared_ptr<const TriggeredAverage::AverageSnapshot>
+    TriggeredAverage::GridDisplay::getAverageSnapshot (ConditionId id) const
+{
+    return m_dataStore ? m_dataStore->getPublishedSnapshot (id) : nullptr;
+}
+
+TriggeredAverage::GridDisplay::~GridDisplay() = default;
+
+void TriggeredAverage::GridDisplay::refresh() { frameScheduler.requestFrame(); }
+
+void TriggeredAverage::GridDisplay::setMaxFramesPerSecond (int framesPerSecond)
+{
+    frameScheduler.setMaxFramesPerSecond (framesPerSecond);
+}
+
+void TriggeredAverage::GridDisplay::renderFrame()
+{
+    if (m_dataStore == nullptr)
+        return;
+
+    // panels of conditions without new trials keep their cached image, unless the range they
+    // share with other panels changed
+    const auto updatedConditions = m_dataStore->takeUpdatedConditions();
+    const bool sharedRangesChanged = ! updatedConditions.empty() && updateSharedRanges();
+    for (auto* entry : visibleEntries)
     {
-        panel->repaint();
+        if (sharedRangesChanged
+            || std::any_of (updatedConditions.begin(),
+                            updatedConditions.end(),
+                            [entry] (ConditionId id) { return entry->panel->showsCondition (id); }))
+            entry->panel->dataUpdated();
     }
 }
 
-void TriggeredAverage::GridDisplay::resized()
+juce::Range<float>
+    TriggeredAverage::GridDisplay::getDataRange (ConditionId id,
+                                                 int channelIndexInAverageBuffer) const
 {
-    totalHeight = 0;
-    const int numPlots = panels.size();
-    const int leftEdge = 10;
-    const int rightEdge = getWidth() - borderSize;
-    const int histogramWidth = (rightEdge - leftEdge - borderSize * (numColumns - 1)) / numColumns;
+    juce::Range<float> range;
+    bool hasRange = false;
+    auto include = [&] (juce::Range<float> other)
+    {
+        range = hasRange ? range.getUnionWith (other) : other;
+        hasRange = true;
+    };
+
+    const bool showsAllTraces =
+        plotType == DisplayMode::INDIVIDUAL_TRACES || plotType == DisplayMode::ALL_AND_AVERAGE;
+
+    if (showsAllTraces && m_dataStore != nullptr)
+    {
+        auto lock = m_dataStore->GetLock();
+        const auto* density = m_dataStore->getTraceDensity (id);
+        if (density != nullptr && density->getNumTrials() > 0
+            && channelIndexInAverageBuffer < density->getNumChannels())
+            include (density->getAmplitudeRange (channelIndexInAverageBuffer));
+    }
+
+    if (plotType != DisplayMode::INDIVIDUAL_TRACES || ! hasRange)
+    {
+        const auto snapshot = getAverageSnapshot (id);
+        if (snapshot != nullptr && snapshot->numTrials > 0
+            && channelIndexInAverageBuffer < static_cast<int> (snapshot->channelRanges.size()))
+            include (snapshot->channelRanges[channelIndexInAverageBuffer]);
+    }
+
+    return range;
+}
+
+bool TriggeredAverage::GridDisplay::updateSharedRanges()
+{
+    if (scaleMode == ScaleMode::PER_PANEL)
+        return false;
+
+    // every entry counts, including the ones scrolled out of view
+    std::unordered_map<const ContinuousChannel*, juce::Range<float>> newChannelRanges;
+    juce::Range<float> newGlobalRange;
+    for (const auto& entry : entries)
+    {
+        const auto range = getDataRange (entry->conditionId, entry->channelIndexInAverageBuffer);
+        if (range.isEmpty())
+            continue;
+
+        auto [channelRange, inserted] = newChannelRanges.try_emplace (entry->channel, range);
+        if (! inserted)
+            channelRange->second = channelRange->second.getUnionWith (range);
+        newGlobalRange = newGlobalRange.isEmpty() ? range : newGlobalRange.getUnionWith (range);
+    }
 
-    int index = -1;
-    int overlayIndex = 0;
-    int row = 0;
-    int col = 0;
-    bool drawBackground = true;
+    const bool changed = newChannelRanges != channelRanges || newGlobalRange != globalRange;
+    channelRanges = std::move (newChannelRanges);
+    globalRange = newGlobalRange;
+    return changed;
+}
+
+juce::Range<float>
+    TriggeredAverage::GridDisplay::getValueRange (const ContinuousChannel* channel,
+                                                  ConditionId id,
+                                                  int channelIndexInAverageBuffer) const
+{
+    switch (scaleMode)
+    {
+        case ScaleMode::PER_CHANNEL:
+            if (auto range = channelRanges.find (channel); range != channelRanges.end())
+                return range->second;
+            break;
+        case ScaleMode::GLOBAL:
+            if (! globalRange.isEmpty())
+                return globalRange;
+            break;
+        default:
+            break;
+    }
+    return getDataRange (id, channelIndexInAverageBuffer);
+}
+
+void TriggeredAverage::GridDisplay::resized()
+{
+    updateLayout();
+    updateVisiblePanels();
+}
 
-    ContinuousChannel* latestChannel = nullptr;
+// assigns every entry a grid slot; in overlay mode, all conditions of a channel share one
+void TriggeredAverage::GridDisplay::updateLayout()
+{
+    std::unordered_map<const ContinuousChannel*, int> channelSlots;
+    std::unordered_map<int, int> overlayCounts;
 
-    for (auto panel : panels)
+    layoutIsDirty = false;
+    numSlots = 0;
+    for (auto& entry : entries)
     {
         if (overlayConditions)
         {
-            if (panel->contChannel != latestChannel)
-            {
-                latestChannel = const_cast<ContinuousChannel*> (panel->contChannel);
-                drawBackground = true;
-                index++;
-                overlayIndex = 0;
-            }
+            auto [slot, inserted] = channelSlots.try_emplace (entry->channel, numSlots);
+            if (inserted)
+                numSlots++;
+            entry->slot = slot->second;
+            entry->overlayIndex = overlayCounts[entry->slot]++;
         }
         else
         {
-            index++;
+            entry->slot = numSlots++;
+            entry->overlayIndex = 0;
         }
+    }
 
-        row = index / numColumns;
-        col = index % numColumns;
+    layoutOrder.clear();
+    layoutOrder.reserve (entries.size());
+    for (auto& entry : entries)
+        layoutOrder.push_back (entry.get());
+    std::stable_sort (layoutOrder.begin(),
+                      layoutOrder.end(),
+                      [] (const PanelEntry* a, const PanelEntry* b) { return a->slot < b->slot; });
 
-        panel->drawBackground (drawBackground);
-        panel->setBounds (leftEdge + col * (histogramWidth + borderSize),
-                          row * (panelHeightPx + borderSize),
-                          histogramWidth,
-                          panelHeightPx);
+    const int numRows = (numSlots + numColumns - 1) / numColumns;
+    totalHeight = numRows * getRowStride();
+}
 
-        panel->setOverlayMode (overlayConditions);
-        panel->setOverlayIndex (overlayIndex);
+void TriggeredAverage::GridDisplay::updateVisiblePanels()
+{
+    // rows are laid out top to bottom, so the visible entries are a contiguous range
+    const int firstRow = std::max (0, visibleArea.getY() / getRowStride());
+    const int lastRow = visibleArea.getBottom() / getRowStride();
+
+    auto first = std::partition_point (layoutOrder.begin(),
+                                       layoutOrder.end(),
+                                       [&] (const PanelEntry* entry)
+                                       { return entry->slot / numColumns < firstRow; });
+    auto last = std::partition_point (first,
+                                      layoutOrder.end(),
+                                      [&] (const PanelEntry* entry)
+                                      { return entry->slot / numColumns <= lastRow; });
+    if (visibleArea.isEmpty())
+        last = first;
+
+    // in overlay mode, the first entry of a slot owns a panel that draws the whole slot
+    std::vector<PanelEntry*> nowVisible;
+    for (auto it = first; it != last; ++it)
+    {
+        if ((*it)->overlayIndex == 0)
+            nowVisible.push_back (*it);
+    }
+    std::sort (nowVisible.begin(), nowVisible.end());
+    for (auto* entry : visibleEntries)
+    {
+        if (! std::binary_search (nowVisible.begin(), nowVisible.end(), entry))
+            entry->panel.reset();
+    }
 
-        if (overlayConditions)
+    visibleEntries.clear();
+    for (auto slotBegin = first; slotBegin != last;)
+    {
+        auto slotEnd = std::find_if (slotBegin,
+                                     last,
+                                     [slot = (*slotBegin)->slot] (const PanelEntry* entry)
+                                     { return entry->slot != slot; });
+        auto* entry = *slotBegin;
+        visibleEntries.push_back (entry);
+
+        if (entry->panel == nullptr)
         {
-            drawBackground = false;
-            overlayIndex++;
+            entry->panel = std::make_unique<SinglePlotPanel> (this,
+                                                              entry->channel,
+                                                              entry->conditionId,
+                                                              entry->channelIndexInAverageBuffer,
+                                                              entry->averageBuffer);
+            entry->panel->setPlotType (plotType);
+            entry->panel->setErpSmoothing (erpSmoothing);
+            entry->panel->setWindowSizeMs (pre_ms, post_ms);
+            addAndMakeVisible (entry->panel.get());
         }
+
+        std::vector<SinglePlotPanel::ConditionLayer> overlaid;
+        for (auto it = std::next (slotBegin); it != slotEnd; ++it)
+            overlaid.push_back ({ (*it)->conditionId, (*it)->channelIndexInAverageBuffer });
+        entry->panel->setOverlayConditions (overlaid);
+        placePanel (*entry);
+
+        slotBegin = slotEnd;
     }
+}
+
+void TriggeredAverage::GridDisplay::placePanel (PanelEntry& entry) const
+{
+    const int leftEdge = 10;
+    const int rightEdge = getWidth() - borderSize;
+    const int histogramWidth = (rightEdge - leftEdge - borderSize * (numColumns - 1)) / numColumns;
+
+    const int row = entry.slot / numColumns;
+    const int col = entry.slot % numColumns;
 
-    totalHeight = (row + 1) * (panelHeightPx + borderSize);
+    auto* panel = entry.panel.get();
+    panel->setBounds (leftEdge + col * (histogramWidth + borderSize),
+                      row * getRowStride(),
+                      histogramWidth,
+                      panelHeightPx);
+
+    panel->setOverlayMode (overlayConditions);
+}
+
+void TriggeredAverage::GridDisplay::setVisibleArea (Rectangle<int> newVisibleArea)
+{
+    visibleArea = newVisibleArea;
+    updateVisiblePanels();
 }
 
 void TriggeredAverage::GridDisplay::addContChannel (const ContinuousChannel* channel,
@@ -75,40 +271,105 @@ void TriggeredAverage::GridDisplay::addContChannel (const ContinuousChannel* cha
                                                     int channelIndexInAverageBuffer,
                                                     const MultiChannelAverageBuffer* avgBuffer)
 {
-    auto* h = new SinglePlotPanel (this, channel, source, channelIndexInAverageBuffer, avgBuffer);
-    h->setPlotType (plotType);
-
-    panels.add (h);
-    triggerSourceToPanelMap[source].add (h);
-    contChannelToPanelMap[channel].add (h);
-
-    int numRows = panels.size() / numColumns + 1;
-
-    totalHeight = (numRows + 1) * (panelHeightPx + 10);
-
-    addAndMakeVisible (h);
+    // the panel component itself is only created once the entry is scrolled into view
+    auto entry = std::make_unique<PanelEntry>();
+    entry->channel = channel;
+    entry->conditionId = source->id;
+    entry->channelIndexInAverageBuffer = channelIndexInAverageBuffer;
+    entry->averageBuffer = avgBuffer;
+    entries.push_back (std::move (entry));
+    conditionInfos[source->id] = { source->name, source->colour };
+    layoutIsDirty = true;
 }
 
 void TriggeredAverage::GridDisplay::updateColourForSource (const TriggerSource* source)
 {
-    Array<SinglePlotPanel*> plotPanels = triggerSourceToPanelMap[source];
+    if (auto info = conditionInfos.find (source->id); info != conditionInfos.end())
+        info->second.colour = source->colour;
 
-    for (auto panel : plotPanels)
+    for (auto* entry : visibleEntries)
     {
-        panel->setSourceColour (source->colour);
+        if (entry->conditionId == source->id)
+            entry->panel->setSourceColour (source->colour);
+        else if (entry->panel->showsCondition (source->id))
+            entry->panel->repaint();
     }
 }
 
 void TriggeredAverage::GridDisplay::updateConditionName (const TriggerSource* source)
 {
-    Array<SinglePlotPanel*> plotPanels = triggerSourceToPanelMap[source];
+    if (auto info = conditionInfos.find (source->id); info != conditionInfos.end())
+        info->second.name = source->name;
 
-    for (auto panel : plotPanels)
+    for (auto* entry : visibleEntries)
     {
-        panel->setSourceName (source->name);
+        if (entry->conditionId == source->id)
+            entry->panel->setSourceName (source->name);
+        else if (entry->panel->showsCondition (source->id))
+            entry->panel->repaint();
     }
 }
 
+String TriggeredAverage::GridDisplay::getConditionName (ConditionId id) const
+{
+    const auto info = conditionInfos.find (id);
+    return info != conditionInfos.end() ? info->second.name : String();
+}
+
+Colour TriggeredAverage::GridDisplay::getConditionColour (ConditionId id) const
+{
+    const auto info = conditionInfos.find (id);
+    return info != conditionInfos.end() ? info->second.colour : Colours::grey;
+}
+
+bool TriggeredAverage::GridDisplay::hasCondition (ConditionId id) const
+{
+    return std::any_of (entries.begin(),
+                        entries.end(),
+                        [id] (const auto& entry) { return entry->conditionId == id; });
+}
+
+Array<TriggeredAverage::ConditionId> TriggeredAverage::GridDisplay::getConditionIds() const
+{
+    Array<ConditionId> ids;
+    for (const auto& entry : entries)
+        ids.addIfNotAlreadyThere (entry->conditionId);
+    return ids;
+}
+
+void TriggeredAverage::GridDisplay::removeConditions (const Array<ConditionId>& ids)
+{
+    if (ids.isEmpty())
+        return;
+
+    auto isRemoved = [&ids] (const PanelEntry* entry) { return ids.contains (entry->conditionId); };
+    std::erase_if (visibleEntries, isRemoved);
+    std::erase_if (layoutOrder, isRemoved);
+    std::erase_if (entries, [&isRemoved] (const auto& entry) { return isRemoved (entry.get()); });
+    for (auto id : ids)
+        conditionInfos.erase (id);
+    layoutIsDirty = true;
+
+    // overlay panels draw other conditions of their slot, which may include the removed one
+    if (overlayConditions)
+        resized();
+}
+
+void TriggeredAverage::GridDisplay::setConditionOrder (const Array<ConditionId>& order)
+{
+    std::stable_sort (entries.begin(),
+                      entries.end(),
+                      [&order] (const auto& a, const auto& b)
+                      {
+                          const int conditionA = order.indexOf (a->conditionId);
+                          const int conditionB = order.indexOf (b->conditionId);
+                          if (conditionA != conditionB)
+                              return conditionA < conditionB;
+                          return a->channelIndexInAverageBuffer < b->channelIndexInAverageBuffer;
+                      });
+    layoutIsDirty = true;
+}
+
 void TriggeredAverage::GridDisplay::setNumColumns (int numColumns_)
 {
     numColumns = numColumns_;
@@ -129,40 +390,75 @@ void TriggeredAverage::GridDisplay::setConditionOverlay (bool overlay_)
 
 void TriggeredAverage::GridDisplay::prepareToUpdate()
 {
-    panels.clear();
-    triggerSourceToPanelMap.clear();
-    contChannelToPanelMap.clear();
+    visibleEntries.clear();
+    layoutOrder.clear();
+    entries.clear();
+    conditionInfos.clear();
+    layoutIsDirty = true;
     setBounds (0, 0, getWidth(), 0);
 }
 
 void TriggeredAverage::GridDisplay::setWindowSizeMs (float pre_ms_, float post_ms_)
 {
+    pre_ms = pre_ms_;
     post_ms = post_ms_;
 
-    for (auto hist : panels)
+    for (auto* entry : visibleEntries)
     {
-        hist->setWindowSizeMs (pre_ms_, post_ms);
+        entry->panel->setWindowSizeMs (pre_ms, post_ms);
     }
 }
 
 void TriggeredAverage::GridDisplay::setPlotType (TriggeredAverage::DisplayMode plotType_)
 {
     plotType = plotType_;
+    if (m_dataStore != nullptr)
+    {
+        m_dataStore->setKeepTrialHistories (plotType == DisplayMode::ERP_IMAGE);
+        m_dataStore->setKeepTraceDensities (plotType == DisplayMode::INDIVIDUAL_TRACES
+                                            || plotType == DisplayMode::ALL_AND_AVERAGE);
+    }
+    updateSharedRanges();
+
+    for (auto* entry : visibleEntries)
+    {
+        entry->panel->setPlotType (plotType);
+    }
+}
 
-    for (auto panel : panels)
+void TriggeredAverage::GridDisplay::setScaleMode (ScaleMode mode)
+{
+    scaleMode = mode;
+    updateSharedRanges();
+
+    for (auto* entry : visibleEntries)
     {
-        panel->setPlotType (plotType);
+        entry->panel->dataUpdated();
     }
 }
 
+void TriggeredAverage::GridDisplay::setErpSmoothing (int numTrials)
+{
+    erpSmoothing = numTrials;
 
-int TriggeredAverage::GridDisplay::getDesiredHeight() const { return totalHeight; }
+    for (auto* entry : visibleEntries)
+    {
+        entry->panel->setErpSmoothing (erpSmoothing);
+    }
+}
+
+int TriggeredAverage::GridDisplay::getDesiredHeight()
+{
+    if (layoutIsDirty)
+        updateLayout();
+    return totalHeight;
+}
 
 void TriggeredAverage::GridDisplay::clearPanels()
 {
-    for (auto hist : panels)
+    for (auto* entry : visibleEntries)
     {
-        hist->clear();
+        entry->panel->clear();
     }
 }
 
@@ -171,13 +467,27 @@ DynamicObject TriggeredAverage::GridDisplay::getInfo()
     DynamicObject output;
     Array<var> panelInfo;
 
-    for (auto panel : panels)
+    // built from the entries, so off-screen panels are included
+    for (const auto& entry : entries)
     {
-        auto info = panel->getInfo().clone();
+        auto snapshot = getAverageSnapshot (entry->conditionId);
+
+        DynamicObject::Ptr info = new DynamicObject();
+        info->setProperty (Identifier ("channel"), var (entry->channel->getName()));
+        info->setProperty (Identifier ("condition"), var (getConditionName (entry->conditionId)));
+        info->setProperty (Identifier ("color"),
+                           var (getConditionColour (entry->conditionId).toString()));
+        info->setProperty (Identifier ("trial_count"), var (snapshot ? snapshot->numTrials : 0));
         panelInfo.add (info.get());
     }
 
     output.setProperty (Identifier ("panels"), panelInfo);
 
     return output;
-}
\ No newline at end of file
+}
+
+void TriggeredAverage::GridViewport::visibleAreaChanged (const Rectangle<int>& newVisibleArea)
+{
+    if (auto* grid = dynamic_cast<GridDisplay*> (getViewedComponent()))
+        grid->setVisibleArea (newVisibleArea);
+}
@@ -1,27 +1,47 @@
 #pragma once
+#include "FrameScheduler.h"
+#include "TriggerSource.h"
+
 #include <VisualizerWindowHeaders.h>
+#include <unordered_map>
 
 namespace TriggeredAverage
 {
 class MultiChannelAverageBuffer;
+struct AverageSnapshot;
+class DataStore;
 enum class DisplayMode : std::uint8_t;
+enum class ScaleMode : std::uint8_t;
 class SinglePlotPanel;
 class TriggerSource;
 
-// GUI Component that holds the grid of triggered average panels
+/**
+    GUI Component that holds the grid of triggered average panels.
+
+    The grid is virtualized: every channel x condition pair is a lightweight entry whose
+    position is computed arithmetically, and SinglePlotPanel components only exist for the
+    entries in the rows that are currently scrolled into view.
+*/
 class GridDisplay : public Component
 {
 public:
-    GridDisplay();
+    explicit GridDisplay (DataStore*);
+    ~GridDisplay() override;
 
-    /** Renders the Visualizer on each animation callback cycle
-        Called instead of Juce's "repaint()" to avoid redrawing underlying components
-        if not necessary.*/
+    /** Called when new data arrived. Updates are paced by the frame scheduler, and each
+        frame only redraws the visible panels of the conditions that changed. */
     void refresh();
 
+    void setMaxFramesPerSecond (int framesPerSecond);
+    /** Lets the frame scheduler account for the time panels spend painting */
+    void addPaintTime (double milliseconds) { frameScheduler.addPaintTime (milliseconds); }
+
     void resized() override;
     void setWindowSizeMs (float pre_ms, float post_ms);
     void setPlotType (TriggeredAverage::DisplayMode plotType);
+    /** Number of neighbouring trials averaged in each row of the ERP image */
+    void setErpSmoothing (int numTrials);
+    void setScaleMode (ScaleMode mode);
 
     void addContChannel (const ContinuousChannel*,
                          const TriggerSource*,
@@ -30,22 +50,90 @@ public:
 
     void updateColourForSource (const TriggerSource* source);
     void updateConditionName (const TriggerSource* source);
+
+    /** Name and colour of a condition, copied from its source, which may already be deleted
+        when the condition is removed */
+    String getConditionName (ConditionId id) const;
+    Colour getConditionColour (ConditionId id) const;
+
+    bool hasCondition (ConditionId id) const;
+    Array<ConditionId> getConditionIds() const;
+    /** Removes all given conditions before laying out again, so that no panel is created for
+        a condition that is about to be removed */
+    void removeConditions (const Array<ConditionId>& ids);
+    /** Orders the panels by condition, then by channel */
+    void setConditionOrder (const Array<ConditionId>& order);
     void setNumColumns (int numColumns);
     void setRowHeight (int rowHeightPixels);
 
+    /** Called by the enclosing viewport whenever the scroll position or its size changes */
+    void setVisibleArea (Rectangle<int> visibleArea);
+
+    /** The snapshot the collector thread last published; shared by all panels of a condition
+        and never computed on the message thread */
+    std::shared_ptr<const AverageSnapshot> getAverageSnapshot (ConditionId id) const;
+
+    DataStore* getDataStore() const { return m_dataStore; }
+
+    /** Vertical range of a panel under the current scale mode, read from the precomputed
+        snapshot and density ranges. Empty while the panel has no data. */
+    juce::Range<float> getValueRange (const ContinuousChannel* channel,
+                                      ConditionId id,
+                                      int channelIndexInAverageBuffer) const;
+
+    /** Worker threads that rasterize the panel traces off the message thread */
+    ThreadPool& getRasterPool() const { return rasterPool; }
+
     void setConditionOverlay (bool);
     void prepareToUpdate();
-    int getDesiredHeight() const;
+    int getDesiredHeight();
     void clearPanels();
 
     DynamicObject getInfo();
 
 private:
-    OwnedArray<SinglePlotPanel> panels;
+    struct PanelEntry
+    {
+        const ContinuousChannel* channel;
+        ConditionId conditionId;
+        int channelIndexInAverageBuffer;
+        const MultiChannelAverageBuffer* averageBuffer;
+
+        // layout, recomputed by updateLayout()
+        int slot = 0;
+        int overlayIndex = 0;
 
-    std::unordered_map<const TriggerSource*, Array<SinglePlotPanel*>> triggerSourceToPanelMap;
-    std::unordered_map<const ContinuousChannel*, Array<SinglePlotPanel*>> contChannelToPanelMap;
+        // only set while the entry is scrolled into view
+        std::unique_ptr<SinglePlotPanel> panel;
+    };
 
+    void renderFrame();
+    /** Extremes of what a panel currently shows: its average and/or its trace density */
+    juce::Range<float> getDataRange (ConditionId id, int channelIndexInAverageBuffer) const;
+    /** Recomputes the per-channel and global ranges; returns true if any of them changed */
+    bool updateSharedRanges();
+    void updateLayout();
+    void updateVisiblePanels();
+    void placePanel (PanelEntry& entry) const;
+    int getRowStride() const { return panelHeightPx + borderSize; }
+
+    DataStore* m_dataStore;
+
+    // entries in display order, and the same entries sorted by their position in the grid
+    std::vector<std::unique_ptr<PanelEntry>> entries;
+    std::vector<PanelEntry*> layoutOrder;
+    std::vector<PanelEntry*> visibleEntries;
+
+    struct ConditionInfo
+    {
+        String name;
+        Colour colour;
+    };
+    std::unordered_map<ConditionId, ConditionInfo> conditionInfos;
+
+    Rectangle<int> visibleArea;
+    bool layoutIsDirty = false;
+    int numSlots = 0;
     int totalHeight = 0;
     int panelHeightPx = 150;
     int borderSize = 10;
@@ -53,8 +141,26 @@ private:
 
     bool overlayConditions = false;
 
-    float post_ms;
+    float pre_ms = 0;
+    float post_ms = 0;
     DisplayMode plotType;
+    int erpSmoothing = 1;
+
+    ScaleMode scaleMode;
+    std::unordered_map<const ContinuousChannel*, juce::Range<float>> channelRanges;
+    juce::Range<float> globalRange;
+
+    FrameScheduler frameScheduler { [this] { renderFrame(); } };
+
+    // declared last, so that pending jobs are finished before the panels are destroyed
+    mutable ThreadPool rasterPool;
+};
+
+/** Viewport that tells its GridDisplay which part of it is visible */
+class GridViewport : public Viewport
+{
+public:
+    void visibleAreaChanged (const Rectangle<int>& newVisibleArea) override;
 };
 
 } // namespace TriggeredAverage
@@ -0,0 +1,174 @@
+#include "HeatmapDisplay.h"
+
+#include "DataCollector.h"
+#include "TimingZones.h"
+#include "TraceDecimation.h"
+
+#include <algorithm>
+
+using namespace TriggeredAverage;
+
+HeatmapDisplay::HeatmapDisplay (DataStore* dataStore) : m_dataStore (dataStore)
+{
+    setOpaque (true);
+}
+
+void HeatmapDisplay::setMaxFramesPerSecond (int framesPerSecond)
+{
+    frameScheduler.setMaxFramesPerSecond (framesPerSecond);
+}
+
+void HeatmapDisplay::addContChannel (const ContinuousChannel* channel,
+                                     const TriggerSource* source,
+                                     int channelIndexInAverageBuffer)
+{
+    auto heatmap = std::find_if (conditions.begin(),
+                                 conditions.end(),
+                                 [source] (const ConditionHeatmap& c)
+                                 { return c.conditionId == source->id; });
+    if (heatmap == conditions.end())
+        heatmap = conditions.insert (
+            conditions.end(),
+            ConditionHeatmap {
+                .conditionId = source->id, .name = source->name, .colour = source->colour });
+
+    // superficial channels (larger distance from the tip) on top
+    const Row row { channelIndexInAverageBuffer, channel->position.y };
+    auto insertAt = std::upper_bound (heatmap->rows.begin(),
+                                      heatmap->rows.end(),
+                                      row,
+                                      [] (const Row& a, const Row& b) { return a.depth > b.depth; });
+    heatmap->rows.insert (insertAt, row);
+    heatmap->version = 0;
+}
+
+void HeatmapDisplay::removeCondition (ConditionId id)
+{
+    std::erase_if (conditions, [id] (const ConditionHeatmap& c) { return c.conditionId == id; });
+    repaint();
+}
+
+void HeatmapDisplay::updateColourForSource (const TriggerSource* source)
+{
+    for (auto& heatmap : conditions)
+        if (heatmap.conditionId == source->id)
+            heatmap.colour = source->colour;
+    repaint();
+}
+
+void HeatmapDisplay::updateConditionName (const TriggerSource* source)
+{
+    for (auto& heatmap : conditions)
+        if (heatmap.conditionId == source->id)
+            heatmap.name = source->name;
+    repaint();
+}
+
+void HeatmapDisplay::setConditionOrder (const Array<ConditionId>& order)
+{
+    std::stable_sort (conditions.begin(),
+                      conditions.end(),
+                      [&order] (const ConditionHeatmap& a, const ConditionHeatmap& b)
+                      { return order.indexOf (a.conditionId) < order.indexOf (b.conditionId); });
+    repaint();
+}
+
+void HeatmapDisplay::setWindowSizeMs (float pre_ms_, float post_ms_)
+{
+    pre_ms = pre_ms_;
+    post_ms = post_ms_;
+    repaint();
+}
+
+void HeatmapDisplay::prepareToUpdate() { conditions.clear(); }
+
+void HeatmapDisplay::updateImage (ConditionHeatmap& heatmap, const AverageSnapshot& snapshot)
+{
+    const auto& average = snapshot.mean;
+    const int numRows = static_cast<int> (heatmap.rows.size());
+    const int numColumns = std::min (average.getNumSamples(), maxColumns);
+    if (numRows == 0 || numColumns == 0)
+        return;
+
+    if (heatmap.image.getWidth() != numColumns || heatmap.image.getHeight() != numRows)
+        heatmap.image = Image (Image::ARGB, numColumns, numRows, false, SoftwareImageType());
+
+    // every trial changes the whole mean and possibly the colour range, so a new version
+    // recolours every pixel; this runs at most once per frame and condition
+
+    // a symmetric range keeps zero at the centre (white) of the diverging map
+    float limit = 0.0f;
+    for (const auto& row : heatmap.rows)
+    {
+        const auto extremes = snapshot.channelRanges[row.channelIndexInAverageBuffer];
+        limit = std::max ({ limit, std::abs (extremes.getStart()), std::abs (extremes.getEnd()) });
+    }
+    const juce::Range<float> range (-limit, limit);
+
+    columnValues.resize (static_cast<size_t> (numColumns));
+    scratch.resize (static_cast<size_t> (numColumns));
+
+    Image::BitmapData pixels (heatmap.image, Image::BitmapData::writeOnly);
+    for (int i = 0; i < numRows; ++i)
+    {
+        const float* channelData =
+            average.getReadPointer (heatmap.rows[i].channelIndexInAverageBuffer);
+        decimateMean (channelData, average.getNumSamples(), columnValues);
+
+        auto* line = reinterpret_cast<std::uint32_t*> (pixels.getLinePointer (i));
+        colourMap.mapValues (columnValues.data(), numColumns, range, line, scratch.data());
+    }
+
+    heatmap.version = snapshot.version;
+}
+
+void HeatmapDisplay::paint (Graphics& g)
+{
+    TRIGGERED_AVG_TIMING_ZONE ("HeatmapDisplay::paint");
+    const double paintStart = Time::getMillisecondCounterHiRes();
+    g.fillAll (Colour (30, 30, 40));
+
+    if (conditions.empty() || m_dataStore == nullptr)
+        return;
+
+    const int labelHeight = 20;
+    const int gap = 10;
+    const int heatmapHeight = std::max (
+        50, (getHeight() - gap) / static_cast<int> (conditions.size()) - labelHeight - gap);
+    const int width = getWidth() - 20;
+
+    int y = gap;
+    for (auto& heatmap : conditions)
+    {
+        g.setColour (heatmap.colour);
+        g.setFont (FontOptions (15.0f));
+        g.drawText (heatmap.name, 10, y, width, labelHeight, Justification::centredLeft);
+        y += labelHeight;
+
+        const auto snapshot = m_dataStore->getPublishedSnapshot (heatmap.conditionId);
+        if (snapshot != nullptr && snapshot->version != heatmap.version)
+            updateImage (heatmap, *snapshot);
+
+        const Rectangle<float> area (10.0f,
+                                     static_cast<float> (y),
+                                     static_cast<float> (width),
+                                     static_cast<float> (heatmapHeight));
+        if (heatmap.image.isValid())
+        {
+            g.setImageResamplingQuality (Graphics::lowResamplingQuality);
+            g.drawImage (heatmap.image, area, RectanglePlacement::stretchToFit);
+        }
+
+        // t = 0
+        if (pre_ms + post_ms > 0.0f)
+        {
+            const float zeroLoc = area.getX() + pre_ms / (pre_ms + post_ms) * area.getWidth();
+            g.setColour (Colours::black);
+            g.drawLine (zeroLoc, area.getY(), zeroLoc, area.getBottom(), 1.0f);
+        }
+
+        y += heatmapHeight + gap;
+    }
+
+    frameScheduler.addPaintTime (Time::getMillisecondCounterHiRes() - paintStart);
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "ColourMap.h"
+#include "FrameScheduler.h"
+#include "TriggerSource.h"
+
+#include <VisualizerWindowHeaders.h>
+
+namespace TriggeredAverage
+{
+struct AverageSnapshot;
+class DataStore;
+
+/**
+    Shows the average of each condition as one channel x time colour image, with a row per
+    channel ordered by probe depth. Images are only rebuilt for conditions whose snapshot
+    changed, so each frame costs one blit per condition.
+*/
+class HeatmapDisplay : public Component
+{
+public:
+    explicit HeatmapDisplay (DataStore*);
+
+    void paint (Graphics& g) override;
+
+    /** Called when new data arrived; repaints are paced by a frame scheduler */
+    void refresh() { frameScheduler.requestFrame(); }
+    void setMaxFramesPerSecond (int framesPerSecond);
+
+    void addContChannel (const ContinuousChannel*,
+                         const TriggerSource*,
+                         int channelIndexInAverageBuffer);
+    void removeCondition (ConditionId id);
+    void updateColourForSource (const TriggerSource* source);
+    void updateConditionName (const TriggerSource* source);
+    void setConditionOrder (const Array<ConditionId>& order);
+    void setWindowSizeMs (float pre_ms, float post_ms);
+    void prepareToUpdate();
+
+private:
+    struct Row
+    {
+        int channelIndexInAverageBuffer;
+        float depth;
+    };
+
+    // copies what it shows of the source, which is deleted before the condition is removed
+    struct ConditionHeatmap
+    {
+        ConditionId conditionId;
+        String name;
+        Colour colour;
+        std::vector<Row> rows;
+        Image image;
+        std::uint64_t version = 0;
+    };
+
+    void updateImage (ConditionHeatmap& heatmap, const AverageSnapshot& snapshot);
+
+    DataStore* m_dataStore;
+    std::vector<ConditionHeatmap> conditions;
+    const ColourMap colourMap = ColourMap::createDiverging();
+
+    // reused between image updates
+    std::vector<float> columnValues;
+    std::vector<float> scratch;
+
+    float pre_ms = 0;
+    float post_ms = 0;
+
+    FrameScheduler frameScheduler { [this] { repaint(); } };
+
+    static constexpr int maxColumns = 1024;
+};
+
+} // namespace TriggeredAverage
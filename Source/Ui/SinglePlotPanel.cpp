@@ -1,26 +1,75 @@
 #include "SinglePlotPanel.h"
 
 #include "DataCollector.h"
+#include "TimingZones.h"
+#include "TraceDecimation.h"
+#include "TrialHistory.h"
 #include "TriggerSource.h"
 #include "TriggeredAvgCanvas.h"
 
+#include <optional>
+
 using namespace TriggeredAverage;
 const static Colour panelBackground { 30, 30, 40 };
 
-SinglePlotPanel::SinglePlotPanel (const GridDisplay* display_,
+namespace TriggeredAverage
+{
+/** Hover crosshair above the traces; moving it only repaints the strips under its lines */
+class CrosshairOverlay : public Component
+{
+public:
+    CrosshairOverlay() { setInterceptsMouseClicks (false, false); }
+
+    void setPosition (std::optional<Point<float>> newPosition)
+    {
+        if (newPosition == position)
+            return;
+
+        repaintLines();
+        position = newPosition;
+        repaintLines();
+    }
+
+    void paint (Graphics& g) override
+    {
+        if (! position)
+            return;
+
+        g.setColour (Colours::white.withAlpha (0.6f));
+        g.drawVerticalLine (roundToInt (position->x), 0.0f, static_cast<float> (getHeight()));
+        g.drawHorizontalLine (roundToInt (position->y), 0.0f, static_cast<float> (getWidth()));
+    }
+
+private:
+    void repaintLines()
+    {
+        if (! position)
+            return;
+
+        repaint (roundToInt (position->x) - 1, 0, 3, getHeight());
+        repaint (0, roundToInt (position->y) - 1, getWidth(), 3);
+    }
+
+    std::optional<Point<float>> position;
+};
+} // namespace TriggeredAverage
+
+SinglePlotPanel::SinglePlotPanel (GridDisplay* display_,
                                   const ContinuousChannel* channel,
-                                  const TriggerSource* source_,
+                                  ConditionId conditionId,
                                   int channelIndexInAverageBuffer_,
                                   const MultiChannelAverageBuffer* avgBuffer)
     : streamId (channel->getStreamId()),
       contChannel (channel),
-      baseColour (source_->colour),
-      m_triggerSource (source_),
+      baseColour (display_->getConditionColour (conditionId)),
+      m_conditionId (conditionId),
       m_parentGrid (display_),
       m_averageBuffer (avgBuffer),
       waitingForWindowToClose (false),
       m_sampleRate (channel->getSampleRate()),
-      channelIndexInAverageBuffer (channelIndexInAverageBuffer_)
+      channelIndexInAverageBuffer (channelIndexInAverageBuffer_),
+      layers { { conditionId, channelIndexInAverageBuffer_ } },
+      densityImages (1)
 {
     pre_ms = 0;
     post_ms = 0;
@@ -50,7 +99,7 @@ SinglePlotPanel::SinglePlotPanel (const GridDisplay* display_,
     conditionLabel = std::make_unique<Label> ("condition label");
     conditionLabel->setFont (font16pt);
     conditionLabel->setJustificationType (Justification::topLeft);
-    conditionLabel->setText (m_triggerSource->name, dontSendNotification);
+    conditionLabel->setText (display_->getConditionName (conditionId), dontSendNotification);
     conditionLabel->setColour (Label::textColourId, baseColour);
     addAndMakeVisible (conditionLabel.get());
 
@@ -68,9 +117,14 @@ SinglePlotPanel::SinglePlotPanel (const GridDisplay* display_,
     trialCounter->setColour (Label::textColourId, baseColour);
     addAndMakeVisible (trialCounter.get());
 
+    crosshair = std::make_unique<CrosshairOverlay>();
+    addAndMakeVisible (crosshair.get());
+
     clear();
 }
 
+SinglePlotPanel::~SinglePlotPanel() = default;
+
 void SinglePlotPanel::resized()
 {
     int labelOffset;
@@ -80,6 +134,7 @@ void SinglePlotPanel::resized()
         labelOffset = 5;
     else
         labelOffset = width - 150;
+    labelOffsetPx = labelOffset;
 
     if (labelOffset == 5)
         panelWidthPx = width - labelOffset;
@@ -87,6 +142,7 @@ void SinglePlotPanel::resized()
         panelWidthPx = labelOffset - 10;
 
     panelHeightPx = (getHeight() - 10);
+    crosshair->setBounds (0, 0, panelWidthPx, panelHeightPx);
 
     infoLabel->setBounds (labelOffset, 10, 150, 30);
 
@@ -114,13 +170,9 @@ void SinglePlotPanel::resized()
     }
     else
     {
-        conditionLabel->setVisible (true);
+        // in overlay mode, the names of all conditions are drawn by paint()
+        conditionLabel->setVisible (! overlayMode);
         channelLabel->setVisible (! overlayMode);
-
-        if (overlayMode)
-        {
-            conditionLabel->setBounds (labelOffset, 49 + 18 * overlayIndex, 150, 15);
-        }
     }
 }
 
@@ -148,11 +200,16 @@ void SinglePlotPanel::setPlotType (TriggeredAverage::DisplayMode plotType)
             plotAverage = true;
             plotAllTraces = true;
             break;
+        case DisplayMode::ERP_IMAGE:
+            plotAverage = false;
+            plotAllTraces = false;
+            break;
         default:
             plotAverage = true;
             plotAllTraces = false;
             break;
     }
+    showErpImage = plotType == DisplayMode::ERP_IMAGE;
 
     repaint();
 }
@@ -169,97 +226,525 @@ void SinglePlotPanel::setSourceName (const String& name) const
     conditionLabel->setText (name, dontSendNotification);
 }
 
-void SinglePlotPanel::drawBackground (bool shouldDraw)
+void SinglePlotPanel::setOverlayMode (bool shouldOverlay)
 {
-    shouldDrawBackground = shouldDraw;
+    if (overlayMode == shouldOverlay)
+        return;
 
-    infoLabel->setVisible (shouldDrawBackground);
+    overlayMode = shouldOverlay;
+    resized();
 }
 
-void SinglePlotPanel::setOverlayMode (bool shouldOverlay) { overlayMode = shouldOverlay; }
+void SinglePlotPanel::setOverlayConditions (const std::vector<ConditionLayer>& others)
+{
+    if (std::equal (layers.begin() + 1, layers.end(), others.begin(), others.end()))
+        return;
 
-void SinglePlotPanel::setOverlayIndex (int index)
+    layers.resize (1);
+    layers.insert (layers.end(), others.begin(), others.end());
+    densityImages.assign (layers.size(), {});
+    repaint();
+}
+
+bool SinglePlotPanel::showsCondition (ConditionId id) const
 {
-    overlayIndex = index;
-    resized();
+    return std::any_of (layers.begin(),
+                        layers.end(),
+                        [id] (const ConditionLayer& layer) { return layer.conditionId == id; });
+}
+
+Colour SinglePlotPanel::getLayerColour (size_t layer) const
+{
+    return layer == 0 ? baseColour : m_parentGrid->getConditionColour (layers[layer].conditionId);
 }
 
 void SinglePlotPanel::update() { numTrials++; }
 
-void SinglePlotPanel::paint (Graphics& g)
+SinglePlotPanel::TraceImageKey
+    SinglePlotPanel::getTraceImageKey (const std::vector<RenderLayer>& renderLayers) const
 {
-    if (shouldDrawBackground)
-        g.fillAll (panelBackground);
+    TraceImageKey key { .width = getWidth(),
+                        .height = getHeight(),
+                        .scale = Component::getApproximateScaleFactorForComponent (this),
+                        .plotAverage = plotAverage,
+                        .valueRange = getValueRange() };
+
+    key.layers.reserve (renderLayers.size());
+    for (const auto& layer : renderLayers)
+        key.layers.push_back ({ layer.snapshot ? layer.snapshot->version : 0, layer.colour });
+    return key;
+}
 
-    if (plotAverage && m_averageBuffer)
+juce::Range<float> SinglePlotPanel::getValueRange() const
+{
+    juce::Range<float> range;
+    for (const auto& layer : layers)
     {
-        // Draw average trace
-        auto avgBuffer = m_averageBuffer->getAverage();
-        auto nSamples = avgBuffer.getNumSamples();
-        auto nChannels = avgBuffer.getNumChannels();
+        const auto layerRange = m_parentGrid->getValueRange (
+            contChannel, layer.conditionId, layer.channelIndexInAverageBuffer);
+        if (! layerRange.isEmpty())
+            range = range.isEmpty() ? layerRange : range.getUnionWith (layerRange);
+    }
+    return range;
+}
 
-        if (avgBuffer.getNumSamples() > 0 && avgBuffer.getNumChannels() > 0)
-        {
-            const int numSamples = avgBuffer.getNumSamples();
-            const float* channelData =
-                avgBuffer.getReadPointer (channelIndexInAverageBuffer); // First channel
-
-            // Calculate min/max for scaling
-            float minVal = channelData[0];
-            float maxVal = channelData[0];
-            for (int i = 1; i < numSamples; ++i)
+namespace TriggeredAverage
+{
+class TraceRasterJob : public ThreadPoolJob
+{
+public:
+    TraceRasterJob (SinglePlotPanel* panel, SinglePlotPanel::TraceRenderRequest request)
+        : ThreadPoolJob ("TriggeredAvg: rasterize traces"),
+          m_panel (panel),
+          m_request (std::move (request))
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        auto image = SinglePlotPanel::rasterizeTraces (m_request);
+        MessageManager::callAsync (
+            [panel = m_panel, image = std::move (image), key = m_request.key]() mutable
             {
-                minVal = std::min (minVal, channelData[i]);
-                maxVal = std::max (maxVal, channelData[i]);
-            }
+                if (panel != nullptr)
+                    panel->setTraceImage (std::move (image), key);
+            });
+        return jobHasFinished;
+    }
+
+private:
+    Component::SafePointer<SinglePlotPanel> m_panel;
+    SinglePlotPanel::TraceRenderRequest m_request;
+};
+} // namespace TriggeredAverage
+
+void SinglePlotPanel::requestTraceImage()
+{
+    std::vector<RenderLayer> renderLayers;
+    renderLayers.reserve (layers.size());
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        renderLayers.push_back ({ m_parentGrid->getAverageSnapshot (layers[i].conditionId),
+                                  layers[i].channelIndexInAverageBuffer,
+                                  getLayerColour (i) });
+    }
+
+    auto key = getTraceImageKey (renderLayers);
+    if (rasterJobInFlight || (key == traceImageKey && ! traceImage.isNull()))
+        return;
+
+    // one job per panel at a time; the next paint picks up changes made meanwhile
+    rasterJobInFlight = true;
+    TraceRenderRequest request { .key = std::move (key),
+                                 .plotWidthPx = panelWidthPx,
+                                 .plotHeightPx = panelHeightPx,
+                                 .layers = std::move (renderLayers) };
+    m_parentGrid->getRasterPool().addJob (new TraceRasterJob (this, std::move (request)), true);
+}
+
+void SinglePlotPanel::dataUpdated()
+{
+    // both images are read from the data store while painting
+    if (showErpImage || plotAllTraces)
+        repaint();
+    else
+        requestTraceImage();
+}
+
+void SinglePlotPanel::setErpSmoothing (int numTrials)
+{
+    if (numTrials == erpSmoothing || numTrials < 1)
+        return;
+
+    erpSmoothing = numTrials;
+    // the smoothed rows have to be recomputed from the stored trials
+    erpGeneration = 0;
+    repaint();
+}
 
-            float range = maxVal - minVal;
-            if (range < 1e-6f)
-                range = 1.0f;
+void SinglePlotPanel::updateErpImage()
+{
+    auto* store = m_parentGrid->getDataStore();
+    if (store == nullptr)
+        return;
+
+    auto lock = store->GetLock();
+    const auto* history = store->getTrialHistory (m_conditionId);
+    if (history == nullptr || channelIndexInAverageBuffer >= history->getNumChannels())
+    {
+        erpImage = {};
+        erpGeneration = 0;
+        return;
+    }
+
+    const auto numTrialsAdded = history->getNumTrialsAdded();
+    bool mustRebuild = history->getGeneration() != erpGeneration
+                       || erpNextTrial < history->getFirstStoredTrial();
+
+    // a trial far outside the current colour range rescales the whole image
+    for (auto t = erpNextTrial; ! mustRebuild && t < numTrialsAdded; ++t)
+    {
+        const auto extremes = FloatVectorOperations::findMinAndMax (
+            history->getTrial (channelIndexInAverageBuffer, t), history->getNumColumns());
+        const float limit = erpRange.getEnd();
+        mustRebuild = extremes.getEnd() > 2.0f * limit || extremes.getStart() < -2.0f * limit;
+    }
+
+    if (mustRebuild)
+    {
+        rebuildErpImage (*history);
+        return;
+    }
+
+    for (auto t = erpNextTrial; t < numTrialsAdded; ++t)
+        appendErpRow (*history, t);
+
+    erpFirstTrial = history->getFirstStoredTrial();
+}
+
+void SinglePlotPanel::rebuildErpImage (const TrialHistory& history)
+{
+    const int numColumns = history.getNumColumns();
+    const auto firstTrial = history.getFirstStoredTrial();
+    const auto numTrialsAdded = history.getNumTrialsAdded();
+
+    erpGeneration = history.getGeneration();
+    erpFirstTrial = firstTrial;
+    erpNextTrial = firstTrial;
+
+    if (erpImage.getWidth() != numColumns || erpImage.getHeight() != history.getCapacity())
+        erpImage = Image (Image::ARGB, numColumns, history.getCapacity(), true);
+
+    // symmetric around zero so that the diverging map keeps zero white
+    float limit = 0.0f;
+    for (auto t = firstTrial; t < numTrialsAdded; ++t)
+    {
+        const auto extremes = FloatVectorOperations::findMinAndMax (
+            history.getTrial (channelIndexInAverageBuffer, t), numColumns);
+        limit = jmax (limit, std::abs (extremes.getStart()), std::abs (extremes.getEnd()));
+    }
+    if (limit < 1e-6f)
+        limit = 1.0f;
+    erpRange = { -limit, limit };
 
-            // Create path for average trace
-            Path averagePath;
-            for (int i = 0; i < numSamples; ++i)
+    erpRunningSum.assign (static_cast<size_t> (numColumns), 0.0f);
+    erpRowValues.resize (static_cast<size_t> (numColumns));
+    erpScratch.resize (static_cast<size_t> (numColumns));
+    erpSmoothingWindow.clear();
+
+    for (auto t = firstTrial; t < numTrialsAdded; ++t)
+        appendErpRow (history, t);
+}
+
+void SinglePlotPanel::appendErpRow (const TrialHistory& history, std::uint64_t trialIndex)
+{
+    const int numColumns = history.getNumColumns();
+    const float* trial = history.getTrial (channelIndexInAverageBuffer, trialIndex);
+
+    // slide the smoothing window: subtract the trial that leaves, add the one that enters
+    std::vector<float> row;
+    if (static_cast<int> (erpSmoothingWindow.size()) >= erpSmoothing)
+    {
+        row = std::move (erpSmoothingWindow.front());
+        erpSmoothingWindow.pop_front();
+        FloatVectorOperations::subtract (erpRunningSum.data(), row.data(), numColumns);
+    }
+    row.assign (trial, trial + numColumns);
+    FloatVectorOperations::add (erpRunningSum.data(), trial, numColumns);
+    erpSmoothingWindow.push_back (std::move (row));
+
+    FloatVectorOperations::multiply (erpRowValues.data(),
+                                     erpRunningSum.data(),
+                                     1.0f / static_cast<float> (erpSmoothingWindow.size()),
+                                     numColumns);
+
+    const auto capacity = static_cast<std::uint64_t> (erpImage.getHeight());
+    const int slot = static_cast<int> (trialIndex % capacity);
+    Image::BitmapData pixels (erpImage, 0, slot, numColumns, 1, Image::BitmapData::writeOnly);
+    erpColourMap.mapValues (erpRowValues.data(),
+                            numColumns,
+                            erpRange,
+                            reinterpret_cast<std::uint32_t*> (pixels.getLinePointer (0)),
+                            erpScratch.data());
+
+    erpNextTrial = trialIndex + 1;
+}
+
+void SinglePlotPanel::drawErpImage (Graphics& g) const
+{
+    const auto numRows = static_cast<int> (erpNextTrial - erpFirstTrial);
+    if (erpImage.isNull() || numRows <= 0 || panelWidthPx <= 0)
+        return;
+
+    // oldest trial at the top; the circular image is drawn in up to two parts
+    const int capacity = erpImage.getHeight();
+    const int firstSlot = static_cast<int> (erpFirstTrial % static_cast<uint64> (capacity));
+    const int rowsBeforeWrap = jmin (numRows, capacity - firstSlot);
+    const float rowHeight = static_cast<float> (panelHeightPx) / static_cast<float> (numRows);
+    const int width = erpImage.getWidth();
+
+    g.setImageResamplingQuality (Graphics::lowResamplingQuality);
+    g.drawImage (erpImage,
+                 0,
+                 0,
+                 panelWidthPx,
+                 roundToInt (rowHeight * static_cast<float> (rowsBeforeWrap)),
+                 0,
+                 firstSlot,
+                 width,
+                 rowsBeforeWrap);
+
+    if (rowsBeforeWrap < numRows)
+    {
+        const int top = roundToInt (rowHeight * static_cast<float> (rowsBeforeWrap));
+        g.drawImage (erpImage,
+                     0,
+                     top,
+                     panelWidthPx,
+                     panelHeightPx - top,
+                     0,
+                     0,
+                     width,
+                     numRows - rowsBeforeWrap);
+    }
+}
+
+void SinglePlotPanel::updateDensityImages()
+{
+    auto* store = m_parentGrid->getDataStore();
+    if (store == nullptr)
+        return;
+
+    auto lock = store->GetLock();
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        auto& target = densityImages[i];
+        const int channel = layers[i].channelIndexInAverageBuffer;
+        const auto* density = store->getTraceDensity (layers[i].conditionId);
+        if (density == nullptr || channel >= density->getNumChannels()
+            || density->getNumTrials() == 0)
+        {
+            target = {};
+            continue;
+        }
+
+        const auto colour = getLayerColour (i);
+        if (density->getVersion() == target.version && target.colour == colour)
+            continue;
+
+        target.version = density->getVersion();
+        target.colour = colour;
+        target.range = density->getAmplitudeRange (channel);
+
+        const int numColumns = density->getNumColumns();
+        const int numRows = density->getNumRows();
+        if (target.image.getWidth() != numColumns || target.image.getHeight() != numRows)
+            target.image = Image (Image::ARGB, numColumns, numRows, false);
+
+        std::array<PixelARGB, 256> palette;
+        for (size_t alpha = 0; alpha < palette.size(); ++alpha)
+            palette[alpha] = colour.withAlpha (static_cast<float> (alpha) / 255.0f).getPixelARGB();
+
+        // log scaling keeps rare excursions visible next to the dense core of the traces
+        const float scale =
+            255.0f / std::log1p (static_cast<float> (density->getMaxCount (channel)));
+        const std::uint32_t* counts = density->getCounts (channel);
+
+        Image::BitmapData pixels (target.image, Image::BitmapData::writeOnly);
+        for (int row = 0; row < numRows; ++row)
+        {
+            auto* line = reinterpret_cast<PixelARGB*> (pixels.getLinePointer (row));
+            const std::uint32_t* rowCounts = counts + row * numColumns;
+            for (int column = 0; column < numColumns; ++column)
             {
-                float x = (static_cast<float> (i) / static_cast<float> (numSamples - 1))
-                          * static_cast<float> (panelWidthPx);
-                float normalizedValue = (channelData[i] - minVal) / range;
-                float y = static_cast<float> (panelHeightPx) * (1.0f - normalizedValue);
-
-                if (i == 0)
-                    averagePath.startNewSubPath (x, y);
-                else
-                    averagePath.lineTo (x, y);
+                const auto count = static_cast<float> (rowCounts[column]);
+                line[column] =
+                    palette[static_cast<size_t> (roundToInt (std::log1p (count) * scale))];
             }
+        }
+    }
+}
+
+void SinglePlotPanel::drawDensityImages (Graphics& g) const
+{
+    const auto valueRange = getValueRange();
+    const auto height = static_cast<float> (panelHeightPx);
 
-            g.setColour (baseColour);
-            g.strokePath (averagePath, PathStrokeType (2.0f));
+    Graphics::ScopedSaveState saveState (g);
+    g.reduceClipRegion (0, 0, panelWidthPx, panelHeightPx);
+
+    // place each density's amplitude range within the panel's (possibly shared) range
+    for (const auto& density : densityImages)
+    {
+        if (density.image.isNull())
+            continue;
+
+        const auto range = valueRange.isEmpty() ? density.range : valueRange;
+        auto toY = [&] (float value)
+        { return height * (1.0f - (value - range.getStart()) / range.getLength()); };
+
+        const float top = toY (density.range.getEnd());
+        g.drawImage (density.image,
+                     Rectangle<float> (0.0f,
+                                       top,
+                                       static_cast<float> (panelWidthPx),
+                                       toY (density.range.getStart()) - top));
+    }
+}
+
+void SinglePlotPanel::drawConditionNames (Graphics& g) const
+{
+    if (labelOffsetPx == 5)
+        return;
+
+    g.setFont (FontOptions (16.0f));
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        g.setColour (getLayerColour (i));
+        g.drawText (m_parentGrid->getConditionName (layers[i].conditionId),
+                    labelOffsetPx,
+                    49 + 18 * static_cast<int> (i),
+                    150,
+                    15,
+                    Justification::topLeft,
+                    true);
+    }
+}
+
+void SinglePlotPanel::setTraceImage (Image image, const TraceImageKey& key)
+{
+    rasterJobInFlight = false;
+    traceImage = std::move (image);
+    traceImageKey = key;
+    repaint();
+}
+
+Image SinglePlotPanel::rasterizeTraces (const TraceRenderRequest& request)
+{
+    const auto& key = request.key;
+    const int imageWidth = roundToInt (static_cast<float> (key.width) * key.scale);
+    const int imageHeight = roundToInt (static_cast<float> (key.height) * key.scale);
+
+    Image image (
+        Image::ARGB, jmax (1, imageWidth), jmax (1, imageHeight), true, SoftwareImageType());
+    {
+        Graphics g (image);
+        g.addTransform (AffineTransform::scale (key.scale));
+        drawTraces (g, request);
+    }
+    return image;
+}
+
+void SinglePlotPanel::drawTraces (Graphics& g, const TraceRenderRequest& request)
+{
+    const auto& key = request.key;
+    const int plotWidthPx = request.plotWidthPx;
+    const int plotHeightPx = request.plotHeightPx;
+
+    if (! key.plotAverage || plotWidthPx <= 1)
+        return;
+
+    // one min/max pair per pixel keeps the path size independent of the window length
+    std::vector<std::vector<MinMaxColumn>> decimatedTraces (request.layers.size());
+    juce::Range<float> fittedRange;
+    for (size_t layer = 0; layer < request.layers.size(); ++layer)
+    {
+        const auto& snapshot = request.layers[layer].snapshot;
+        const int channel = request.layers[layer].channelIndex;
+        if (snapshot == nullptr || snapshot->mean.getNumSamples() <= 1
+            || snapshot->mean.getNumChannels() <= channel)
+            continue;
+
+        const int nSamples = snapshot->mean.getNumSamples();
+        const float* channelData = snapshot->mean.getReadPointer (channel);
+        auto& decimatedTrace = decimatedTraces[layer];
+        decimatedTrace.resize (static_cast<size_t> (std::min (nSamples, plotWidthPx)));
+        if (nSamples > plotWidthPx)
+        {
+            snapshot->pyramids[channel].decimate (0, nSamples, decimatedTrace);
+        }
+        else
+        {
+            for (int i = 0; i < nSamples; ++i)
+                decimatedTrace[i] = { channelData[i], channelData[i] };
         }
+
+        const auto traceRange = getRange (decimatedTrace);
+        fittedRange =
+            fittedRange.isEmpty() ? traceRange : fittedRange.getUnionWith (traceRange);
     }
 
-    if (plotAllTraces)
+    // all conditions share one scale
+    const auto valueRange = key.valueRange.isEmpty() ? fittedRange : key.valueRange;
+    const float minVal = valueRange.getStart();
+    float range = valueRange.getLength();
+    if (range < 1e-6f)
+        range = 1.0f;
+
+    auto toY = [&] (float value)
+    { return static_cast<float> (plotHeightPx) * (1.0f - (value - minVal) / range); };
+
+    for (size_t layer = 0; layer < request.layers.size(); ++layer)
     {
-        // TODO: draw all traces
-        // draw a test line with random numbers across the range for now
-        g.setColour (baseColour);
-        Path allTracesPath;
-        const int numSamples = 100;
-        for (int i = 0; i < numSamples; ++i)
+        const auto& decimatedTrace = decimatedTraces[layer];
+        const int numColumns = static_cast<int> (decimatedTrace.size());
+        if (numColumns <= 1)
+            continue;
+
+        Path averagePath;
+        averagePath.preallocateSpace (6 * numColumns);
+        for (int i = 0; i < numColumns; ++i)
         {
-            float x = (static_cast<float> (i) / static_cast<float> (numSamples - 1))
-                      * static_cast<float> (panelWidthPx);
-            float y = static_cast<float> (panelHeightPx)
-                      * (0.2f + 0.6f * static_cast<float> (std::rand()) / RAND_MAX);
+            const float x = (static_cast<float> (i) / static_cast<float> (numColumns - 1))
+                            * static_cast<float> (plotWidthPx);
+            const auto& column = decimatedTrace[i];
+
             if (i == 0)
-                allTracesPath.startNewSubPath (x, y);
+                averagePath.startNewSubPath (x, toY (column.max));
             else
-                allTracesPath.lineTo (x, y);
+                averagePath.lineTo (x, toY (column.max));
+
+            if (column.min != column.max)
+                averagePath.lineTo (x, toY (column.min));
         }
-        g.strokePath (allTracesPath, PathStrokeType (1.0f));
 
+        g.setColour (request.layers[layer].colour);
+        g.strokePath (averagePath, PathStrokeType (2.0f));
+    }
+}
+
+void SinglePlotPanel::paint (Graphics& g)
+{
+    TRIGGERED_AVG_TIMING_ZONE ("SinglePlotPanel::paint");
+    const double paintStart = Time::getMillisecondCounterHiRes();
 
+    g.fillAll (panelBackground);
 
+    if (showErpImage)
+    {
+        updateErpImage();
+        drawErpImage (g);
     }
+    else
+    {
+        if (plotAllTraces)
+        {
+            updateDensityImages();
+            drawDensityImages (g);
+        }
+
+        // the traces are rasterized on the grid's thread pool; until a new image arrives the
+        // previous one is stretched over the panel
+        requestTraceImage();
+        if (! traceImage.isNull())
+            g.drawImage (traceImage, getLocalBounds().toFloat());
+    }
+
+    if (auto snapshot = m_parentGrid->getAverageSnapshot (m_conditionId))
+        numTrials = static_cast<size_t> (snapshot->numTrials);
+
+    if (overlayMode)
+        drawConditionNames (g);
 
     auto trialCounterString = String (numTrials);
     trialCounter->setText (trialCounterString, dontSendNotification);
@@ -268,23 +753,53 @@ void SinglePlotPanel::paint (Graphics& g)
     // t = 0
     float zeroLoc = (pre_ms) / (pre_ms + post_ms) * static_cast<float> (panelWidthPx);
     g.drawLine (zeroLoc, 0, zeroLoc, static_cast<float> (getHeight()), 2.0);
+
+    m_parentGrid->addPaintTime (Time::getMillisecondCounterHiRes() - paintStart);
 }
 
 void SinglePlotPanel::mouseMove (const MouseEvent& event)
 {
-    if (event.getPosition().x < panelWidthPx)
+    // read straight from the cached snapshot; only the label and the crosshair repaint
+    const auto snapshot = m_parentGrid->getAverageSnapshot (m_conditionId);
+    const int channel = channelIndexInAverageBuffer;
+    if (showErpImage || event.x >= panelWidthPx || snapshot == nullptr
+        || snapshot->mean.getNumSamples() < 2 || channel >= snapshot->mean.getNumChannels())
     {
-        String hoverString = "TODO";
-        hoverLabel->setText (hoverString, dontSendNotification);
+        clearHover();
+        return;
+    }
 
-        repaint();
+    const int numSamples = snapshot->mean.getNumSamples();
+    const float position =
+        jlimit (0.0f, 1.0f, static_cast<float> (event.x) / static_cast<float> (panelWidthPx));
+    const int sample = roundToInt (position * static_cast<float> (numSamples - 1));
+    const double timeMs = (sample - snapshot->numPreSamples) * 1000.0 / m_sampleRate;
+    const float mean = snapshot->mean.getSample (channel, sample);
+    const float sd = snapshot->standardDeviation.getSample (channel, sample);
+
+    hoverLabel->setText (String (timeMs, 1) + " ms\nmean: " + String (mean, 2) + "\nSD: "
+                             + String (sd, 2) + ", n: " + String (snapshot->trialCounts[sample]),
+                         dontSendNotification);
+
+    // on the same scale as the traces
+    const auto valueRange = getValueRange();
+    float y = static_cast<float> (panelHeightPx) * 0.5f;
+    if (valueRange.getLength() > 1e-6f)
+    {
+        y = static_cast<float> (panelHeightPx)
+            * (1.0f - (mean - valueRange.getStart()) / valueRange.getLength());
     }
+    const float x = static_cast<float> (sample) / static_cast<float> (numSamples - 1)
+                    * static_cast<float> (panelWidthPx);
+    crosshair->setPosition (Point<float> (x, y));
 }
 
-void SinglePlotPanel::mouseExit (const MouseEvent& event)
+void SinglePlotPanel::mouseExit (const MouseEvent& event) { clearHover(); }
+
+void SinglePlotPanel::clearHover()
 {
     hoverLabel->setText ("", dontSendNotification);
-    repaint();
+    crosshair->setPosition (std::nullopt);
 }
 
 void SinglePlotPanel::comboBoxChanged (ComboBox* comboBox)
@@ -305,8 +820,9 @@ DynamicObject SinglePlotPanel::getInfo() const
     DynamicObject info;
 
     info.setProperty (Identifier ("channel"), var (contChannel->getName()));
-    info.setProperty (Identifier ("condition"), var (m_triggerSource->name));
-    info.setProperty (Identifier ("color"), var (m_triggerSource->colour.toString()));
+    info.setProperty (Identifier ("condition"),
+                      var (m_parentGrid->getConditionName (m_conditionId)));
+    info.setProperty (Identifier ("color"), var (baseColour.toString()));
     info.setProperty (Identifier ("trial_count"), var (int (numTrials)));
 
     return info;
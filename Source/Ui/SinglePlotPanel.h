@@ -1,22 +1,29 @@
 #pragma once
+#include "ColourMap.h"
+#include "TriggerSource.h"
 
 #include <VisualizerWindowHeaders.h>
+#include <deque>
 
 namespace TriggeredAverage
 {
 class MultiChannelAverageBuffer;
+struct AverageSnapshot;
 enum class DisplayMode : std::uint8_t;
 class GridDisplay;
 class TriggerSource;
+class TrialHistory;
+class CrosshairOverlay;
 
 class SinglePlotPanel : public Component, public ComboBox::Listener
 {
 public:
-    SinglePlotPanel (const GridDisplay*,
+    SinglePlotPanel (GridDisplay*,
                      const ContinuousChannel*,
-                     const TriggerSource*,
+                     ConditionId,
                      int channelIndexInAverageBuffer,
                      const MultiChannelAverageBuffer*);
+    ~SinglePlotPanel() override;
 
     void paint (Graphics& g) override;
     void resized() override;
@@ -27,24 +34,116 @@ public:
     void setSourceColour (Colour colour);
 
     void setSourceName (const String& name) const;
-    void drawBackground (bool);
     void setOverlayMode (bool);
-    void setOverlayIndex (int index);
+
+    /** A condition drawn by this panel */
+    struct ConditionLayer
+    {
+        ConditionId conditionId;
+        int channelIndexInAverageBuffer;
+
+        bool operator== (const ConditionLayer&) const = default;
+    };
+
+    /** In overlay mode, the other conditions of this channel, drawn in the same pass and on
+        the same scale as the panel's own condition */
+    void setOverlayConditions (const std::vector<ConditionLayer>& others);
+    bool showsCondition (ConditionId id) const;
+
     void mouseMove (const MouseEvent& event) override;
     void mouseExit (const MouseEvent& event) override;
     void comboBoxChanged (ComboBox* comboBox) override;
     void update();
 
+    /** Starts rasterizing the traces on the grid's thread pool if the cached image no longer
+        matches the condition's data or the display. The panel repaints once it is done. */
+    void requestTraceImage();
+
+    /** Called by the grid when new trials arrived for one of this panel's conditions */
+    void dataUpdated();
+
+    /** Number of neighbouring trials averaged into each row of the ERP image */
+    void setErpSmoothing (int numTrials);
+
     uint16 streamId;
     const ContinuousChannel* contChannel;
     DynamicObject getInfo() const;
+    ConditionId getConditionId() const { return m_conditionId; }
+    int getChannelIndex() const { return channelIndexInAverageBuffer; }
+
+    struct LayerKey
+    {
+        std::uint64_t version = 0;
+        Colour colour;
+
+        bool operator== (const LayerKey&) const = default;
+    };
+
+    // everything the rasterized traces depend on
+    struct TraceImageKey
+    {
+        // one per condition drawn, the panel's own first
+        std::vector<LayerKey> layers;
+        int width = 0;
+        int height = 0;
+        float scale = 1.0f;
+        bool plotAverage = false;
+        // vertical range chosen by the grid's scale mode; empty to fit the averages
+        juce::Range<float> valueRange;
+
+        bool operator== (const TraceImageKey&) const = default;
+    };
+
+    struct RenderLayer
+    {
+        std::shared_ptr<const AverageSnapshot> snapshot;
+        int channelIndex = 0;
+        Colour colour;
+    };
+
+    /** Self-contained description of one rasterization, safe to hand to another thread */
+    struct TraceRenderRequest
+    {
+        TraceImageKey key;
+        int plotWidthPx = 0;
+        int plotHeightPx = 0;
+        std::vector<RenderLayer> layers;
+    };
+
+    /** Renders the traces into a software image; called on the raster threads */
+    static Image rasterizeTraces (const TraceRenderRequest& request);
 
 private:
+    TraceImageKey getTraceImageKey (const std::vector<RenderLayer>& layers) const;
+    Colour getLayerColour (size_t layer) const;
+    /** Shared vertical range of all conditions drawn; empty to fit the averages */
+    juce::Range<float> getValueRange() const;
+    void setTraceImage (Image image, const TraceImageKey& key);
+    static void drawTraces (Graphics& g, const TraceRenderRequest& request);
+
+    // ERP image: one row per trial in a circular image, so a new trial only writes one row
+    void updateErpImage();
+    void rebuildErpImage (const TrialHistory& history);
+    void appendErpRow (const TrialHistory& history, std::uint64_t trialIndex);
+    void drawErpImage (Graphics& g) const;
+
+    // all traces: one density image per condition, placed on the shared scale
+    void updateDensityImages();
+    void drawDensityImages (Graphics& g) const;
+
+    // overlay mode: one coloured name per condition instead of the condition label
+    void drawConditionNames (Graphics& g) const;
+
+    void clearHover();
+
+    friend class TraceRasterJob;
+
     std::unique_ptr<Label> infoLabel;
     std::unique_ptr<Label> channelLabel;
     std::unique_ptr<Label> conditionLabel;
     std::unique_ptr<Label> hoverLabel;
     std::unique_ptr<Label> trialCounter;
+    std::unique_ptr<CrosshairOverlay> crosshair;
 
     bool plotAllTraces = true;
     bool plotAverage = true;
@@ -52,21 +151,51 @@ private:
 
     Colour baseColour;
 
-    const TriggerSource* m_triggerSource;
-    const GridDisplay* m_parentGrid;
+    const ConditionId m_conditionId;
+    GridDisplay* m_parentGrid;
     const MultiChannelAverageBuffer* m_averageBuffer;
 
     float pre_ms;
     float post_ms;
     int bin_size_ms;
-    int panelWidthPx;
-    int panelHeightPx;
-    bool shouldDrawBackground = true;
-    int overlayIndex = 0;
+    int panelWidthPx = 0;
+    int panelHeightPx = 0;
+    int labelOffsetPx = 0;
     bool overlayMode = false;
     bool waitingForWindowToClose;
     size_t numTrials = 0;
     const double m_sampleRate;
     int channelIndexInAverageBuffer;
+
+    // the panel's own condition first, then the overlaid ones
+    std::vector<ConditionLayer> layers;
+
+    Image traceImage;
+    TraceImageKey traceImageKey;
+    bool rasterJobInFlight = false;
+
+    bool showErpImage = false;
+    int erpSmoothing = 1;
+    Image erpImage;
+    std::uint64_t erpGeneration = 0; // 0 never matches a history, forcing a rebuild
+    std::uint64_t erpFirstTrial = 0;
+    std::uint64_t erpNextTrial = 0;
+    juce::Range<float> erpRange;
+    // running sum over the last erpSmoothing trials
+    std::vector<float> erpRunningSum;
+    std::deque<std::vector<float>> erpSmoothingWindow;
+    std::vector<float> erpRowValues;
+    std::vector<float> erpScratch;
+    const ColourMap erpColourMap = ColourMap::createDiverging();
+
+    // all traces: each condition's density histogram, converted to an alpha image on change
+    struct DensityImage
+    {
+        Image image;
+        std::uint64_t version = 0;
+        Colour colour;
+        juce::Range<float> range;
+    };
+    std::vector<DensityImage> densityImages;
 };
 } // namespace TriggeredAverage
@@ -1,6 +1,7 @@
 #include "TriggeredAvgCanvas.h"
 #include "GridDisplay.h"
 #include "TimeAxis.h"
+#include "TimingZones.h"
 #include "TriggeredAvgNode.h"
 
 #include <mfidl.h>
@@ -24,6 +25,15 @@ OptionsBar::OptionsBar (TriggeredAvgCanvas* canvas_, GridDisplay* display_, Time
     saveButton->setClickingTogglesState (false);
     addAndMakeVisible (saveButton.get());
 
+    if (TimingZones::isEnabled)
+    {
+        traceButton = std::make_unique<UtilityButton> ("TRACE");
+        traceButton->setFont (FontOptions (12.0f));
+        traceButton->addListener (this);
+        traceButton->setClickingTogglesState (false);
+        addAndMakeVisible (traceButton.get());
+    }
+
     plotTypeSelector = std::make_unique<ComboBox> ("Plot Type Selector");
 
     plotTypeSelector->addItemList (DisplayModeStrings, 1);
@@ -32,6 +42,13 @@ OptionsBar::OptionsBar (TriggeredAvgCanvas* canvas_, GridDisplay* display_, Time
     plotTypeSelector->addListener (this);
     addAndMakeVisible (plotTypeSelector.get());
 
+    scaleModeSelector = std::make_unique<ComboBox> ("Scale Mode Selector");
+    scaleModeSelector->addItemList (ScaleModeStrings, 1);
+    scaleModeSelector->setSelectedId (static_cast<int> (ScaleMode::PER_PANEL),
+                                      dontSendNotification);
+    scaleModeSelector->addListener (this);
+    addAndMakeVisible (scaleModeSelector.get());
+
     columnNumberSelector = std::make_unique<ComboBox> ("Column Number Selector");
     for (int i = 1; i < 7; i++)
         columnNumberSelector->addItem (String (i), i);
@@ -46,11 +63,31 @@ OptionsBar::OptionsBar (TriggeredAvgCanvas* canvas_, GridDisplay* display_, Time
     rowHeightSelector->addListener (this);
     addAndMakeVisible (rowHeightSelector.get());
 
+    frameRateSelector = std::make_unique<ComboBox> ("Frame Rate Selector");
+    for (int fps : { 5, 10, 20, 30, 60 })
+        frameRateSelector->addItem (String (fps), fps);
+    frameRateSelector->setSelectedId (30, dontSendNotification);
+    frameRateSelector->addListener (this);
+    addAndMakeVisible (frameRateSelector.get());
+
     overlayButton = std::make_unique<UtilityButton> ("OFF");
     overlayButton->setFont (FontOptions (12.0f));
     overlayButton->addListener (this);
     overlayButton->setClickingTogglesState (true);
     addAndMakeVisible (overlayButton.get());
+
+    erpSmoothingSelector = std::make_unique<ComboBox> ("ERP Smoothing Selector");
+    for (int numTrials : { 1, 3, 5, 10 })
+        erpSmoothingSelector->addItem (String (numTrials), numTrials);
+    erpSmoothingSelector->setSelectedId (1, dontSendNotification);
+    erpSmoothingSelector->addListener (this);
+    addAndMakeVisible (erpSmoothingSelector.get());
+
+    heatmapButton = std::make_unique<UtilityButton> ("OFF");
+    heatmapButton->setFont (FontOptions (12.0f));
+    heatmapButton->addListener (this);
+    heatmapButton->setClickingTogglesState (true);
+    addAndMakeVisible (heatmapButton.get());
 }
 
 void OptionsBar::buttonClicked (Button* button)
@@ -71,11 +108,17 @@ void OptionsBar::buttonClicked (Button* button)
 
         canvas->resized();
     }
+    else if (button == heatmapButton.get())
+    {
+        canvas->setHeatmapMode (button->getToggleState());
+        heatmapButton->setLabel (heatmapButton->getToggleState() ? "ON" : "OFF");
+    }
     else if (button == saveButton.get())
     {
         DynamicObject output = display->getInfo();
 
-        FileChooser chooser ("Save histogram statistics to file...", File(), "*.json");
+        // the panel summary goes into the chosen file, the data into .npy files next to it
+        FileChooser chooser ("Save averages to file...", File(), "*.json");
 
         if (chooser.browseForFileToSave (true))
         {
@@ -91,6 +134,20 @@ void OptionsBar::buttonClicked (Button* button)
                                     .withIndentLevel (5)
                                     .withSpacing (JSON::Spacing::multiLine)
                                     .withMaxDecimalPlaces (4));
+
+            canvas->getProcessor()->saveAveragesAsNpy (file.getParentDirectory(),
+                                                       file.getFileNameWithoutExtension());
+        }
+    }
+    else if (button == traceButton.get())
+    {
+        FileChooser chooser ("Save timing zones as Chrome trace...", File(), "*.json");
+
+        if (chooser.browseForFileToSave (true))
+        {
+            const auto result = TimingZones::writeChromeTrace (chooser.getResult());
+            if (result.failed())
+                CoreServices::sendStatusMessage (result.getErrorMessage());
         }
     }
 }
@@ -121,6 +178,18 @@ void OptionsBar::comboBoxChanged (ComboBox* comboBox)
 
         canvas->resized();
     }
+    else if (comboBox == scaleModeSelector.get())
+    {
+        display->setScaleMode (static_cast<ScaleMode> (comboBox->getSelectedId()));
+    }
+    else if (comboBox == erpSmoothingSelector.get())
+    {
+        display->setErpSmoothing (comboBox->getSelectedId());
+    }
+    else if (comboBox == frameRateSelector.get())
+    {
+        canvas->setMaxFramesPerSecond (comboBox->getSelectedId());
+    }
 }
 
 void OptionsBar::resized()
@@ -129,9 +198,19 @@ void OptionsBar::resized()
 
     clearButton->setBounds (getWidth() - 100, verticalOffset, 70, 25);
     saveButton->setBounds (getWidth() - 180, verticalOffset, 70, 25);
+    if (traceButton)
+        traceButton->setBounds (getWidth() - 260, verticalOffset, 70, 25);
 
     plotTypeSelector->setBounds (440, verticalOffset, 150, 25);
 
+    frameRateSelector->setBounds (650, verticalOffset, 55, 25);
+
+    heatmapButton->setBounds (765, verticalOffset, 35, 25);
+
+    erpSmoothingSelector->setBounds (870, verticalOffset, 50, 25);
+
+    scaleModeSelector->setBounds (975, verticalOffset, 105, 25);
+
     rowHeightSelector->setBounds (60, verticalOffset, 80, 25);
 
     columnNumberSelector->setBounds (200, verticalOffset, 50, 25);
@@ -154,6 +233,14 @@ void OptionsBar::paint (Graphics& g)
     g.drawText ("Conditions", 240, verticalOffset + 15, 93, 15, Justification::centredRight, false);
     g.drawText ("Plot", 390, verticalOffset, 43, 15, Justification::centredRight, false);
     g.drawText ("Type", 390, verticalOffset + 15, 43, 15, Justification::centredRight, false);
+    g.drawText ("Max", 600, verticalOffset, 43, 15, Justification::centredRight, false);
+    g.drawText ("FPS", 600, verticalOffset + 15, 43, 15, Justification::centredRight, false);
+    g.drawText ("Heatmap", 700, verticalOffset, 58, 15, Justification::centredRight, false);
+    g.drawText ("View", 700, verticalOffset + 15, 58, 15, Justification::centredRight, false);
+    g.drawText ("ERP", 805, verticalOffset, 58, 15, Justification::centredRight, false);
+    g.drawText ("Smoothing", 795, verticalOffset + 15, 68, 15, Justification::centredRight, false);
+    g.drawText ("Auto", 925, verticalOffset, 43, 15, Justification::centredRight, false);
+    g.drawText ("Scale", 925, verticalOffset + 15, 43, 15, Justification::centredRight, false);
 }
 
 void OptionsBar::saveCustomParametersToXml (XmlElement* xml) const
@@ -162,6 +249,10 @@ void OptionsBar::saveCustomParametersToXml (XmlElement* xml) const
     xml->setAttribute ("num_cols", columnNumberSelector->getSelectedId());
     xml->setAttribute ("row_height", rowHeightSelector->getSelectedId());
     xml->setAttribute ("overlay", overlayButton->getToggleState());
+    xml->setAttribute ("max_fps", frameRateSelector->getSelectedId());
+    xml->setAttribute ("heatmap", heatmapButton->getToggleState());
+    xml->setAttribute ("erp_smoothing", erpSmoothingSelector->getSelectedId());
+    xml->setAttribute ("scale_mode", scaleModeSelector->getSelectedId());
 }
 
 void OptionsBar::loadCustomParametersFromXml (XmlElement* xml)
@@ -170,24 +261,35 @@ void OptionsBar::loadCustomParametersFromXml (XmlElement* xml)
     rowHeightSelector->setSelectedId (xml->getIntAttribute ("row_height", 150), sendNotification);
     overlayButton->setToggleState (xml->getBoolAttribute ("overlay", false), sendNotification);
     plotTypeSelector->setSelectedId (xml->getIntAttribute ("plot_type", 1), sendNotification);
+    frameRateSelector->setSelectedId (xml->getIntAttribute ("max_fps", 30), sendNotification);
+    heatmapButton->setToggleState (xml->getBoolAttribute ("heatmap", false), sendNotification);
+    erpSmoothingSelector->setSelectedId (xml->getIntAttribute ("erp_smoothing", 1),
+                                         sendNotification);
+    scaleModeSelector->setSelectedId (
+        xml->getIntAttribute ("scale_mode", static_cast<int> (ScaleMode::PER_PANEL)),
+        sendNotification);
 }
 
 TriggeredAvgCanvas::TriggeredAvgCanvas (TriggeredAvgNode* processor_)
     : Visualizer (processor_),
+      m_processor (processor_),
       m_dataStore (processor_->getDataStore())
 {
     m_timeAxis = std::make_unique<TimeAxis>();
     addAndMakeVisible (m_timeAxis.get());
 
-    m_mainViewport = std::make_unique<Viewport>();
+    m_mainViewport = std::make_unique<GridViewport>();
     m_mainViewport->setScrollBarsShown (true, true);
 
-    m_grid = std::make_unique<GridDisplay>();
+    m_grid = std::make_unique<GridDisplay> (m_dataStore);
     m_mainViewport->setViewedComponent (m_grid.get(), false);
     m_mainViewport->setScrollBarThickness (15);
     addAndMakeVisible (m_mainViewport.get());
     m_grid->setBounds (0, 50, 500, 100);
 
+    m_heatmap = std::make_unique<HeatmapDisplay> (m_dataStore);
+    addChildComponent (m_heatmap.get());
+
     m_optionsBarHolder = std::make_unique<Viewport>();
     m_optionsBarHolder->setScrollBarsShown (false, true);
     m_optionsBarHolder->setScrollBarThickness (10);
@@ -219,9 +321,11 @@ void TriggeredAvgCanvas::resized()
     m_grid->setBounds (0, 0, getWidth() - scrollBarThickness, m_grid->getDesiredHeight());
     m_grid->resized();
 
+    m_heatmap->setBounds (m_mainViewport->getBounds());
+
     m_optionsBarHolder->setBounds (0, getHeight() - optionsBarHeight, getWidth(), optionsBarHeight);
 
-    int optionsWidth = getWidth() < 775 ? 775 : getWidth();
+    int optionsWidth = getWidth() < 1270 ? 1270 : getWidth();
     m_optionsBar->setBounds (0, 0, optionsWidth, m_optionsBarHolder->getHeight());
 }
 
@@ -239,6 +343,7 @@ void TriggeredAvgCanvas::setWindowSizeMs (float pre_ms_, float post_ms_)
     post_ms = post_ms_;
 
     m_grid->setWindowSizeMs (pre_ms, post_ms);
+    m_heatmap->setWindowSizeMs (pre_ms, post_ms);
     m_timeAxis->setWindowSizeMs (pre_ms, post_ms);
 
     repaint();
@@ -250,19 +355,52 @@ void TriggeredAvgCanvas::addContChannel (const ContinuousChannel* channel,
                                          const MultiChannelAverageBuffer* avgBuffer)
 {
     m_grid->addContChannel (channel, source, channelIndexInAverageBuffer, avgBuffer);
+    m_heatmap->addContChannel (channel, source, channelIndexInAverageBuffer);
 }
 
 void TriggeredAvgCanvas::updateColourForSource (const TriggerSource* source)
 {
     m_grid->updateColourForSource (source);
+    m_heatmap->updateColourForSource (source);
 }
 
 void TriggeredAvgCanvas::updateConditionName (const TriggerSource* source)
 {
     m_grid->updateConditionName (source);
+    m_heatmap->updateConditionName (source);
+}
+
+void TriggeredAvgCanvas::prepareToUpdate()
+{
+    m_grid->prepareToUpdate();
+    m_heatmap->prepareToUpdate();
+}
+
+void TriggeredAvgCanvas::removeConditions (const Array<ConditionId>& ids)
+{
+    m_grid->removeConditions (ids);
+    for (auto id : ids)
+        m_heatmap->removeCondition (id);
+}
+
+void TriggeredAvgCanvas::setConditionOrder (const Array<ConditionId>& order)
+{
+    m_grid->setConditionOrder (order);
+    m_heatmap->setConditionOrder (order);
 }
 
-void TriggeredAvgCanvas::prepareToUpdate() { m_grid->prepareToUpdate(); }
+void TriggeredAvgCanvas::setHeatmapMode (bool showHeatmap)
+{
+    m_heatmap->setVisible (showHeatmap);
+    m_mainViewport->setVisible (! showHeatmap);
+    refresh();
+}
+
+void TriggeredAvgCanvas::setMaxFramesPerSecond (int framesPerSecond)
+{
+    m_grid->setMaxFramesPerSecond (framesPerSecond);
+    m_heatmap->setMaxFramesPerSecond (framesPerSecond);
+}
 
 void TriggeredAvgCanvas::saveCustomParametersToXml (XmlElement* xml)
 {
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 #pragma once
 #include "GridDisplay.h"
+#include "HeatmapDisplay.h"
 #include "TimeAxis.h"
 #include "TriggeredAvgNode.h"
 #include <VisualizerWindowHeaders.h>
@@ -18,6 +19,7 @@ enum class DisplayMode : std::uint8_t
     INDIVIDUAL_TRACES = 1,
     AVERAGE_TRAGE = 2,
     ALL_AND_AVERAGE = 3,
+    ERP_IMAGE = 4,
 };
 
 constexpr auto DisplayModeModeToString (DisplayMode mode) -> const char*
@@ -33,13 +35,25 @@ constexpr auto DisplayModeModeToString (DisplayMode mode) -> const char*
             return "Average trace";
         case DisplayMode::ALL_AND_AVERAGE:
             return "Average + All";
+        case DisplayMode::ERP_IMAGE:
+            return "ERP image";
         default:
             return "Unknown";
     }
 }
 
 static const auto DisplayModeStrings =
-    StringArray { "All traces", "Average trace", "Average + All" };
+    StringArray { "All traces", "Average trace", "Average + All", "ERP image" };
+
+/** How the vertical range of the panels is shared */
+enum class ScaleMode : std::uint8_t
+{
+    PER_PANEL = 1,
+    PER_CHANNEL = 2, // same range for a channel across all conditions
+    GLOBAL = 3,
+};
+
+static const auto ScaleModeStrings = StringArray { "Per panel", "Per channel", "Global" };
 
 class OptionsBar : public Component, public Button::Listener, public ComboBox::Listener
 {
@@ -60,12 +74,18 @@ public:
 private:
     std::unique_ptr<UtilityButton> clearButton;
     std::unique_ptr<UtilityButton> saveButton;
+    // only with TRIGGERED_AVG_TIMING_ZONES
+    std::unique_ptr<UtilityButton> traceButton;
 
     std::unique_ptr<ComboBox> plotTypeSelector;
+    std::unique_ptr<ComboBox> scaleModeSelector;
 
     std::unique_ptr<ComboBox> columnNumberSelector;
     std::unique_ptr<ComboBox> rowHeightSelector;
+    std::unique_ptr<ComboBox> frameRateSelector;
+    std::unique_ptr<ComboBox> erpSmoothingSelector;
     std::unique_ptr<UtilityButton> overlayButton;
+    std::unique_ptr<UtilityButton> heatmapButton;
 
     GridDisplay* display;
     TriggeredAvgCanvas* canvas;
@@ -80,7 +100,9 @@ public:
 
     void refresh() override
     {
-        if (m_grid)
+        if (m_heatmap && m_heatmap->isVisible())
+            m_heatmap->refresh();
+        else if (m_grid)
             m_grid->refresh();
     }
     /** Called when the Visualizer's tab becomes visible after being hidden .*/
@@ -115,6 +137,18 @@ public:
     /** Prepare for update*/
     void prepareToUpdate();
 
+    /** Switches between the grid of line plots and one channel x time heatmap per condition */
+    void setHeatmapMode (bool showHeatmap);
+    void setMaxFramesPerSecond (int framesPerSecond);
+
+    TriggeredAvgNode* getProcessor() const { return m_processor; }
+
+    /** Incremental updates of the displayed conditions */
+    bool hasCondition (ConditionId id) const { return m_grid->hasCondition (id); }
+    Array<ConditionId> getConditionIds() const { return m_grid->getConditionIds(); }
+    void removeConditions (const Array<ConditionId>& ids);
+    void setConditionOrder (const Array<ConditionId>& order);
+
     // Visualizer calls refresh but we don't, unless new data was added (from Processor)
     void timerCallback() override {};
 
@@ -126,6 +160,7 @@ public:
 
 private:
     // dependencies
+    TriggeredAvgNode* m_processor;
     DataStore* m_dataStore;
 
     // data
@@ -136,6 +171,7 @@ private:
     std::unique_ptr<Viewport> m_mainViewport;
     std::unique_ptr<TimeAxis> m_timeAxis;
     std::unique_ptr<GridDisplay> m_grid;
+    std::unique_ptr<HeatmapDisplay> m_heatmap;
     std::unique_ptr<Viewport> m_optionsBarHolder;
     std::unique_ptr<OptionsBar> m_optionsBar;
 
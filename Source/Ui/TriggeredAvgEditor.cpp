@@ -50,28 +50,67 @@ void TriggeredAvgEditor::updateSettings()
     if (canvas == nullptr)
         return;
 
-    canvas->prepareToUpdate();
-
     TriggeredAvgNode* proc = dynamic_cast<TriggeredAvgNode*> (getProcessor());
     assert (proc);
     DataStore* store = (proc->getDataStore());
     assert (store);
 
-    store->Clear();
     const int nChannels = proc->getTotalContinuousChannels();
-    const int nSamples = proc->getNumberOfSamples();
+    const int nPreSamples = proc->getNumberOfPreSamples();
+    const int nPostSamples = proc->getNumberOfPostSamplesIncludingTrigger();
+
+    // panels reference the channel objects, which are recreated when the signal chain changes
+    Array<const ContinuousChannel*> channels;
+    for (int i = 0; i < nChannels; i++)
+        channels.add (proc->getContinuousChannel (i));
 
-    for (auto source : proc->getTriggerSources().getAll())
+    if (channels != displayedChannels)
     {
-        store->ResetAndResizeAverageBufferForTriggerSource (source, nChannels, nSamples);
-        for (int i = 0; i < proc->getTotalContinuousChannels(); i++)
-        {
-            const ContinuousChannel* channel = proc->getContinuousChannel (i);
+        canvas->prepareToUpdate();
+        displayedChannels = channels;
+    }
+
+    // conditions that were removed keep their data in the store until they are re-added
+    auto& triggerSources = proc->getTriggerSources();
+    Array<ConditionId> removedConditions;
+    for (auto id : canvas->getConditionIds())
+    {
+        if (triggerSources.getById (id) == nullptr)
+            removedConditions.add (id);
+    }
+    canvas->removeConditions (removedConditions);
+    for (auto id : store->getConditionIds())
+    {
+        if (triggerSources.getById (id) == nullptr)
+            store->retireAverageBufferForCondition (id);
+    }
+
+    Array<ConditionId> conditionOrder;
+    for (auto source : triggerSources.getAll())
+    {
+        conditionOrder.add (source->id);
 
-            canvas->addContChannel (
-                channel, source, i, store->getRefToAverageBufferForTriggerSource (source));
+        // during acquisition the collector accumulates into the same buffers and applies
+        // window changes itself (DataCollector::setWindowSize)
+        MultiChannelAverageBuffer* avgBuffer;
+        {
+            auto lock = store->GetLock();
+            avgBuffer = store->getOrCreateAverageBufferForCondition (
+                source->id, nChannels, nPreSamples, nPostSamples);
+            if (avgBuffer->getNumChannels() != nChannels)
+                store->ResetAndResizeAverageBufferForCondition (
+                    source->id, nChannels, nPreSamples, nPostSamples);
+            else if (! acquisitionIsActive)
+                avgBuffer->resizeWindow (nPreSamples, nPostSamples);
         }
+
+        if (canvas->hasCondition (source->id))
+            continue;
+
+        for (int i = 0; i < nChannels; i++)
+            canvas->addContChannel (channels[i], source, i, avgBuffer);
     }
+    canvas->setConditionOrder (conditionOrder);
     canvas->setWindowSizeMs (proc->getPreWindowSizeMs(), proc->getPostWindowSizeMs());
     canvas->resized();
 }
@@ -73,6 +73,9 @@ private:
 
     TriggeredAvgCanvas* canvas;
 
+    // channels the canvas panels were created for
+    Array<const ContinuousChannel*> displayedChannels;
+
     Popup::PopupConfigurationWindow* currentConfigWindow;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TriggeredAvgEditor);
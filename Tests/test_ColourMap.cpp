@@ -0,0 +1,38 @@
+#include "ColourMap.h"
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace TriggeredAverage;
+
+TEST (ColourMapTest, MapsRangeOntoTableAndClips)
+{
+    const auto map = ColourMap::createDiverging();
+    const std::vector<float> values { -2.0f, -1.0f, 0.0f, 1.0f, 3.0f };
+    std::vector<std::uint32_t> colours (values.size());
+    std::vector<float> scratch (values.size());
+
+    map.mapValues (values.data(),
+                   static_cast<int> (values.size()),
+                   { -1.0f, 1.0f },
+                   colours.data(),
+                   scratch.data());
+
+    EXPECT_EQ (colours[0], map.getColour (0));
+    EXPECT_EQ (colours[1], map.getColour (0));
+    EXPECT_EQ (colours[2], map.getColour (ColourMap::numEntries / 2));
+    EXPECT_EQ (colours[3], map.getColour (ColourMap::numEntries - 1));
+    EXPECT_EQ (colours[4], map.getColour (ColourMap::numEntries - 1));
+}
+
+TEST (ColourMapTest, DivergingMapIsOpaqueAndWhiteInTheMiddle)
+{
+    const auto map = ColourMap::createDiverging();
+    for (int i = 0; i < ColourMap::numEntries; ++i)
+        EXPECT_EQ (map.getColour (i) >> 24, 0xffu);
+
+    const auto centre = map.getColour (ColourMap::numEntries / 2);
+    EXPECT_GT ((centre >> 16) & 0xff, 0xf0u);
+    EXPECT_GT ((centre >> 8) & 0xff, 0xf0u);
+    EXPECT_GT (centre & 0xff, 0xf0u);
+}
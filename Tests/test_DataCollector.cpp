@@ -0,0 +1,227 @@
+#include "DataCollector.h"
+#include <gtest/gtest.h>
+
+using namespace TriggeredAverage;
+
+namespace
+{
+// one channel whose samples count up from firstValue
+juce::AudioBuffer<float> makeRamp (int numSamples, float firstValue)
+{
+    juce::AudioBuffer<float> buffer (1, numSamples);
+    for (int i = 0; i < numSamples; ++i)
+        buffer.setSample (0, i, firstValue + static_cast<float> (i));
+    return buffer;
+}
+} // namespace
+
+TEST (MultiChannelAverageBufferTest, AveragesTrials)
+{
+    MultiChannelAverageBuffer buffer (1, 2, 3);
+    buffer.addDataToAverageFromBuffer (makeRamp (5, 0.0f));
+    buffer.addDataToAverageFromBuffer (makeRamp (5, 2.0f));
+
+    auto average = buffer.getAverage();
+    ASSERT_EQ (average.getNumSamples(), 5);
+    EXPECT_EQ (buffer.getNumTrials(), 2);
+    for (int i = 0; i < 5; ++i)
+        EXPECT_FLOAT_EQ (average.getSample (0, i), static_cast<float> (i) + 1.0f);
+}
+
+TEST (MultiChannelAverageBufferTest, ShrinkingWindowKeepsOverlap)
+{
+    MultiChannelAverageBuffer buffer (1, 4, 4);
+    buffer.addDataToAverageFromBuffer (makeRamp (8, 0.0f));
+
+    buffer.resizeWindow (2, 3);
+
+    auto average = buffer.getAverage();
+    ASSERT_EQ (average.getNumSamples(), 5);
+    EXPECT_EQ (buffer.getNumTrials(), 1);
+    for (int i = 0; i < 5; ++i)
+        EXPECT_FLOAT_EQ (average.getSample (0, i), static_cast<float> (i + 2));
+}
+
+TEST (MultiChannelAverageBufferTest, GrowingWindowCountsTrialsPerSample)
+{
+    MultiChannelAverageBuffer buffer (1, 2, 2);
+    buffer.addDataToAverageFromBuffer (makeRamp (4, 10.0f));
+
+    buffer.resizeWindow (3, 4);
+    EXPECT_EQ (buffer.getNumTrialsAtSample (0), 0);
+    EXPECT_EQ (buffer.getNumTrialsAtSample (1), 1);
+    EXPECT_EQ (buffer.getNumTrialsAtSample (4), 1);
+    EXPECT_EQ (buffer.getNumTrialsAtSample (5), 0);
+
+    buffer.addDataToAverageFromBuffer (makeRamp (7, 0.0f));
+
+    auto average = buffer.getAverage();
+    ASSERT_EQ (average.getNumSamples(), 7);
+    EXPECT_FLOAT_EQ (average.getSample (0, 0), 0.0f);
+    EXPECT_FLOAT_EQ (average.getSample (0, 1), (10.0f + 1.0f) / 2.0f);
+    EXPECT_FLOAT_EQ (average.getSample (0, 4), (13.0f + 4.0f) / 2.0f);
+    EXPECT_FLOAT_EQ (average.getSample (0, 6), 6.0f);
+}
+
+TEST (MultiChannelAverageBufferTest, AlignsBuffersCapturedWithDifferentWindow)
+{
+    MultiChannelAverageBuffer buffer (1, 2, 2);
+
+    // captured with 3 pre samples: the trigger is at index 3 of the input
+    buffer.addDataToAverageFromBuffer (makeRamp (5, 0.0f), 3);
+
+    auto average = buffer.getAverage();
+    EXPECT_FLOAT_EQ (average.getSample (0, 0), 1.0f);
+    EXPECT_FLOAT_EQ (average.getSample (0, 3), 4.0f);
+    EXPECT_EQ (buffer.getNumTrialsAtSample (3), 1);
+}
+
+TEST (MultiChannelAverageBufferTest, MergeMatchesAccumulatingAllTrials)
+{
+    MultiChannelAverageBuffer all (1, 2, 3);
+    MultiChannelAverageBuffer first (1, 2, 3);
+    MultiChannelAverageBuffer second (1, 2, 3);
+    for (float offset : { 0.0f, 4.0f, -2.0f })
+    {
+        all.addDataToAverageFromBuffer (makeRamp (5, offset));
+        (offset < 0.0f ? second : first).addDataToAverageFromBuffer (makeRamp (5, offset));
+    }
+
+    first.merge (second);
+    EXPECT_EQ (first.getNumTrials(), 3);
+    EXPECT_EQ (first.getNumTrialsAtSample (4), 3);
+    auto mean = first.getAverage();
+    auto sd = first.getStandardDeviation();
+    for (int i = 0; i < 5; ++i)
+    {
+        EXPECT_FLOAT_EQ (mean.getSample (0, i), all.getAverage().getSample (0, i));
+        EXPECT_FLOAT_EQ (sd.getSample (0, i), all.getStandardDeviation().getSample (0, i));
+    }
+}
+
+TEST (DataStoreTest, SnapshotHoldsChannelRanges)
+{
+    DataStore store;
+    const ConditionId id { 1 };
+    store.ResetAndResizeAverageBufferForCondition (id, 1, 2, 3);
+    store.getRefToAverageBufferForCondition (id)->addDataToAverageFromBuffer (
+        makeRamp (5, -1.0f));
+
+    auto snapshot = store.getAverageSnapshot (id);
+    ASSERT_NE (snapshot, nullptr);
+    ASSERT_EQ (snapshot->channelRanges.size(), 1u);
+    EXPECT_FLOAT_EQ (snapshot->channelRanges[0].getStart(), -1.0f);
+    EXPECT_FLOAT_EQ (snapshot->channelRanges[0].getEnd(), 3.0f);
+    EXPECT_FLOAT_EQ (snapshot->range.getEnd(), 3.0f);
+}
+
+TEST (DataStoreTest, FreesOldestRetiredConditionsBeyondLimit)
+{
+    DataStore store;
+    for (ConditionId id = 1; id <= 3; ++id)
+    {
+        store.ResetAndResizeAverageBufferForCondition (id, 1, 2, 3);
+        store.getRefToAverageBufferForCondition (id)->addDataToAverageFromBuffer (
+            makeRamp (5, 0.0f));
+    }
+    const auto bytesPerCondition = store.getRefToAverageBufferForCondition (1)->getNumBytes();
+    store.setRetiredBytesLimit (2 * bytesPerCondition);
+
+    for (ConditionId id = 1; id <= 3; ++id)
+        store.retireAverageBufferForCondition (id);
+    EXPECT_FALSE (store.isRetired (1));
+    EXPECT_TRUE (store.isRetired (2));
+    EXPECT_TRUE (store.isRetired (3));
+
+    // restoring keeps the data; an evicted condition starts empty
+    EXPECT_EQ (store.getOrCreateAverageBufferForCondition (3, 1, 2, 3)->getNumTrials(), 1);
+    EXPECT_EQ (store.getOrCreateAverageBufferForCondition (1, 1, 2, 3)->getNumTrials(), 0);
+
+    // the most recent removal survives even when it alone exceeds the limit
+    store.setRetiredBytesLimit (0);
+    EXPECT_TRUE (store.isRetired (2));
+}
+
+TEST (DataStoreTest, PublishesOnlyChangedSnapshots)
+{
+    DataStore store;
+    store.ResetAndResizeAverageBufferForCondition (1, 1, 2, 3);
+    store.ResetAndResizeAverageBufferForCondition (2, 1, 2, 3);
+    EXPECT_EQ (store.getPublishedSnapshot (1), nullptr);
+
+    EXPECT_EQ (store.publishSnapshots(), 2);
+    EXPECT_EQ (store.publishSnapshots(), 0);
+    const auto before = store.getPublishedSnapshot (1);
+    ASSERT_NE (before, nullptr);
+
+    store.getRefToAverageBufferForCondition (1)->addDataToAverageFromBuffer (makeRamp (5, 0.0f));
+    EXPECT_EQ (store.getPublishedSnapshot (1), before);
+    EXPECT_EQ (store.publishSnapshots(), 1);
+    EXPECT_EQ (store.getPublishedSnapshot (1)->numTrials, 1);
+    EXPECT_EQ (store.getPublishedSnapshot (2)->numTrials, 0);
+}
+
+TEST (MultiChannelAverageBufferTest, MergeAlignsWindowsAndRejectsOtherChannelCounts)
+{
+    MultiChannelAverageBuffer wide (1, 4, 4);
+    MultiChannelAverageBuffer narrow (1, 2, 3);
+    narrow.addDataToAverageFromBuffer (makeRamp (5, 0.0f));
+
+    ASSERT_TRUE (wide.merge (narrow));
+    EXPECT_EQ (wide.getNumTrials(), 1);
+    EXPECT_EQ (wide.getNumTrialsAtSample (1), 0);
+    EXPECT_EQ (wide.getNumTrialsAtSample (2), 1);
+    EXPECT_EQ (wide.getNumTrialsAtSample (7), 0);
+    // the trigger (sample 2 of narrow) lands on sample 4 of wide
+    EXPECT_FLOAT_EQ (wide.getAverage().getSample (0, 4), 2.0f);
+
+    MultiChannelAverageBuffer twoChannels (2, 2, 3);
+    EXPECT_FALSE (twoChannels.merge (narrow));
+    EXPECT_EQ (twoChannels.getNumTrials(), 0);
+}
+
+TEST (DataStoreTest, ForgetsRecentTriggersWhenBufferIsReset)
+{
+    DataStore store;
+    store.ResetAndResizeAverageBufferForCondition (1, 1, 2, 3);
+    store.ResetAndResizeAverageBufferForCondition (2, 1, 2, 3);
+    store.addRecentTrigger (1, 100);
+    store.addRecentTrigger (2, 200);
+
+    store.ResetAndResizeAverageBufferForCondition (1, 1, 4, 3);
+    EXPECT_EQ (store.getRecentTriggers (1), nullptr);
+    ASSERT_NE (store.getRecentTriggers (2), nullptr);
+
+    store.addRecentTrigger (1, 300);
+    store.retireAverageBufferForCondition (1);
+    EXPECT_EQ (store.getRecentTriggers (1), nullptr);
+
+    store.Clear();
+    EXPECT_EQ (store.getRecentTriggers (2), nullptr);
+}
+
+TEST (DataStoreTest, KeepsTrialHistoriesOnlyWhenAskedTo)
+{
+    DataStore store;
+    EXPECT_FALSE (store.keepsTrialHistories());
+
+    store.setKeepTrialHistories (true);
+    store.getOrCreateTrialHistory (1, 1, 5)->addTrial (makeRamp (5, 0.0f));
+    ASSERT_NE (store.getTrialHistory (1), nullptr);
+
+    store.setKeepTrialHistories (false);
+    EXPECT_EQ (store.getTrialHistory (1), nullptr);
+}
+
+TEST (DataStoreTest, KeepsTraceDensitiesOnlyWhenAskedTo)
+{
+    DataStore store;
+    EXPECT_FALSE (store.keepsTraceDensities());
+
+    store.setKeepTraceDensities (true);
+    store.getOrCreateTraceDensity (1, 1, 5)->addTrial (makeRamp (5, 0.0f));
+    ASSERT_NE (store.getTraceDensity (1), nullptr);
+
+    store.setKeepTraceDensities (false);
+    EXPECT_EQ (store.getTraceDensity (1), nullptr);
+}
@@ -0,0 +1,210 @@
+#include "DataCollector.h"
+#include "Offline/BinaryRecording.h"
+#include "Offline/NpyFile.h"
+#include "Offline/OfflineReplay.h"
+#include "Offline/SnapshotExport.h"
+#include "TrialHistory.h"
+#include <gtest/gtest.h>
+
+using namespace TriggeredAverage;
+
+namespace
+{
+constexpr int numChannels = 2;
+constexpr int numSamples = 1000;
+constexpr SampleNumber firstSample = 5000;
+constexpr float bitVolts = 0.5f;
+
+template <typename T>
+void writeNpy (const juce::File& file, const char* dtype, const std::vector<T>& values)
+{
+    NpyWriter writer (file, dtype, { static_cast<std::int64_t> (values.size()) });
+    writer.write (values.data(), values.size() * sizeof (T));
+    ASSERT_TRUE (writer.finish().wasOk());
+}
+
+// channel 0 counts up from 0, channel 1 counts down; TTL events as (relative sample, state)
+void writeRecording (const juce::File& folder,
+                     const std::vector<std::pair<SampleNumber, std::int16_t>>& events)
+{
+    folder.getChildFile ("structure.oebin")
+        .replaceWithText (R"({ "continuous": [ { "folder_name": "Source-100.Probe/",
+            "stream_name": "Probe", "sample_rate": 1000.0, "num_channels": 2,
+            "channels": [ { "channel_name": "CH1", "bit_volts": 0.5 },
+                          { "channel_name": "CH2", "bit_volts": 0.5 } ] } ],
+            "events": [ { "folder_name": "Source-100.Probe/TTL/", "stream_name": "Probe" } ] })");
+
+    const auto streamFolder = folder.getChildFile ("continuous/Source-100.Probe");
+    ASSERT_TRUE (streamFolder.createDirectory().wasOk());
+    std::vector<std::int16_t> samples;
+    std::vector<std::int64_t> sampleNumbers;
+    for (int i = 0; i < numSamples; ++i)
+    {
+        samples.push_back (static_cast<std::int16_t> (i));
+        samples.push_back (static_cast<std::int16_t> (-i));
+        sampleNumbers.push_back (firstSample + i);
+    }
+    streamFolder.getChildFile ("continuous.dat")
+        .replaceWithData (samples.data(), samples.size() * sizeof (std::int16_t));
+    writeNpy (streamFolder.getChildFile ("sample_numbers.npy"), "<i8", sampleNumbers);
+
+    const auto eventFolder = folder.getChildFile ("events/Source-100.Probe/TTL");
+    ASSERT_TRUE (eventFolder.createDirectory().wasOk());
+    std::vector<std::int64_t> eventSamples;
+    std::vector<std::int16_t> states;
+    for (auto [sample, state] : events)
+    {
+        eventSamples.push_back (firstSample + sample);
+        states.push_back (state);
+    }
+    writeNpy (eventFolder.getChildFile ("sample_numbers.npy"), "<i8", eventSamples);
+    writeNpy (eventFolder.getChildFile ("states.npy"), "<i2", states);
+}
+
+class OfflineReplayTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        folder = juce::File::getSpecialLocation (juce::File::tempDirectory)
+                     .getNonexistentChildFile ("triggered-avg-replay", "", false);
+        ASSERT_TRUE (folder.createDirectory().wasOk());
+    }
+    void TearDown() override { folder.deleteRecursively(); }
+
+    juce::File folder;
+};
+} // namespace
+
+TEST_F (OfflineReplayTest, NpyRoundTrip)
+{
+    const std::vector<std::int16_t> values { -3, 0, 7 };
+    const auto file = folder.getChildFile ("values.npy");
+    writeNpy (file, "<i2", values);
+
+    NpyFile npy;
+    ASSERT_TRUE (npy.open (file).wasOk());
+    EXPECT_EQ (npy.getDtype(), "<i2");
+    ASSERT_EQ (npy.getShape(), std::vector<std::int64_t> { 3 });
+    EXPECT_EQ (npy.readIntegers(), (std::vector<std::int64_t> { -3, 0, 7 }));
+    EXPECT_EQ ((file.getSize() - 3 * 2) % 64, 0); // data is aligned
+}
+
+TEST_F (OfflineReplayTest, ExportsAveragesAndTrialsOfEveryCondition)
+{
+    DataStore store;
+    juce::AudioBuffer<float> trial (numChannels, 8);
+    for (int t = 0; t < 3; ++t)
+    {
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < 8; ++i)
+                trial.setSample (ch, i, static_cast<float> (100 * t + 10 * ch + i));
+        store.getOrCreateAverageBufferForCondition (1, numChannels, 2, 6)
+            ->addDataToAverageFromBuffer (trial);
+        store.getOrCreateTrialHistory (1, numChannels, 8)->addTrial (trial);
+    }
+    store.getOrCreateAverageBufferForCondition (2, numChannels, 2, 6);
+
+    // condition 3 has no data, the second "Stim" gets its id appended
+    ASSERT_TRUE (exportConditionsAsNpy (store,
+                                        { { 1, "Stim" }, { 2, "Stim" }, { 3, "Empty" } },
+                                        folder,
+                                        "session")
+                     .wasOk());
+    EXPECT_TRUE (folder.getChildFile ("session_Stim_sd.npy").existsAsFile());
+    EXPECT_TRUE (folder.getChildFile ("session_Stim_2_mean.npy").existsAsFile());
+    EXPECT_FALSE (folder.getChildFile ("session_Stim_2_trials.npy").exists());
+    EXPECT_FALSE (folder.getChildFile ("session_Empty_mean.npy").exists());
+
+    NpyFile mean;
+    ASSERT_TRUE (mean.open (folder.getChildFile ("session_Stim_mean.npy")).wasOk());
+    ASSERT_EQ (mean.getShape(), (std::vector<std::int64_t> { numChannels, 8 }));
+    EXPECT_FLOAT_EQ (static_cast<const float*> (mean.getData())[8 + 3], 100.0f + 10.0f + 3.0f);
+
+    NpyFile trials;
+    ASSERT_TRUE (trials.open (folder.getChildFile ("session_Stim_trials.npy")).wasOk());
+    ASSERT_EQ (trials.getShape(), (std::vector<std::int64_t> { 3, numChannels, 8 }));
+    const auto* values = static_cast<const float*> (trials.getData());
+    EXPECT_FLOAT_EQ (values[(2 * numChannels + 1) * 8 + 5], 200.0f + 10.0f + 5.0f);
+}
+
+TEST_F (OfflineReplayTest, AveragesRisingEdgesOfSelectedLine)
+{
+    // line 1 rises at 100 and 400, too early at 5 and too late at 995; line 2 rises at 600
+    writeRecording (folder,
+                    { { 5, 1 }, { 100, 1 }, { 150, -1 }, { 400, 1 }, { 600, 2 }, { 995, 1 } });
+
+    BinaryRecording recording;
+    ASSERT_TRUE (recording.open (folder, 0).wasOk());
+    EXPECT_EQ (recording.getNumChannels(), numChannels);
+    EXPECT_EQ (recording.getNumSamples(), numSamples);
+    EXPECT_EQ (recording.getFirstSampleNumber(), firstSample);
+    EXPECT_EQ (recording.getTtlEvents().size(), 6u);
+
+    ReplaySettings settings;
+    settings.preSamples = 10;
+    settings.postSamples = 20;
+    settings.blockSize = 16;
+    settings.conditions.push_back ({ .id = 1, .name = "TTL 1", .ttlLine = 0 });
+
+    DataStore store;
+    const auto stats = OfflineReplay (recording, settings).run (store);
+    EXPECT_EQ (stats.numTriggers, 4);
+    EXPECT_EQ (stats.numTrialsAccumulated, 2);
+    EXPECT_LT (stats.numSamplesRead, numSamples);
+
+    auto snapshot = store.getAverageSnapshot (1);
+    ASSERT_NE (snapshot, nullptr);
+    EXPECT_EQ (snapshot->numTrials, 2);
+    for (int i = 0; i < 30; ++i)
+    {
+        const float expected = bitVolts * (((90 + i) + (390 + i)) / 2.0f);
+        EXPECT_FLOAT_EQ (snapshot->mean.getSample (0, i), expected);
+        EXPECT_FLOAT_EQ (snapshot->mean.getSample (1, i), -expected);
+    }
+}
+
+TEST_F (OfflineReplayTest, ParallelReplayMatchesSerial)
+{
+    std::vector<std::pair<SampleNumber, std::int16_t>> events;
+    for (SampleNumber sample = 20; sample < numSamples; sample += 37)
+    {
+        events.push_back ({ sample, 1 });
+        events.push_back ({ sample + 5, -1 });
+    }
+    writeRecording (folder, events);
+
+    BinaryRecording recording;
+    ASSERT_TRUE (recording.open (folder, 0).wasOk());
+
+    ReplaySettings settings;
+    settings.preSamples = 10;
+    settings.postSamples = 20;
+    settings.blockSize = 16;
+    settings.conditions.push_back ({ .id = 1, .name = "TTL 1", .ttlLine = 0 });
+    const OfflineReplay replay (recording, settings);
+
+    DataStore serialStore, parallelStore;
+    const auto serial = replay.run (serialStore);
+    const auto parallel = replay.runParallel (parallelStore, 4);
+    EXPECT_EQ (parallel.numTriggers, serial.numTriggers);
+    EXPECT_EQ (parallel.numTrialsAccumulated, serial.numTrialsAccumulated);
+
+    auto expected = serialStore.getAverageSnapshot (1);
+    auto actual = parallelStore.getAverageSnapshot (1);
+    ASSERT_NE (actual, nullptr);
+    EXPECT_EQ (actual->numTrials, expected->numTrials);
+    for (int ch = 0; ch < numChannels; ++ch)
+        for (int i = 0; i < 30; ++i)
+            EXPECT_NEAR (actual->mean.getSample (ch, i), expected->mean.getSample (ch, i), 1e-3);
+}
+
+TEST (SnapshotExportTest, MakesPrefixesOfSameNamedConditionsUnique)
+{
+    std::set<juce::String> used;
+    EXPECT_EQ (makeUniquePrefix ("Stim", 1, used), "Stim");
+    EXPECT_EQ (makeUniquePrefix ("Stim_2", 5, used), "Stim_2");
+    EXPECT_EQ (makeUniquePrefix ("Stim", 2, used), "Stim_2_2");
+    EXPECT_EQ (makeUniquePrefix ("Stim", 2, used), "Stim_2_3");
+    EXPECT_EQ (used.size(), 4u);
+}
@@ -0,0 +1,87 @@
+#include "DataCollector.h"
+#include "MultiChannelRingBuffer.h"
+#include "RealtimeSafety.h"
+#include "Synthetic/SyntheticSource.h"
+#include "TimingZones.h"
+#include <gtest/gtest.h>
+
+#include <mutex>
+
+using namespace TriggeredAverage;
+
+class RealtimeSafetyTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        if (! RealtimeSafety::isEnabled)
+            GTEST_SKIP() << "needs TRIGGERED_AVG_REALTIME_CHECKS";
+        RealtimeSafety::resetViolationCounts();
+    }
+};
+
+TEST_F (RealtimeSafetyTest, CountsAllocationsAndLocksInsideSections)
+{
+    std::mutex mutex;
+    void* outside = ::operator new (16);
+    ::operator delete (outside);
+    EXPECT_EQ (RealtimeSafety::getViolationCounts().total(), 0);
+
+    {
+        const RealtimeSafety::ScopedRealtimeSection section;
+        void* inside = ::operator new (16);
+        ::operator delete (inside);
+        const std::scoped_lock lock (mutex);
+    }
+
+    const auto counts = RealtimeSafety::getViolationCounts();
+    EXPECT_GE (counts.allocations, 1);
+    EXPECT_GE (counts.deallocations, 1);
+#if defined(__GLIBC__)
+    EXPECT_EQ (counts.locks, 1);
+#endif
+}
+
+// the audio thread's share of the pipeline, while the collector runs on its own thread
+TEST_F (RealtimeSafetyTest, AudioThreadPathNeitherAllocatesNorLocks)
+{
+    SyntheticSettings settings;
+    settings.numChannels = 16;
+    settings.triggers.push_back ({ .ttlLine = 0, .rateHz = 200.0 });
+    settings.responses.push_back ({ .ttlLine = 0 });
+    SyntheticSource source (settings);
+
+    constexpr int blockSize = 512;
+    MultiChannelRingBuffer ringBuffer (settings.numChannels, 30000);
+    DataStore store;
+    DataCollector collector ({}, &ringBuffer, &store);
+    collector.startThread();
+
+    juce::AudioBuffer<float> block (settings.numChannels, blockSize);
+    std::vector<TtlEvent> events;
+    events.reserve (256);
+    TimingZones::registerCurrentThread ("audio");
+    for (int i = 0; i < 200; ++i)
+    {
+        events.clear();
+        const auto first = source.nextBlock (block, blockSize, events);
+
+        const RealtimeSafety::ScopedRealtimeSection section;
+        ringBuffer.addData (block, first, blockSize);
+        for (const auto& event : events)
+        {
+            if (event.state && event.sampleNumber >= 300)
+                collector.registerCaptureRequest ({ .conditionId = 1,
+                                                    .triggerSample = event.sampleNumber,
+                                                    .preSamples = 300,
+                                                    .postSamples = 600 });
+        }
+    }
+    collector.stopThread (1000);
+
+    const auto counts = RealtimeSafety::getViolationCounts();
+    EXPECT_EQ (counts.allocations, 0);
+    EXPECT_EQ (counts.deallocations, 0);
+    EXPECT_EQ (counts.locks, 0);
+    EXPECT_EQ (collector.getNumDroppedRequests(), 0);
+}
@@ -0,0 +1,86 @@
+#include "SnapshotPublisher.h"
+#include <gtest/gtest.h>
+
+using namespace TriggeredAverage;
+
+namespace
+{
+struct Counted
+{
+    explicit Counted (int& liveCount_, int value_) : liveCount (liveCount_), value (value_)
+    {
+        ++liveCount;
+    }
+    ~Counted() { --liveCount; }
+
+    int& liveCount;
+    int value;
+};
+} // namespace
+
+TEST (SnapshotPublisherTest, ReaderSeesLatestSnapshot)
+{
+    int live = 0;
+    SnapshotPublisher<Counted> publisher;
+    publisher.publish (std::make_unique<const Counted> (live, 1));
+    publisher.publish (std::make_unique<const Counted> (live, 2));
+
+    SnapshotPublisher<Counted>::ReadScope scope (publisher);
+    ASSERT_NE (scope.get(), nullptr);
+    EXPECT_EQ (scope->value, 2);
+}
+
+TEST (SnapshotPublisherTest, RetiredSnapshotsAreFreedWhenReaderIsQuiescent)
+{
+    int live = 0;
+    SnapshotPublisher<Counted> publisher;
+    publisher.publish (std::make_unique<const Counted> (live, 1));
+    publisher.publish (std::make_unique<const Counted> (live, 2));
+
+    EXPECT_EQ (live, 1);
+    EXPECT_EQ (publisher.getNumRetired(), 0u);
+}
+
+TEST (SnapshotPublisherTest, PinnedSnapshotSurvivesUntilGracePeriodEnds)
+{
+    int live = 0;
+    SnapshotPublisher<Counted> publisher;
+    publisher.publish (std::make_unique<const Counted> (live, 1));
+
+    {
+        SnapshotPublisher<Counted>::ReadScope scope (publisher);
+        publisher.publish (std::make_unique<const Counted> (live, 2));
+
+        // the reader may still use the first snapshot
+        EXPECT_EQ (live, 2);
+        EXPECT_EQ (scope->value, 1);
+    }
+
+    publisher.collectGarbage();
+    EXPECT_EQ (live, 1);
+}
+
+TEST (SnapshotPublisherTest, ReaderInNewerEpochReleasesOlderSnapshots)
+{
+    int live = 0;
+    SnapshotPublisher<Counted> publisher;
+    publisher.publish (std::make_unique<const Counted> (live, 1));
+    publisher.publish (std::make_unique<const Counted> (live, 2));
+
+    SnapshotPublisher<Counted>::ReadScope scope (publisher);
+    publisher.collectGarbage();
+    EXPECT_EQ (live, 1);
+    EXPECT_EQ (scope->value, 2);
+}
+
+TEST (SnapshotPublisherTest, DestructorFreesEverything)
+{
+    int live = 0;
+    {
+        SnapshotPublisher<Counted> publisher;
+        publisher.publish (std::make_unique<const Counted> (live, 1));
+        SnapshotPublisher<Counted>::ReadScope scope (publisher);
+        publisher.publish (std::make_unique<const Counted> (live, 2));
+    }
+    EXPECT_EQ (live, 0);
+}
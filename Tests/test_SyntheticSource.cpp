@@ -0,0 +1,127 @@
+#include "DataCollector.h"
+#include "MultiChannelRingBuffer.h"
+#include "Synthetic/SyntheticSource.h"
+#include <gtest/gtest.h>
+
+using namespace TriggeredAverage;
+
+namespace
+{
+SyntheticSettings makeSettings()
+{
+    SyntheticSettings settings;
+    settings.numChannels = 2;
+    settings.sampleRate = 1000.0;
+    settings.seed = 3;
+    settings.noiseRms = 5.0f;
+    settings.lineNoiseAmplitude = 2.0f;
+    settings.maxDriftPerSecond = 1.0f;
+    settings.triggers.push_back ({ .ttlLine = 0, .rateHz = 10.0, .poisson = false });
+    settings.triggers.push_back ({ .ttlLine = 1, .rateHz = 7.0, .poisson = true });
+    settings.responses.push_back ({ .ttlLine = 0, .latencyMs = 20.0, .widthMs = 4.0 });
+    return settings;
+}
+} // namespace
+
+TEST (SyntheticSourceTest, OutputDoesNotDependOnBlockSize)
+{
+    SyntheticSource a (makeSettings());
+    SyntheticSource b (makeSettings());
+    juce::AudioBuffer<float> blockA, blockB;
+    std::vector<TtlEvent> eventsA, eventsB;
+
+    // 3000 samples as 3 blocks of 1000 and as 10 blocks of 300
+    std::vector<float> samplesA, samplesB;
+    for (int i = 0; i < 3; ++i)
+    {
+        a.nextBlock (blockA, 1000, eventsA);
+        const auto* data = blockA.getReadPointer (1);
+        samplesA.insert (samplesA.end(), data, data + 1000);
+    }
+    for (int i = 0; i < 10; ++i)
+    {
+        b.nextBlock (blockB, 300, eventsB);
+        const auto* data = blockB.getReadPointer (1);
+        samplesB.insert (samplesB.end(), data, data + 300);
+    }
+
+    EXPECT_EQ (samplesA, samplesB);
+    ASSERT_EQ (eventsA.size(), eventsB.size());
+    EXPECT_GT (eventsA.size(), 50u);
+    for (size_t i = 0; i < eventsA.size(); ++i)
+    {
+        EXPECT_EQ (eventsA[i].sampleNumber, eventsB[i].sampleNumber);
+        EXPECT_EQ (eventsA[i].line, eventsB[i].line);
+        EXPECT_EQ (eventsA[i].state, eventsB[i].state);
+    }
+}
+
+TEST (SyntheticSourceTest, DroppedBlocksSkipSamplesAndEvents)
+{
+    auto settings = makeSettings();
+    settings.dropBlockProbability = 0.3;
+    SyntheticSource source (settings);
+    juce::AudioBuffer<float> block;
+
+    SampleNumber expectedFirst = 0;
+    int numSkipped = 0;
+    for (int i = 0; i < 50; ++i)
+    {
+        std::vector<TtlEvent> events;
+        const auto first = source.nextBlock (block, 100, events);
+        ASSERT_EQ ((first - expectedFirst) % 100, 0);
+        numSkipped += static_cast<int> ((first - expectedFirst) / 100);
+        for (const auto& event : events)
+            EXPECT_TRUE (event.sampleNumber >= first && event.sampleNumber < first + 100);
+        expectedFirst = first + 100;
+    }
+    EXPECT_GT (numSkipped, 0);
+    EXPECT_EQ (numSkipped, source.getNumDroppedBlocks());
+}
+
+TEST (SyntheticSourceTest, CollectorAveragesTheEvokedResponse)
+{
+    auto settings = makeSettings();
+    settings.lineNoiseAmplitude = 0.0f;
+    settings.maxDriftPerSecond = 0.0f;
+    SyntheticSource source (settings);
+
+    constexpr int preSamples = 10;
+    constexpr int postSamples = 50;
+    MultiChannelRingBuffer ringBuffer (settings.numChannels, 1000);
+    DataStore store;
+    DataCollector collector ({}, &ringBuffer, &store);
+
+    juce::AudioBuffer<float> block;
+    for (int i = 0; i < 300; ++i)
+    {
+        std::vector<TtlEvent> events;
+        const auto first = source.nextBlock (block, 64, events);
+        ringBuffer.addData (block, first, 64);
+        for (const auto& event : events)
+        {
+            if (event.line == 0 && event.state && event.sampleNumber >= preSamples)
+                collector.registerCaptureRequest ({ .conditionId = 1,
+                                                    .triggerSample = event.sampleNumber,
+                                                    .preSamples = preSamples,
+                                                    .postSamples = postSamples });
+        }
+        collector.processAvailableRequests();
+    }
+
+    auto snapshot = store.getAverageSnapshot (1);
+    ASSERT_NE (snapshot, nullptr);
+    EXPECT_GT (snapshot->numTrials, 150);
+
+    // the noise of the mean is 5 / sqrt (trials), well below 1
+    for (int ch = 0; ch < settings.numChannels; ++ch)
+    {
+        for (int i = 0; i < preSamples + postSamples; ++i)
+        {
+            const double secondsAfterTrigger = (i - preSamples) / settings.sampleRate;
+            EXPECT_NEAR (snapshot->mean.getSample (ch, i),
+                         source.getExpectedResponse (ch, 0, secondsAfterTrigger),
+                         1.5);
+        }
+    }
+}
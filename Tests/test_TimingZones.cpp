@@ -0,0 +1,67 @@
+#include "TimingZones.h"
+#include <gtest/gtest.h>
+
+#include <map>
+
+using namespace TriggeredAverage;
+
+namespace
+{
+class ZoneThread : public juce::Thread
+{
+public:
+    ZoneThread() : juce::Thread ("Zone thread") {}
+
+    void run() override
+    {
+        for (int i = 0; i < 10; ++i)
+            TRIGGERED_AVG_TIMING_ZONE ("worker");
+    }
+};
+} // namespace
+
+TEST (TimingZonesTest, WritesZonesOfAllThreadsAsChromeTrace)
+{
+    if (! TimingZones::isEnabled)
+        GTEST_SKIP() << "needs TRIGGERED_AVG_TIMING_ZONES";
+
+    {
+        TRIGGERED_AVG_TIMING_ZONE ("outer");
+        TRIGGERED_AVG_TIMING_ZONE ("inner");
+    }
+    ZoneThread thread;
+    thread.startThread();
+    thread.stopThread (1000);
+
+    const auto file = juce::File::getSpecialLocation (juce::File::tempDirectory)
+                          .getNonexistentChildFile ("timing-zones", ".json", false);
+    ASSERT_TRUE (TimingZones::writeChromeTrace (file).wasOk());
+    const auto trace = juce::JSON::parse (file);
+    file.deleteFile();
+
+    const auto* events = trace["traceEvents"].getArray();
+    ASSERT_NE (events, nullptr);
+    std::map<juce::String, int> numZones;
+    std::map<juce::String, juce::String> threadOfZone;
+    std::map<juce::String, juce::String> threadNames;
+    for (const auto& event : *events)
+    {
+        const auto tid = event["tid"].toString();
+        if (event["ph"].toString() == "M")
+        {
+            threadNames[tid] = event["args"]["name"].toString();
+            continue;
+        }
+        EXPECT_EQ (event["ph"].toString(), "X");
+        EXPECT_GE (static_cast<double> (event["dur"]), 0.0);
+        ++numZones[event["name"].toString()];
+        threadOfZone[event["name"].toString()] = tid;
+    }
+
+    EXPECT_GE (numZones["outer"], 1);
+    EXPECT_GE (numZones["inner"], 1);
+    EXPECT_EQ (numZones["worker"], 10);
+    EXPECT_EQ (threadOfZone["outer"], threadOfZone["inner"]);
+    EXPECT_NE (threadOfZone["outer"], threadOfZone["worker"]);
+    EXPECT_EQ (threadNames[threadOfZone["worker"]], "Zone thread");
+}
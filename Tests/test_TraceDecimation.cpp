@@ -0,0 +1,70 @@
+#include "TraceDecimation.h"
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <tuple>
+#include <vector>
+
+using namespace TriggeredAverage;
+
+TEST (TraceDecimationTest, KeepsSingleSamplePeaks)
+{
+    std::vector<float> trace (1000, 0.0f);
+    trace[123] = 5.0f;
+    trace[877] = -3.0f;
+
+    std::vector<MinMaxColumn> columns (10);
+    decimateMinMax (trace.data(), static_cast<int> (trace.size()), columns);
+
+    EXPECT_FLOAT_EQ (columns[1].max, 5.0f);
+    EXPECT_FLOAT_EQ (columns[8].min, -3.0f);
+    EXPECT_FLOAT_EQ (columns[0].min, 0.0f);
+    EXPECT_FLOAT_EQ (columns[0].max, 0.0f);
+
+    const auto range = getRange (columns);
+    EXPECT_FLOAT_EQ (range.getStart(), -3.0f);
+    EXPECT_FLOAT_EQ (range.getEnd(), 5.0f);
+}
+
+TEST (TraceDecimationTest, UnevenSplitCoversEverySample)
+{
+    // 7 samples into 3 columns: [0, 2), [2, 4), [4, 7)
+    const std::vector<float> trace { 1, 2, 3, 4, 5, 6, 7 };
+    std::vector<MinMaxColumn> columns (3);
+    decimateMinMax (trace.data(), static_cast<int> (trace.size()), columns);
+
+    EXPECT_FLOAT_EQ (columns[0].min, 1.0f);
+    EXPECT_FLOAT_EQ (columns[0].max, 2.0f);
+    EXPECT_FLOAT_EQ (columns[1].min, 3.0f);
+    EXPECT_FLOAT_EQ (columns[1].max, 4.0f);
+    EXPECT_FLOAT_EQ (columns[2].min, 5.0f);
+    EXPECT_FLOAT_EQ (columns[2].max, 7.0f);
+}
+
+TEST (TraceDecimationTest, PyramidMatchesDirectDecimationOfSubRanges)
+{
+    std::vector<float> trace (1003);
+    for (size_t i = 0; i < trace.size(); ++i)
+        trace[i] = std::sin (0.37f * static_cast<float> (i)) * static_cast<float> (i % 17);
+
+    MinMaxPyramid pyramid;
+    pyramid.build (trace.data(), static_cast<int> (trace.size()));
+    EXPECT_EQ (pyramid.getNumSamples(), 1003);
+    EXPECT_EQ (pyramid.getNumLevels(), 10);
+
+    for (auto [start, length, width] : { std::tuple { 0, 1003, 100 },
+                                         std::tuple { 13, 501, 37 },
+                                         std::tuple { 998, 5, 5 } })
+    {
+        std::vector<MinMaxColumn> expected (width);
+        std::vector<MinMaxColumn> actual (width);
+        decimateMinMax (trace.data() + start, length, expected);
+        pyramid.decimate (start, length, actual);
+
+        for (int i = 0; i < width; ++i)
+        {
+            EXPECT_FLOAT_EQ (actual[i].min, expected[i].min);
+            EXPECT_FLOAT_EQ (actual[i].max, expected[i].max);
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#include "TraceDensity.h"
+#include <gtest/gtest.h>
+
+#include <numeric>
+
+using namespace TriggeredAverage;
+
+namespace
+{
+juce::AudioBuffer<float> makeConstantTrial (int numSamples, float value)
+{
+    juce::AudioBuffer<float> buffer (1, numSamples);
+    for (int i = 0; i < numSamples; ++i)
+        buffer.setSample (0, i, value);
+    return buffer;
+}
+
+std::uint64_t totalCount (const TraceDensity& density)
+{
+    const auto* counts = density.getCounts (0);
+    return std::accumulate (
+        counts, counts + density.getNumColumns() * density.getNumRows(), std::uint64_t { 0 });
+}
+} // namespace
+
+TEST (TraceDensityTest, ConstantTrialsFillOneRow)
+{
+    TraceDensity density (1, 8, 16);
+    density.addTrial (makeConstantTrial (16, 1.0f));
+    density.addTrial (makeConstantTrial (16, 1.0f));
+
+    EXPECT_EQ (density.getNumTrials(), 2);
+    EXPECT_EQ (density.getMaxCount (0), 2u);
+    EXPECT_EQ (totalCount (density), 16u);
+    EXPECT_GE (density.getAmplitudeRange (0).getEnd(), 1.0f);
+}
+
+TEST (TraceDensityTest, GrowingRangeKeepsCounts)
+{
+    TraceDensity density (1, 8, 16);
+    density.addTrial (makeConstantTrial (16, 1.0f));
+    const auto version = density.getVersion();
+
+    density.addTrial (makeConstantTrial (16, -10.0f));
+
+    EXPECT_NE (density.getVersion(), version);
+    EXPECT_GE (density.getAmplitudeRange (0).getEnd(), 10.0f);
+    EXPECT_EQ (totalCount (density), 16u);
+    EXPECT_EQ (density.getMaxCount (0), 1u);
+}
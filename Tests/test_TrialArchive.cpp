@@ -0,0 +1,94 @@
+#include "TrialArchive.h"
+#include <gtest/gtest.h>
+
+using namespace TriggeredAverage;
+
+namespace
+{
+// channel ch of trial t holds t * 1000 + ch * 100 + sample
+juce::AudioBuffer<float> makeTrial (int trial, int numChannels, int numSamples)
+{
+    juce::AudioBuffer<float> buffer (numChannels, numSamples);
+    for (int ch = 0; ch < numChannels; ++ch)
+        for (int i = 0; i < numSamples; ++i)
+            buffer.setSample (ch, i, static_cast<float> (trial * 1000 + ch * 100 + i));
+    return buffer;
+}
+
+juce::File makeArchiveFile()
+{
+    return juce::File::getSpecialLocation (juce::File::tempDirectory)
+        .getNonexistentChildFile ("trial-archive", ".bin", false);
+}
+} // namespace
+
+TEST (TrialArchiveTest, ReadsBackTrialsSpanningBlocks)
+{
+    const auto file = makeArchiveFile();
+    {
+        // 4 blocks of 4 KiB; each trial of 3 x 100 samples spans block boundaries
+        TrialArchiveWriter writer (file, 4 * 4096, 4096);
+        ASSERT_TRUE (writer.getStatus().wasOk());
+        for (int t = 0; t < 20; ++t)
+        {
+            const auto trial = makeTrial (t, 3, 100);
+            while (! writer.addTrial (ConditionId (t % 3 + 1), 10000 + t, 40, trial))
+                juce::Thread::sleep (1);
+        }
+        writer.finish();
+        EXPECT_TRUE (writer.getStatus().wasOk());
+        EXPECT_EQ (writer.getNumArchivedTrials(), 20);
+    }
+
+    TrialArchiveReader reader;
+    ASSERT_TRUE (reader.open (file).wasOk());
+    ASSERT_EQ (reader.getNumTrials(), 20);
+    for (int t = 0; t < 20; ++t)
+    {
+        const auto header = reader.getHeader (t);
+        EXPECT_EQ (header.conditionId, static_cast<std::uint32_t> (t % 3 + 1));
+        EXPECT_EQ (header.triggerSample, 10000 + t);
+        EXPECT_EQ (header.preSamples, 40);
+        ASSERT_EQ (header.numChannels, 3);
+        ASSERT_EQ (header.numSamples, 100);
+        for (int ch = 0; ch < 3; ++ch)
+            for (int i = 0; i < 100; i += 33)
+                EXPECT_EQ (reader.getChannel (t, ch)[i],
+                           static_cast<float> (t * 1000 + ch * 100 + i));
+    }
+    file.deleteFile();
+}
+
+TEST (TrialArchiveTest, DropsTrialsThatDoNotFitAndFlagsTheNextOne)
+{
+    const auto file = makeArchiveFile();
+    {
+        TrialArchiveWriter writer (file, 2 * 4096, 4096);
+        ASSERT_TRUE (writer.getStatus().wasOk());
+
+        // larger than the whole buffer
+        EXPECT_FALSE (writer.addTrial (ConditionId (1), 0, 0, makeTrial (0, 4, 1024)));
+        EXPECT_TRUE (writer.addTrial (ConditionId (2), 1, 0, makeTrial (1, 1, 16)));
+        writer.finish();
+        EXPECT_EQ (writer.getNumArchivedTrials(), 1);
+        EXPECT_EQ (writer.getNumDroppedTrials(), 1);
+    }
+
+    TrialArchiveReader reader;
+    ASSERT_TRUE (reader.open (file).wasOk());
+    ASSERT_EQ (reader.getNumTrials(), 1);
+    EXPECT_EQ (reader.getHeader (0).conditionId, 2u);
+    EXPECT_NE (reader.getHeader (0).flags & TrialRecordHeader::afterDroppedTrials, 0u);
+    EXPECT_EQ (reader.getChannel (0, 0)[5], 1005.0f);
+    file.deleteFile();
+}
+
+TEST (TrialArchiveTest, RejectsFilesThatAreNotArchives)
+{
+    const auto file = makeArchiveFile();
+    file.replaceWithText ("not a trial archive");
+
+    TrialArchiveReader reader;
+    EXPECT_TRUE (reader.open (file).failed());
+    file.deleteFile();
+}
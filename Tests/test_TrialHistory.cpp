@@ -0,0 +1,44 @@
+#include "TrialHistory.h"
+#include <gtest/gtest.h>
+
+using namespace TriggeredAverage;
+
+namespace
+{
+juce::AudioBuffer<float> makeConstantTrial (int numSamples, float value)
+{
+    juce::AudioBuffer<float> buffer (1, numSamples);
+    for (int i = 0; i < numSamples; ++i)
+        buffer.setSample (0, i, value);
+    return buffer;
+}
+} // namespace
+
+TEST (TrialHistoryTest, OverwritesOldestTrial)
+{
+    TrialHistory history (1, 4, 3);
+    for (int trial = 0; trial < 5; ++trial)
+        history.addTrial (makeConstantTrial (8, static_cast<float> (trial)));
+
+    EXPECT_EQ (history.getNumTrialsAdded(), 5u);
+    EXPECT_EQ (history.getFirstStoredTrial(), 2u);
+    for (std::uint64_t trial = 2; trial < 5; ++trial)
+    {
+        const float* columns = history.getTrial (0, trial);
+        for (int column = 0; column < 4; ++column)
+            EXPECT_FLOAT_EQ (columns[column], static_cast<float> (trial));
+    }
+}
+
+TEST (TrialHistoryTest, ClearStartsNewGeneration)
+{
+    TrialHistory history (1, 4, 3);
+    history.addTrial (makeConstantTrial (4, 1.0f));
+    const auto generation = history.getGeneration();
+
+    history.clear();
+
+    EXPECT_EQ (history.getNumTrialsAdded(), 0u);
+    EXPECT_EQ (history.getFirstStoredTrial(), 0u);
+    EXPECT_NE (history.getGeneration(), generation);
+}
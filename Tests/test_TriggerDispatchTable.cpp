@@ -0,0 +1,107 @@
+#include "TriggerDispatchTable.h"
+#include "TriggerSource.h"
+#include <JuceHeader.h>
+#include <gtest/gtest.h>
+#include <memory>
+
+using namespace TriggeredAverage;
+
+class TriggerDispatchTableTest : public ::testing::Test
+{
+protected:
+    TriggerSource* addSource (int line, TriggerType type)
+    {
+        const auto id = static_cast<ConditionId> (ownedSources.size() + 1);
+        auto* source = ownedSources.add (
+            new TriggerSource (nullptr, "Condition " + String (id), line, type, id));
+        sources.add (source);
+        return source;
+    }
+
+    OwnedArray<TriggerSource> ownedSources;
+    Array<TriggerSource*> sources;
+};
+
+TEST_F (TriggerDispatchTableTest, EmptyTable)
+{
+    TriggerDispatchTable table (sources, 10, 20);
+    EXPECT_TRUE (table.getEntriesForLine (0).empty());
+    EXPECT_TRUE (table.getEntriesForAnyLine().empty());
+    EXPECT_EQ (table.getPreSamples(), 10);
+    EXPECT_EQ (table.getPostSamples(), 20);
+}
+
+TEST_F (TriggerDispatchTableTest, SourcesAreIndexedByLine)
+{
+    auto* line3a = addSource (3, TriggerType::TTL_TRIGGER);
+    auto* line7 = addSource (7, TriggerType::TTL_AND_MSG_TRIGGER);
+    auto* line3b = addSource (3, TriggerType::TTL_TRIGGER);
+    auto* any = addSource (TriggerDispatchTable::anyLine, TriggerType::TTL_TRIGGER);
+
+    TriggerDispatchTable table (sources, 100, 200);
+
+    auto line3Entries = table.getEntriesForLine (3);
+    ASSERT_EQ (line3Entries.size(), 2u);
+    EXPECT_EQ (table.getSource (line3Entries[0].sourceIndex).id, line3a->id);
+    EXPECT_EQ (table.getSource (line3Entries[1].sourceIndex).id, line3b->id);
+    EXPECT_EQ (line3Entries[0].preSamples, 100);
+    EXPECT_EQ (line3Entries[0].postSamples, 200);
+
+    auto line7Entries = table.getEntriesForLine (7);
+    ASSERT_EQ (line7Entries.size(), 1u);
+    EXPECT_EQ (table.getSource (line7Entries[0].sourceIndex).id, line7->id);
+    EXPECT_EQ (table.getSource (line7Entries[0].sourceIndex).type,
+               TriggerType::TTL_AND_MSG_TRIGGER);
+
+    auto anyEntries = table.getEntriesForAnyLine();
+    ASSERT_EQ (anyEntries.size(), 1u);
+    EXPECT_EQ (table.getSource (anyEntries[0].sourceIndex).id, any->id);
+
+    EXPECT_TRUE (table.getEntriesForLine (0).empty());
+    EXPECT_TRUE (table.getEntriesForLine (255).empty());
+}
+
+TEST_F (TriggerDispatchTableTest, MessageOnlySourcesAreNotDispatchedOnTtl)
+{
+    addSource (1, TriggerType::MSG_TRIGGER);
+    TriggerDispatchTable table (sources, 1, 1);
+    EXPECT_TRUE (table.getEntriesForLine (1).empty());
+}
+
+TEST_F (TriggerDispatchTableTest, OutOfRangeLinesAreIgnored)
+{
+    addSource (256, TriggerType::TTL_TRIGGER);
+    addSource (-2, TriggerType::TTL_TRIGGER);
+    TriggerDispatchTable table (sources, 1, 1);
+    EXPECT_TRUE (table.getEntriesForLine (256).empty());
+    EXPECT_TRUE (table.getEntriesForLine (-2).empty());
+    EXPECT_TRUE (table.getEntriesForAnyLine().empty());
+}
+
+TEST_F (TriggerDispatchTableTest, TtlAndMessageSourcesFireOncePerArm)
+{
+    addSource (2, TriggerType::TTL_AND_MSG_TRIGGER);
+    TriggerDispatchTable table (sources, 1, 1);
+    const int index = table.getEntriesForLine (2)[0].sourceIndex;
+
+    EXPECT_FALSE (table.tryTrigger (index));
+    table.arm (index);
+    EXPECT_TRUE (table.tryTrigger (index));
+    EXPECT_FALSE (table.tryTrigger (index));
+}
+
+TEST_F (TriggerDispatchTableTest, ArmedStateIsCarriedOverById)
+{
+    addSource (2, TriggerType::TTL_AND_MSG_TRIGGER);
+    TriggerDispatchTable previous (sources, 1, 1);
+    previous.arm (0);
+
+    // a new source in front shifts the index but not the id
+    auto* inserted =
+        ownedSources.add (new TriggerSource (nullptr, "New", 5, TriggerType::TTL_TRIGGER, 99));
+    sources.insert (0, inserted);
+    TriggerDispatchTable next (sources, 1, 1, &previous);
+
+    EXPECT_TRUE (next.isArmed (1));
+    EXPECT_TRUE (next.tryTrigger (1));
+}
@@ -0,0 +1,431 @@
+/*
+    triggered-avg-benchmark: drives the ring buffer and collector the way
+    TriggeredAvgNode::process does, with 30 kHz blocks from SyntheticSource (noise, line noise,
+    drift and an evoked response) paced in real time, to find the largest configuration a
+    workstation sustains.
+
+    triggered-avg-benchmark [options]
+        --channels <n,...>    channel counts, default 64,384,1024
+        --rates <hz,...>      mean trigger rates, default 0.1,1,10,100
+        --triggers <type>     "poisson" (default) or "periodic"
+        --seconds <s>         duration of each configuration, default 10
+        --block <samples>     samples per block, default 1024
+        --pre <ms>            pre-trigger window, default 500
+        --post <ms>           post-trigger window, default 2000
+        --trace <file>        write the timing zones of all runs as a Chrome trace; needs
+                              TRIGGERED_AVG_TIMING_ZONES
+        --archive <file>      also write every accumulated trial to a trial archive, which
+                              each configuration overwrites
+
+    For every configuration it prints the audio-thread time per block (p50/p99/max, and the
+    maximum as a share of the block's real-time budget), the latency from a trigger's window
+    being complete to its trial being accumulated, the CPU use of the collector thread, the
+    number of completed windows that were not accumulated, and the peak RSS of the process
+    so far. Configurations run in increasing order of size, so the peak belongs to the
+    current one. With --archive it also prints how many trials were archived and dropped.
+    Built with TRIGGERED_AVG_REALTIME_CHECKS, it also counts allocations and
+    locks in the audio thread's part of each block.
+*/
+
+#include "DataCollector.h"
+#include "MultiChannelRingBuffer.h"
+#include "RealtimeSafety.h"
+#include "Synthetic/SyntheticSource.h"
+#include "TimingZones.h"
+#include "TrialArchive.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#if ! JUCE_WINDOWS
+    #include <sys/resource.h>
+    #include <time.h>
+#endif
+
+using namespace TriggeredAverage;
+
+namespace
+{
+constexpr double sampleRate = 30000.0;
+constexpr ConditionId conditionId = 1;
+
+struct Options
+{
+    std::vector<int> channelCounts { 64, 384, 1024 };
+    std::vector<double> triggerRates { 0.1, 1.0, 10.0, 100.0 };
+    bool poisson = true;
+    double seconds = 10.0;
+    int blockSize = 1024;
+    double preMs = 500.0;
+    double postMs = 2000.0;
+    juce::String traceFile;
+    juce::String archiveFile;
+};
+
+struct Percentiles
+{
+    double p50 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+Percentiles getPercentiles (std::vector<double> values)
+{
+    if (values.empty())
+        return {};
+
+    std::sort (values.begin(), values.end());
+    auto at = [&values] (double fraction)
+    { return values[static_cast<size_t> (fraction * static_cast<double> (values.size() - 1))]; };
+    return { at (0.5), at (0.99), values.back() };
+}
+
+// CPU time of the calling thread
+double getThreadCpuSeconds()
+{
+#if JUCE_WINDOWS
+    return 0.0;
+#else
+    timespec time {};
+    clock_gettime (CLOCK_THREAD_CPUTIME_ID, &time);
+    return static_cast<double> (time.tv_sec) + static_cast<double> (time.tv_nsec) * 1.0e-9;
+#endif
+}
+
+double getPeakRssMegabytes()
+{
+#if JUCE_WINDOWS
+    return 0.0;
+#else
+    rusage usage {};
+    getrusage (RUSAGE_SELF, &usage);
+    #if JUCE_MAC
+    return static_cast<double> (usage.ru_maxrss) / (1024.0 * 1024.0); // bytes
+    #else
+    return static_cast<double> (usage.ru_maxrss) / 1024.0; // kilobytes
+    #endif
+#endif
+}
+
+/**
+    Matches accumulated trials to the time their window was completed. The audio thread
+    records completion times before adding the completing block, the collector thread's
+    update callback matches them in trigger order, which is the order of accumulation.
+*/
+class LatencyRecorder
+{
+public:
+    explicit LatencyRecorder (size_t maxNumTriggers) : m_completedAtMs (maxNumTriggers)
+    {
+        m_latenciesMs.reserve (maxNumTriggers);
+    }
+
+    // audio thread
+    void windowCompleted (double nowMs)
+    {
+        const auto index = m_numCompleted.load (std::memory_order_relaxed);
+        if (index == m_completedAtMs.size())
+            return;
+        m_completedAtMs[index] = nowMs;
+        m_numCompleted.store (index + 1, std::memory_order_release);
+    }
+
+    // collector thread
+    void trialsAccumulated (int numTrials, double nowMs)
+    {
+        const auto numCompleted = m_numCompleted.load (std::memory_order_acquire);
+        const auto numMatched = std::min (static_cast<size_t> (numTrials), numCompleted);
+        for (; m_numMatched < numMatched; ++m_numMatched)
+            m_latenciesMs.push_back (nowMs - m_completedAtMs[m_numMatched]);
+        m_numMatchedShared.store (m_numMatched);
+    }
+
+    size_t getNumCompleted() const { return m_numCompleted.load(); }
+    size_t getNumMatched() const { return m_numMatchedShared.load(); }
+
+    // after the collector has stopped
+    const std::vector<double>& getLatenciesMs() const { return m_latenciesMs; }
+
+private:
+    std::vector<double> m_completedAtMs;
+    std::atomic<size_t> m_numCompleted { 0 };
+    size_t m_numMatched = 0;
+    std::atomic<size_t> m_numMatchedShared { 0 };
+    std::vector<double> m_latenciesMs;
+};
+
+void runConfiguration (const Options& options, int numChannels, double triggerRate)
+{
+    const int blockSize = options.blockSize;
+    const int preSamples = juce::roundToInt (options.preMs * sampleRate / 1000.0);
+    const int postSamples = juce::roundToInt (options.postMs * sampleRate / 1000.0);
+    const auto numBlocks = static_cast<int> (options.seconds * sampleRate / blockSize);
+
+    SyntheticSettings settings;
+    settings.numChannels = numChannels;
+    settings.sampleRate = sampleRate;
+    settings.noiseRms = 20.0f;
+    settings.lineNoiseAmplitude = 10.0f;
+    settings.maxDriftPerSecond = 5.0f;
+    settings.triggers.push_back (
+        { .ttlLine = 0, .rateHz = triggerRate, .poisson = options.poisson });
+    settings.responses.push_back ({ .ttlLine = 0 });
+    settings.jitterMs = 1.0;
+    SyntheticSource source (settings);
+    juce::AudioBuffer<float> block (numChannels, blockSize);
+    std::vector<TtlEvent> events;
+    events.reserve (1024);
+
+    // room for far more triggers than a Poisson process produces at this rate
+    const auto maxNumTriggers = static_cast<size_t> (triggerRate * options.seconds * 2.0) + 64;
+    std::vector<SampleNumber> triggers;
+    triggers.reserve (maxNumTriggers);
+
+    // sized like the plugin's ring buffer: ten seconds
+    MultiChannelRingBuffer ringBuffer (numChannels, static_cast<int> (sampleRate * 10.0));
+    DataStore store;
+    LatencyRecorder latencies (maxNumTriggers);
+    std::atomic<double> collectorCpuSeconds { 0.0 };
+
+    DataCollector collector (
+        [&]
+        {
+            int numTrials = 0;
+            {
+                auto lock = store.GetLock();
+                if (auto* buffer = store.getRefToAverageBufferForCondition (conditionId))
+                    numTrials = buffer->getNumTrials();
+            }
+            latencies.trialsAccumulated (numTrials, juce::Time::getMillisecondCounterHiRes());
+            collectorCpuSeconds.store (getThreadCpuSeconds());
+        },
+        &ringBuffer,
+        &store);
+    if (options.archiveFile.isNotEmpty())
+        collector.setTrialArchive (std::make_unique<TrialArchiveWriter> (
+            juce::File::getCurrentWorkingDirectory().getChildFile (options.archiveFile),
+            TrialArchiveWriter::getBufferBytesFor (numChannels, preSamples + postSamples)));
+    collector.startThread (juce::Thread::Priority::high);
+
+    std::vector<double> blockTimesUs;
+    blockTimesUs.reserve (static_cast<size_t> (numBlocks));
+    size_t nextCompletion = 0;
+
+    TimingZones::registerCurrentThread ("audio");
+    RealtimeSafety::resetViolationCounts();
+    const auto startTime = std::chrono::steady_clock::now();
+    const auto blockDuration = std::chrono::duration<double> (blockSize / sampleRate);
+    for (int b = 0; b < numBlocks; ++b)
+    {
+        // generated in the block's time slot, but not timed
+        events.clear();
+        const SampleNumber firstSample = source.nextBlock (block, blockSize, events);
+        const SampleNumber endSample = firstSample + blockSize;
+        const auto before = juce::Time::getMillisecondCounterHiRes();
+
+        while (nextCompletion < triggers.size()
+               && triggers[nextCompletion] + postSamples <= endSample)
+        {
+            latencies.windowCompleted (before);
+            ++nextCompletion;
+        }
+
+        // what TriggeredAvgNode::process does per block
+        {
+            const RealtimeSafety::ScopedRealtimeSection realtimeSection;
+            ringBuffer.addData (block, firstSample, static_cast<juce::uint32> (blockSize));
+            for (const auto& event : events)
+            {
+                // a window starting before the first sample could never be accumulated
+                if (! event.state || event.sampleNumber < preSamples
+                    || triggers.size() == maxNumTriggers)
+                    continue;
+
+                triggers.push_back (event.sampleNumber);
+                collector.registerCaptureRequest (
+                    CaptureRequest { .conditionId = conditionId,
+                                     .triggerSample = event.sampleNumber,
+                                     .preSamples = preSamples,
+                                     .postSamples = postSamples });
+            }
+        }
+
+        blockTimesUs.push_back ((juce::Time::getMillisecondCounterHiRes() - before) * 1000.0);
+        std::this_thread::sleep_until (
+            startTime
+            + std::chrono::duration_cast<std::chrono::steady_clock::duration> (blockDuration
+                                                                               * (b + 1)));
+    }
+    const double elapsedSeconds =
+        std::chrono::duration<double> (std::chrono::steady_clock::now() - startTime).count();
+
+    // give the collector a moment to catch up with the last completed windows
+    const auto deadline = juce::Time::getMillisecondCounterHiRes() + 2000.0;
+    while (latencies.getNumMatched() < latencies.getNumCompleted()
+           && juce::Time::getMillisecondCounterHiRes() < deadline)
+        juce::Thread::sleep (10);
+    collector.stopThread (1000);
+    auto archive = collector.setTrialArchive (nullptr);
+    if (archive != nullptr)
+        archive->finish();
+
+    const auto blockTimes = getPercentiles (blockTimesUs);
+    const auto latency = getPercentiles (latencies.getLatenciesMs());
+    const double budgetUs = blockSize / sampleRate * 1.0e6;
+    const double collectorCpuPercent =
+        100.0 * collectorCpuSeconds.load() / elapsedSeconds;
+
+    std::printf ("%8d %8.1f %8.0f %8.0f %8.0f %7.1f%% %8.1f %8.1f %8.1f %7.1f%% %8zu %9.0f\n",
+                 numChannels,
+                 triggerRate,
+                 blockTimes.p50,
+                 blockTimes.p99,
+                 blockTimes.max,
+                 100.0 * blockTimes.max / budgetUs,
+                 latency.p50,
+                 latency.p99,
+                 latency.max,
+                 collectorCpuPercent,
+                 latencies.getNumCompleted() - latencies.getNumMatched(),
+                 getPeakRssMegabytes());
+    if (RealtimeSafety::isEnabled)
+    {
+        const auto violations = RealtimeSafety::getViolationCounts();
+        std::printf ("%17s real-time violations: %d allocations, %d deallocations, %d locks\n",
+                     "",
+                     violations.allocations,
+                     violations.deallocations,
+                     violations.locks);
+    }
+    if (archive != nullptr)
+    {
+        const auto status = archive->getStatus();
+        std::printf ("%17s archive: %d trials, %d dropped, %.1f MB%s%s\n",
+                     "",
+                     archive->getNumArchivedTrials(),
+                     archive->getNumDroppedTrials(),
+                     static_cast<double> (archive->getFile().getSize()) / (1024.0 * 1024.0),
+                     status.failed() ? ", " : "",
+                     status.getErrorMessage().toRawUTF8());
+    }
+    std::fflush (stdout);
+}
+
+template <typename T>
+bool parseList (const juce::String& text, std::vector<T>& values)
+{
+    values.clear();
+    for (const auto& item : juce::StringArray::fromTokens (text, ",", ""))
+    {
+        const auto value = static_cast<T> (item.getDoubleValue());
+        if (value <= 0)
+            return false;
+        values.push_back (value);
+    }
+    std::sort (values.begin(), values.end());
+    return ! values.empty();
+}
+
+bool parseOptions (int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String argument (argv[i]);
+        if (i + 1 >= argc)
+            return false;
+
+        const juce::String value (argv[++i]);
+        if (argument == "--channels")
+        {
+            if (! parseList (value, options.channelCounts))
+                return false;
+        }
+        else if (argument == "--rates")
+        {
+            if (! parseList (value, options.triggerRates))
+                return false;
+        }
+        else if (argument == "--triggers" && (value == "poisson" || value == "periodic"))
+            options.poisson = value == "poisson";
+        else if (argument == "--seconds")
+            options.seconds = value.getDoubleValue();
+        else if (argument == "--block")
+            options.blockSize = value.getIntValue();
+        else if (argument == "--pre")
+            options.preMs = value.getDoubleValue();
+        else if (argument == "--post")
+            options.postMs = value.getDoubleValue();
+        else if (argument == "--trace")
+            options.traceFile = value;
+        else if (argument == "--archive")
+            options.archiveFile = value;
+        else
+            return false;
+    }
+    return options.seconds > 0.0 && options.blockSize > 0 && options.preMs >= 0.0
+           && options.postMs > 0.0;
+}
+} // namespace
+
+int main (int argc, char* argv[])
+{
+    Options options;
+    if (! parseOptions (argc, argv, options))
+    {
+        std::fprintf (stderr,
+                      "usage: triggered-avg-benchmark [--channels n,...] [--rates hz,...] "
+                      "[--triggers poisson|periodic] [--seconds s] [--block samples] "
+                      "[--pre ms] [--post ms] [--trace file] [--archive file]\n");
+        return 1;
+    }
+
+    std::printf ("%s triggers, %d-sample blocks at 30 kHz (%.0f us budget), window -%.0f/+%.0f "
+                 "ms, %.0f s per configuration\n",
+                 options.poisson ? "Poisson" : "Periodic",
+                 options.blockSize,
+                 options.blockSize / sampleRate * 1.0e6,
+                 options.preMs,
+                 options.postMs,
+                 options.seconds);
+    std::printf ("%8s %8s %26s %8s %26s %8s %8s %9s\n",
+                 "",
+                 "",
+                 "audio thread per block us",
+                 "",
+                 "trigger to accumulated ms",
+                 "",
+                 "",
+                 "");
+    std::printf ("%8s %8s %8s %8s %8s %8s %8s %8s %8s %8s %8s %9s\n",
+                 "channels",
+                 "rate Hz",
+                 "p50",
+                 "p99",
+                 "max",
+                 "budget",
+                 "p50",
+                 "p99",
+                 "max",
+                 "collect",
+                 "missed",
+                 "peak MB");
+
+    for (int numChannels : options.channelCounts)
+        for (double rate : options.triggerRates)
+            runConfiguration (options, numChannels, rate);
+
+    if (options.traceFile.isNotEmpty())
+    {
+        const auto result = TimingZones::writeChromeTrace (
+            juce::File::getCurrentWorkingDirectory().getChildFile (options.traceFile));
+        if (result.failed())
+        {
+            std::fprintf (stderr, "%s\n", result.getErrorMessage().toRawUTF8());
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,183 @@
+/*
+    triggered-avg-replay: averages a recorded Open Ephys binary session offline, using the
+    same collector and accumulators as the plugin, and writes the results as .npy files.
+
+    triggered-avg-replay <recording folder> <output folder> [options]
+        --ttl <line>[=name]  add a condition triggered by a TTL line (one-based, as in the
+                             GUI), or by every line with "any"; may be repeated
+        --pre <ms>           pre-trigger window, default 500
+        --post <ms>          post-trigger window, default 2000
+        --stream <index>     continuous stream of the recording, default 0
+        --block <samples>    block size fed through the ring buffer, default 4096
+        --threads <count>    worker threads, default one per CPU core
+*/
+
+#include "DataCollector.h"
+#include "Offline/BinaryRecording.h"
+#include "Offline/OfflineReplay.h"
+#include "Offline/SnapshotExport.h"
+
+#include <iostream>
+#include <optional>
+#include <set>
+
+using namespace TriggeredAverage;
+
+namespace
+{
+struct Options
+{
+    juce::File recordingFolder;
+    juce::File outputFolder;
+    std::vector<juce::String> ttlConditions;
+    double preMs = 500.0;
+    double postMs = 2000.0;
+    int streamIndex = 0;
+    int blockSize = 4096;
+    int numThreads = juce::SystemStats::getNumCpus();
+};
+
+int fail (const juce::String& message)
+{
+    std::cerr << message << std::endl;
+    return 1;
+}
+
+bool parseOptions (int argc, char* argv[], Options& options)
+{
+    juce::StringArray positional;
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String argument (argv[i]);
+        const bool hasValue = i + 1 < argc;
+        if (argument == "--ttl" && hasValue)
+            options.ttlConditions.push_back (argv[++i]);
+        else if (argument == "--pre" && hasValue)
+            options.preMs = juce::String (argv[++i]).getDoubleValue();
+        else if (argument == "--post" && hasValue)
+            options.postMs = juce::String (argv[++i]).getDoubleValue();
+        else if (argument == "--stream" && hasValue)
+            options.streamIndex = juce::String (argv[++i]).getIntValue();
+        else if (argument == "--block" && hasValue)
+            options.blockSize = juce::String (argv[++i]).getIntValue();
+        else if (argument == "--threads" && hasValue)
+            options.numThreads = juce::String (argv[++i]).getIntValue();
+        else if (argument.startsWith ("--"))
+            return false;
+        else
+            positional.add (argument);
+    }
+
+    if (positional.size() != 2 || options.ttlConditions.empty() || options.blockSize <= 0
+        || options.numThreads <= 0)
+        return false;
+
+    const auto currentFolder = juce::File::getCurrentWorkingDirectory();
+    options.recordingFolder = currentFolder.getChildFile (positional[0]);
+    options.outputFolder = currentFolder.getChildFile (positional[1]);
+    return true;
+}
+
+// "3" or "3=Reward" or "any"; nothing for other lines, as -1 would mean every line
+std::optional<ReplayCondition> parseCondition (const juce::String& text, ConditionId id)
+{
+    const auto line = text.upToFirstOccurrenceOf ("=", false, false).trim();
+    const bool anyLine = line.equalsIgnoreCase ("any");
+    if (! anyLine && (! line.containsOnly ("0123456789") || line.getIntValue() < 1))
+        return std::nullopt;
+
+    auto name = text.fromFirstOccurrenceOf ("=", false, false).trim();
+    if (name.isEmpty())
+        name = anyLine ? juce::String ("TTL any") : "TTL " + line;
+
+    return ReplayCondition { .id = id,
+                             .name = name,
+                             .ttlLine = anyLine ? -1 : line.getIntValue() - 1 };
+}
+} // namespace
+
+int main (int argc, char* argv[])
+{
+    Options options;
+    if (! parseOptions (argc, argv, options))
+    {
+        return fail ("usage: triggered-avg-replay <recording folder> <output folder> "
+                     "--ttl <line>[=name] [--ttl ...] [--pre ms] [--post ms] [--stream index] "
+                     "[--block samples] [--threads count]");
+    }
+
+    ReplaySettings settings;
+    for (const auto& text : options.ttlConditions)
+    {
+        const auto id = static_cast<ConditionId> (settings.conditions.size() + 1);
+        const auto condition = parseCondition (text, id);
+        if (! condition)
+            return fail ("Invalid TTL line \"" + text + "\": expected a line from 1 or \"any\"");
+        settings.conditions.push_back (*condition);
+    }
+
+    BinaryRecording recording;
+    if (auto result = recording.open (options.recordingFolder, options.streamIndex);
+        result.failed())
+        return fail (result.getErrorMessage());
+
+    settings.preSamples = juce::roundToInt (options.preMs * recording.getSampleRate() / 1000.0);
+    settings.postSamples = juce::roundToInt (options.postMs * recording.getSampleRate() / 1000.0);
+    settings.blockSize = options.blockSize;
+
+    std::cout << "Averaging " << recording.getStreamName() << ": "
+              << recording.getNumChannels() << " channels, " << recording.getNumSamples()
+              << " samples, " << recording.getTtlEvents().size() << " TTL events" << std::endl;
+
+    DataStore store;
+    OfflineReplay replay (recording, settings);
+    const auto stats = options.numThreads > 1 ? replay.runParallel (store, options.numThreads)
+                                              : replay.run (store);
+
+    std::cout << stats.numTrialsAccumulated << " of " << stats.numTriggers
+              << " triggers averaged, " << stats.numSamplesRead << " samples read in "
+              << stats.seconds << " s on " << options.numThreads << " threads" << std::endl;
+
+    if (auto result = options.outputFolder.createDirectory(); result.failed())
+        return fail (result.getErrorMessage());
+
+    auto summary = std::make_unique<juce::DynamicObject>();
+    summary->setProperty ("recording", options.recordingFolder.getFullPathName());
+    summary->setProperty ("stream", recording.getStreamName());
+    summary->setProperty ("sample_rate", recording.getSampleRate());
+    summary->setProperty ("pre_samples", settings.preSamples);
+    summary->setProperty ("post_samples", settings.postSamples);
+    summary->setProperty ("channel_names", recording.getChannelNames());
+
+    // conditions with the same name get their id appended, as in exportConditionsAsNpy
+    juce::Array<juce::var> conditions;
+    std::set<juce::String> usedPrefixes;
+    for (const auto& condition : settings.conditions)
+    {
+        const auto prefix = makeUniquePrefix (
+            juce::File::createLegalFileName (condition.name).replaceCharacter (' ', '_'),
+            condition.id,
+            usedPrefixes);
+        auto entry = std::make_unique<juce::DynamicObject>();
+        entry->setProperty ("name", condition.name);
+        entry->setProperty ("ttl_line", condition.ttlLine < 0 ? -1 : condition.ttlLine + 1);
+        entry->setProperty ("files", prefix);
+
+        auto snapshot = store.getAverageSnapshot (condition.id);
+        entry->setProperty ("num_trials", snapshot != nullptr ? snapshot->numTrials : 0);
+        if (snapshot != nullptr)
+        {
+            if (auto result = writeSnapshotAsNpy (*snapshot, options.outputFolder, prefix);
+                result.failed())
+                return fail (result.getErrorMessage());
+        }
+        conditions.add (entry.release());
+    }
+    summary->setProperty ("conditions", conditions);
+
+    const auto summaryFile = options.outputFolder.getChildFile ("summary.json");
+    if (! summaryFile.replaceWithText (juce::JSON::toString (juce::var (summary.release()))))
+        return fail ("Could not write " + summaryFile.getFullPathName());
+
+    return 0;
+}